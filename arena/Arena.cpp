@@ -0,0 +1,118 @@
+#include "Arena.h"
+#include <stdlib.h>
+#include "../metrics/Metrics.h"
+
+thread_local Arena *Arena::t_current = NULL;
+
+static inline size_t align_up(size_t size){
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+//块头占满一个对齐单位，数据区的起点同样16字节对齐
+static const size_t BLOCK_HEADER = 16;
+
+Arena::Arena(){
+    m_blocks = NULL;
+    m_large = NULL;
+    m_ptr = NULL;
+    m_end = NULL;
+    m_used = 0;
+}
+
+Arena::~Arena(){
+    Reset();
+    while(m_blocks){
+        Arena_block *next = m_blocks->m_next;
+        free(m_blocks);
+        m_blocks = next;
+    }
+    if(t_current == this){
+        t_current = NULL;
+    }
+}
+
+/*
+@ function: 分配size字节，第一次分配时才申请第一块，没有处理过请求的线程不占内存
+@ param: size (size_t)
+@ return: (void *)
+*/
+void *Arena::Allocate(size_t size){
+    size = align_up(size ? size : 1);
+    if(size > ARENA_LARGE_SIZE){
+        return AllocateLarge(size);
+    }
+    if((size_t)(m_end - m_ptr) < size && !Grow()){
+        return NULL;
+    }
+    void *ptr = m_ptr;
+    m_ptr += size;
+    m_used += size;
+    return ptr;
+}
+
+void Arena::Free(void *ptr, size_t size){
+    if(!ptr){
+        return;
+    }
+    size = align_up(size ? size : 1);
+    if(size > ARENA_LARGE_SIZE){
+        //大块在Reset()时统一释放
+        return;
+    }
+    if((char *)ptr + size == m_ptr){
+        m_ptr = (char *)ptr;
+        m_used -= size;
+    }
+}
+
+bool Arena::Grow(){
+    Arena_block *block = (Arena_block *)malloc(BLOCK_HEADER + ARENA_BLOCK_SIZE);
+    if(!block){
+        return false;
+    }
+    METRICS_COUNT("arena.blocks", 1);
+    block->m_size = ARENA_BLOCK_SIZE;
+    block->m_next = m_blocks;
+    m_blocks = block;
+    m_ptr = (char *)block + BLOCK_HEADER;
+    m_end = m_ptr + ARENA_BLOCK_SIZE;
+    return true;
+}
+
+void *Arena::AllocateLarge(size_t size){
+    Arena_block *block = (Arena_block *)malloc(BLOCK_HEADER + size);
+    if(!block){
+        return NULL;
+    }
+    METRICS_COUNT("arena.large", 1);
+    block->m_size = size;
+    block->m_next = m_large;
+    m_large = block;
+    m_used += size;
+    return (char *)block + BLOCK_HEADER;
+}
+
+/*
+@ function: 收回全部分配，只保留第一块
+@ return: 无
+*/
+void Arena::Reset(){
+    if(m_used > 0){
+        METRICS_RECORD("arena.request_bytes", (long)m_used);
+    }
+    while(m_large){
+        Arena_block *next = m_large->m_next;
+        free(m_large);
+        m_large = next;
+    }
+    while(m_blocks && m_blocks->m_next){
+        Arena_block *next = m_blocks->m_next;
+        free(m_blocks);
+        m_blocks = next;
+    }
+    if(m_blocks){
+        m_ptr = (char *)m_blocks + BLOCK_HEADER;
+        m_end = m_ptr + m_blocks->m_size;
+    }
+    m_used = 0;
+}
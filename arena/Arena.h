@@ -0,0 +1,155 @@
+#ifndef ARENA_H
+#define ARENA_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <stddef.h>
+#include <new>
+#include <string>
+#include <vector>
+
+//每块64KB，一个普通请求的临时数据通常一块就够
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+//超过块大小1/4的分配单独malloc，避免一次大分配浪费整块剩余空间
+const size_t ARENA_LARGE_SIZE = ARENA_BLOCK_SIZE / 4;
+
+//所有分配按16字节对齐，满足long double和SSE类型
+const size_t ARENA_ALIGN = 16;
+
+/*
+class: Arena
+请求级的线性分配器
+@ function: 分配只移动指针，释放只在Reset()时整体进行；每个工作线程一个，处理完一个请求后Reset()，
+            请求期间的临时字符串、解析结果不再经过malloc的共享arena，也不需要逐个释放；
+            Reset()只保留第一块，请求偶尔用多了不会让线程长期占着内存
+public:
+@ func: Allocate()
+@ param size: (size_t)
+@ return: (void *) 16字节对齐，内存不足时返回NULL
+
+@ func: Free()
+@ param ptr: (void *) 只有最近一次分配能真正收回，例如string扩容时旧的缓冲区，其余忽略
+@ param size: (size_t)
+@ return: 无
+
+@ func: Reset()
+@ function: 收回全部分配，释放多余的块和单独分配的大块
+@ return: 无
+
+@ func: Used()
+@ return: (size_t) 上次Reset()以来分配出去的字节数
+
+@ func: Current() / SetCurrent() 静态函数
+@ function: 当前线程的Arena，不是工作线程时为NULL
+*/
+class Arena{
+public:
+    Arena();
+
+    ~Arena();
+
+    void *Allocate(size_t size);
+
+    void Free(void *ptr, size_t size);
+
+    void Reset();
+
+    size_t Used() const { return m_used; }
+
+    static Arena *Current() { return t_current; }
+
+    static void SetCurrent(Arena *arena) { t_current = arena; }
+
+private:
+    //块头，数据紧跟其后
+    struct Arena_block
+    {
+        Arena_block *m_next;
+        size_t m_size;
+    };
+
+    //当前块用完，取下一块
+    bool Grow();
+
+    void *AllocateLarge(size_t size);
+
+    //普通块，m_blocks为正在使用的块，链表尾是第一块
+    Arena_block *m_blocks;
+
+    //单独分配的大块
+    Arena_block *m_large;
+
+    char *m_ptr;
+
+    char *m_end;
+
+    size_t m_used;
+
+    static thread_local Arena *t_current;
+
+    Arena(const Arena &);
+
+    Arena &operator=(const Arena &);
+};
+
+/*
+class: Arena_allocator
+标准库容器使用的分配器
+@ function: 构造时记下当前线程的Arena，之后的分配都从它取；没有Arena的线程退回operator new，
+            所以同一份代码在工作线程和主线程中都能用。
+            容器必须在请求处理完之前析构，不能放进连接对象或跨线程传递
+*/
+template <typename T>
+class Arena_allocator{
+public:
+    typedef T value_type;
+
+    Arena_allocator() : m_arena(Arena::Current()) {}
+
+    explicit Arena_allocator(Arena *arena) : m_arena(arena) {}
+
+    template <typename U>
+    Arena_allocator(const Arena_allocator<U> &other) : m_arena(other.m_arena) {}
+
+    T *allocate(size_t n)
+    {
+        if (!m_arena)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        void *ptr = m_arena->Allocate(n * sizeof(T));
+        if (!ptr)
+            throw std::bad_alloc();
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T *ptr, size_t n)
+    {
+        if (!m_arena)
+            ::operator delete(ptr);
+        else
+            m_arena->Free(ptr, n * sizeof(T));
+    }
+
+    Arena *m_arena;
+};
+
+template <typename T, typename U>
+inline bool operator==(const Arena_allocator<T> &a, const Arena_allocator<U> &b)
+{
+    return a.m_arena == b.m_arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const Arena_allocator<T> &a, const Arena_allocator<U> &b)
+{
+    return a.m_arena != b.m_arena;
+}
+
+//请求期间的字符串和数组
+typedef std::basic_string<char, std::char_traits<char>, Arena_allocator<char> > Arena_string;
+
+template <typename T>
+using Arena_vector = std::vector<T, Arena_allocator<T> >;
+
+#endif
@@ -0,0 +1,193 @@
+/*************************************************************
+*请求级分配器基准测试
+*每个线程反复处理同一个HTTP请求：解析请求行和头部、拼出文件路径和响应头，
+*heap模式使用std::string/std::vector，arena模式使用Arena_string/Arena_vector，每个请求后Reset()，与工作线程相同；
+*统计每秒请求数、每个请求的malloc次数和测试前后的RSS增长
+*malloc次数通过替换malloc（转调glibc的__libc_malloc）统计，只适用于glibc
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_arena.cpp arena/Arena.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp -o bench_arena
+*运行: ./bench_arena [每个线程的请求数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include "bench_util.h"
+#include "../arena/Arena.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+static thread_local long long t_mallocs = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    ++t_mallocs;
+    return __libc_malloc(size);
+}
+
+static const char REQUEST[] =
+    "GET /static/images/gallery/2024/summer/picture_0042_large.jpg?width=1280&height=720 HTTP/1.1\r\n"
+    "Host: www.tinywebserver.example.com:9006\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:126.0) Gecko/20100101 Firefox/126.0\r\n"
+    "Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: http://www.tinywebserver.example.com:9006/gallery.html\r\n"
+    "Cookie: session=8f2c1e0b7a6d4c3b9e8f7a6b5c4d3e2f; theme=dark; lang=zh-CN\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+//解析并组装响应，返回响应长度防止被优化掉
+template <typename String>
+static size_t handle_request(const char *text)
+{
+    typedef typename String::allocator_type Char_allocator;
+    typedef std::pair<String, String> Header;
+    typedef typename std::allocator_traits<Char_allocator>::template rebind_alloc<Header> Header_allocator;
+    std::vector<Header, Header_allocator> headers;
+
+    const char *line_end = strstr(text, "\r\n");
+    const char *space1 = (const char *)memchr(text, ' ', line_end - text);
+    const char *space2 = (const char *)memchr(space1 + 1, ' ', line_end - space1 - 1);
+    String method(text, space1);
+    String url(space1 + 1, space2);
+    String version(space2 + 1, line_end);
+
+    const char *p = line_end + 2;
+    while (strncmp(p, "\r\n", 2) != 0)
+    {
+        line_end = strstr(p, "\r\n");
+        const char *colon = (const char *)memchr(p, ':', line_end - p);
+        const char *value = colon + 1;
+        while (*value == ' ')
+            ++value;
+        headers.push_back(Header(String(p, colon), String(value, line_end)));
+        p = line_end + 2;
+    }
+
+    String path("/home/tinywebserver/root");
+    path += url.substr(0, url.find('?'));
+
+    String response(version);
+    response += " 200 OK\r\nContent-Type: image/jpeg\r\n";
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        if (headers[i].first == "Connection")
+        {
+            response += "Connection: ";
+            response += headers[i].second;
+            response += "\r\n";
+        }
+    }
+    response += "Content-Location: ";
+    response += path;
+    response += "\r\n\r\n";
+    return response.size() + method.size();
+}
+
+struct Worker_arg
+{
+    bool arena;
+    int requests;
+    long long mallocs;
+    size_t checksum;
+    Latency_histogram hist;
+};
+
+static void *worker(void *p)
+{
+    Worker_arg *arg = (Worker_arg *)p;
+    Arena arena;
+    if (arg->arena)
+        Arena::SetCurrent(&arena);
+    //第一个请求会申请块，不计入
+    if (arg->arena)
+        handle_request<Arena_string>(REQUEST);
+    else
+        handle_request<std::string>(REQUEST);
+    arena.Reset();
+
+    long long mallocs_before = t_mallocs;
+    for (int i = 0; i < arg->requests; ++i)
+    {
+        long long begin = bench_now_ns();
+        if (arg->arena)
+        {
+            arg->checksum += handle_request<Arena_string>(REQUEST);
+            arena.Reset();
+        }
+        else
+        {
+            arg->checksum += handle_request<std::string>(REQUEST);
+        }
+        arg->hist.record(bench_now_ns() - begin);
+    }
+    arg->mallocs = t_mallocs - mallocs_before;
+    Arena::SetCurrent(NULL);
+    return NULL;
+}
+
+static long rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * 4;
+}
+
+static void run_case(bool use_arena, int threads, int requests)
+{
+    std::vector<Worker_arg> args(threads);
+    std::vector<pthread_t> tids(threads);
+    long rss_before = rss_kb();
+    long long start = bench_now_ns();
+    for (int i = 0; i < threads; ++i)
+    {
+        args[i].arena = use_arena;
+        args[i].requests = requests;
+        args[i].mallocs = 0;
+        args[i].checksum = 0;
+        pthread_create(&tids[i], NULL, worker, &args[i]);
+    }
+    Latency_histogram hist;
+    long long mallocs = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        hist.merge(args[i].hist);
+        mallocs += args[i].mallocs;
+    }
+    long long elapsed = bench_now_ns() - start;
+    long rss_after = rss_kb();
+
+    char case_name[64];
+    snprintf(case_name, sizeof(case_name), "%s_t%d", use_arena ? "arena" : "heap", threads);
+    long long total = (long long)threads * requests;
+    Bench_report("arena", case_name)
+        .param("threads", threads)
+        .param("requests", total)
+        .metric("requests_per_sec", total * 1e9 / elapsed)
+        .metric("mallocs_per_request", (double)mallocs / total)
+        .metric("rss_growth_kb", (double)(rss_after - rss_before))
+        .histogram(hist)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int requests = argc > 1 ? atoi(argv[1]) : 200000;
+    int threads[] = {1, 4, 8};
+    for (int i = 0; i < 3; ++i)
+    {
+        run_case(false, threads[i], requests);
+        run_case(true, threads[i], requests);
+    }
+    return 0;
+}
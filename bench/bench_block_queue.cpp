@@ -0,0 +1,115 @@
+/*************************************************************
+*block_queue基准测试
+*P个生产者、C个消费者，队列元素为入队时间戳，
+*统计吞吐量和入队到出队的延迟分位数；
+*spsc用例为1个生产者、1个消费者下spsc_policy与默认互斥锁版本的对比，另外统计futex唤醒次数
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_block_queue.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp -o bench_block_queue
+*运行: ./bench_block_queue [每个用例的元素总数] [队列容量]
+**************************************************************/
+#include <pthread.h>
+#include <vector>
+#include <type_traits>
+#include "bench_util.h"
+#include "../log/block_queue.h"
+
+//消费者收到该值后退出
+static const long long STOP_ITEM = -1;
+
+template <class Policy>
+struct Queue_case
+{
+    block_queue<long long, Policy> *queue;
+    int items;                     //每个生产者写入的元素数
+    std::vector<long long> latency; //每个消费者的延迟样本
+};
+
+template <class Policy>
+static void *producer(void *arg)
+{
+    Queue_case<Policy> *c = (Queue_case<Policy> *)arg;
+    for (int i = 0; i < c->items; ++i)
+    {
+        //push在队列满时返回false，让出CPU后重试
+        while (!c->queue->push(bench_now_ns()))
+            sched_yield();
+    }
+    return NULL;
+}
+
+template <class Policy>
+static void *consumer(void *arg)
+{
+    Queue_case<Policy> *c = (Queue_case<Policy> *)arg;
+    long long item;
+    while (c->queue->pop(item))
+    {
+        if (item == STOP_ITEM)
+            break;
+        c->latency.push_back(bench_now_ns() - item);
+    }
+    return NULL;
+}
+
+template <class Policy>
+static void run_case(const char *prefix, int producers, int consumers, int total, int capacity)
+{
+    block_queue<long long, Policy> queue(capacity);
+    queue.set_metrics("bench.queue");
+    long wakeups_before = Metrics_registry::GetInstance()->Counter("bench.queue.wakeups")->Value();
+    std::vector<Queue_case<Policy> > prod(producers), cons(consumers);
+    std::vector<pthread_t> prod_tid(producers), cons_tid(consumers);
+
+    for (int i = 0; i < consumers; ++i)
+    {
+        cons[i].queue = &queue;
+        cons[i].latency.reserve(total / consumers + 1);
+        pthread_create(&cons_tid[i], NULL, consumer<Policy>, &cons[i]);
+    }
+
+    long long start = bench_now_ns();
+    for (int i = 0; i < producers; ++i)
+    {
+        prod[i].queue = &queue;
+        prod[i].items = total / producers;
+        pthread_create(&prod_tid[i], NULL, producer<Policy>, &prod[i]);
+    }
+    for (int i = 0; i < producers; ++i)
+        pthread_join(prod_tid[i], NULL);
+    for (int i = 0; i < consumers; ++i)
+        while (!queue.push(STOP_ITEM))
+            sched_yield();
+    for (int i = 0; i < consumers; ++i)
+        pthread_join(cons_tid[i], NULL);
+    long long elapsed = bench_now_ns() - start;
+
+    std::vector<long long> samples;
+    for (int i = 0; i < consumers; ++i)
+        samples.insert(samples.end(), cons[i].latency.begin(), cons[i].latency.end());
+
+    char name[32];
+    snprintf(name, sizeof(name), "%sp%d_c%d", prefix, producers, consumers);
+    Bench_report report("block_queue", name);
+    report.param("producers", producers)
+        .param("consumers", consumers)
+        .param("capacity", capacity)
+        .param("items", (long long)samples.size());
+    //默认版本每次push都broadcast，只有spsc版本统计唤醒次数
+    if (std::is_same<Policy, spsc_policy>::value)
+        report.param("wakeups", Metrics_registry::GetInstance()->Counter("bench.queue.wakeups")->Value() - wakeups_before);
+    report.metric("ops_per_sec", samples.size() * 1e9 / elapsed)
+        .latency(samples)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int total = argc > 1 ? atoi(argv[1]) : 200000;
+    int capacity = argc > 2 ? atoi(argv[2]) : 1024;
+    int threads[] = {1, 2, 4};
+
+    for (int p = 0; p < 3; ++p)
+        for (int c = 0; c < 3; ++c)
+            run_case<mutex_policy>("", threads[p], threads[c], total, capacity);
+    run_case<spsc_policy>("spsc_", 1, 1, total, capacity);
+    return 0;
+}
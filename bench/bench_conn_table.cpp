@@ -0,0 +1,153 @@
+/*************************************************************
+*连接表基准测试
+*N个打开的连接中找出到期的连接，以及按状态统计：
+*aos:  每个连接一个结构体（fd、到期时间、状态之外还有地址、读写缓冲区等冷数据，约与http_conn的头部相当），
+*      按fd号顺序遍历结构体数组，相当于在连接对象上扫描
+*soa:  Conn_table::Expired() / CountStates()，只读到期时间数组和状态数组
+*另外统计Conn_table::Valid()单次检查的耗时，即线程池出队时多出来的开销
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_conn_table.cpp conn/Conn_Table.cpp \
+*      log/log.cpp metrics/Metrics.cpp trace/Trace.cpp -o bench_conn_table
+*运行: ./bench_conn_table [连接数] [扫描次数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <vector>
+#include "bench_util.h"
+#include "../conn/Conn_Table.h"
+
+struct Fat_conn
+{
+    int fd;
+    time_t deadline;
+    int state;
+    sockaddr_in address;
+    char read_buf[2048];
+    long read_idx;
+    char write_buf[1024];
+    long write_idx;
+};
+
+static void run_aos(int conns, int sweeps)
+{
+    std::vector<Fat_conn> table(conns);
+    for (int i = 0; i < conns; ++i)
+    {
+        table[i].fd = i;
+        table[i].deadline = 1000 + i % 15;
+        table[i].state = CONN_ACTIVE + i % 3;
+    }
+    std::vector<int> expired;
+    expired.reserve(conns);
+    long counts[CONN_PARKED + 1];
+    long long found = 0;
+    Latency_histogram hist;
+    long long start = bench_now_ns();
+    for (int s = 0; s < sweeps; ++s)
+    {
+        long long begin = bench_now_ns();
+        expired.clear();
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < conns; ++i)
+        {
+            if (table[i].deadline != 0 && table[i].deadline <= 1000 + s % 15)
+                expired.push_back(table[i].fd);
+            ++counts[table[i].state];
+        }
+        found += expired.size() + counts[CONN_PARKED];
+        hist.record(bench_now_ns() - begin);
+    }
+    long long elapsed = bench_now_ns() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "aos_%d", conns);
+    Bench_report("conn_table", name)
+        .param("conns", conns)
+        .param("sweeps", sweeps)
+        .param("found", found)
+        .metric("ns_per_conn", (double)elapsed / ((double)conns * sweeps))
+        .histogram(hist)
+        .print();
+}
+
+static void run_soa(int conns, int sweeps)
+{
+    Conn_table table;
+    table.Init(conns);
+    for (int i = 0; i < conns; ++i)
+    {
+        Conn_handle handle = table.Open(i, 1000 + i % 15);
+        table.SetState(handle, CONN_ACTIVE + i % 3);
+    }
+    std::vector<Conn_handle> expired;
+    expired.reserve(conns);
+    long counts[CONN_PARKED + 1];
+    long long found = 0;
+    Latency_histogram hist;
+    long long start = bench_now_ns();
+    for (int s = 0; s < sweeps; ++s)
+    {
+        long long begin = bench_now_ns();
+        expired.clear();
+        memset(counts, 0, sizeof(counts));
+        table.Expired(1000 + s % 15, expired);
+        table.CountStates(counts);
+        found += expired.size() + counts[CONN_PARKED];
+        hist.record(bench_now_ns() - begin);
+    }
+    long long elapsed = bench_now_ns() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "soa_%d", conns);
+    Bench_report("conn_table", name)
+        .param("conns", conns)
+        .param("sweeps", sweeps)
+        .param("found", found)
+        .metric("ns_per_conn", (double)elapsed / ((double)conns * sweeps))
+        .histogram(hist)
+        .print();
+}
+
+//一半句柄已经失效，与关闭后又复用槽位的情况相同
+static void run_valid(int conns, int rounds)
+{
+    Conn_table table;
+    table.Init(conns);
+    std::vector<Conn_handle> handles(conns);
+    for (int i = 0; i < conns; ++i)
+        handles[i] = table.Open(i, 0);
+    for (int i = 0; i < conns; i += 2)
+    {
+        table.Close(handles[i]);
+        table.Open(i, 0);
+    }
+    long long valid = 0;
+    long long start = bench_now_ns();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int i = 0; i < conns; ++i)
+            valid += table.Valid(handles[i]);
+    }
+    long long elapsed = bench_now_ns() - start;
+
+    char name[32];
+    snprintf(name, sizeof(name), "valid_%d", conns);
+    Bench_report("conn_table", name)
+        .param("conns", conns)
+        .param("valid", valid)
+        .metric("ns_per_check", (double)elapsed / ((double)conns * rounds))
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = argc > 1 ? atoi(argv[1]) : 60000;
+    int sweeps = argc > 2 ? atoi(argv[2]) : 200;
+    if (conns > CONN_MAX_SLOTS)
+        conns = CONN_MAX_SLOTS;
+    run_aos(conns, sweeps);
+    run_soa(conns, sweeps);
+    run_valid(conns, sweeps);
+    return 0;
+}
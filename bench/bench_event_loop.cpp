@@ -0,0 +1,206 @@
+/*************************************************************
+*Event_loop_group回环冒烟测试
+*分别以转交模式（0号循环accept，经eventfd轮询转交）和SO_REUSEPORT模式（每个循环各自监听）启动N个事件循环，
+*回调只做回显；客户端建立C个连接，每个连接做R次请求/回显，检查每次回显的内容，
+*统计每个循环分到的连接数、建连速率和回显速率；有连接丢失或回显出错时返回非0
+*编译（连接池替身只为满足List_Timer.cpp的头文件，不需要MySQL）：
+*g++ -O2 -std=c++14 -pthread -include bench/stub/sql_connection_pool.h \
+*    bench/bench_event_loop.cpp reactor/Event_Loop.cpp timer/List_Timer.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp \
+*    -o bench_event_loop
+*运行：./bench_event_loop [-n 事件循环数] [-c 连接数] [-r 每个连接的请求数] [-t 客户端线程数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+#include "bench_util.h"
+#include "../reactor/Event_Loop.h"
+#include "../http/http_conn.h"
+
+//cb_func维护该计数，本程序不链接http_conn.cpp
+int http_conn::m_user_count = 0;
+
+static const int TIMESLOT = 5;
+static const int MAX_LOOPS = 64;
+static const char REQUEST[] = "ping 0123456789\n";
+static const int REQUEST_LEN = sizeof(REQUEST) - 1;
+
+//每个循环分到的连接数，由各循环的线程累加，Stop()之后由主线程读取
+static long long g_loop_conns[MAX_LOOPS];
+
+static void on_conn(Event_loop *loop, int, const sockaddr_in &){
+    __atomic_fetch_add(&g_loop_conns[loop->Index()], 1, __ATOMIC_RELAXED);
+}
+
+//LT模式，读到多少回显多少；请求很小，非阻塞write一次写完
+static void on_io(Event_loop *loop, int sockfd, uint32_t events){
+    char buf[4096];
+    ssize_t len = read(sockfd, buf, sizeof(buf));
+    if (len > 0 && write(sockfd, buf, len) == len)
+        return;
+    if (len < 0 && errno == EAGAIN && !(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+        return;
+    loop->m_utils.Removefd(loop->m_epollfd, sockfd);
+}
+
+struct Client_arg
+{
+    int port;
+    int connections;
+    int requests;
+    std::vector<int> fds;
+    long long connect_ns;
+    long long errors;
+};
+
+static int connect_to(int port){
+    int fd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0){
+        close(fd);
+        return -1;
+    }
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    return fd;
+}
+
+//先建立全部连接，再轮流在每个连接上做一次请求/回显，直到每个连接都做完requests次
+static void *client_main(void *arg){
+    Client_arg *c = (Client_arg *)arg;
+    long long start = bench_now_ns();
+    for (int i = 0; i < c->connections; ++i){
+        int fd = connect_to(c->port);
+        if (fd < 0){
+            ++c->errors;
+            continue;
+        }
+        c->fds.push_back(fd);
+    }
+    c->connect_ns = bench_now_ns() - start;
+
+    char buf[REQUEST_LEN];
+    for (int r = 0; r < c->requests; ++r){
+        for (size_t i = 0; i < c->fds.size(); ++i){
+            if (c->fds[i] < 0)
+                continue;
+            bool ok = write(c->fds[i], REQUEST, REQUEST_LEN) == REQUEST_LEN;
+            int got = 0;
+            while (ok && got < REQUEST_LEN){
+                ssize_t len = read(c->fds[i], buf + got, REQUEST_LEN - got);
+                ok = len > 0;
+                got += ok ? (int)len : 0;
+            }
+            if (!ok || memcmp(buf, REQUEST, REQUEST_LEN) != 0){
+                ++c->errors;
+                close(c->fds[i]);
+                c->fds[i] = -1;
+            }
+        }
+    }
+    for (size_t i = 0; i < c->fds.size(); ++i){
+        if (c->fds[i] >= 0)
+            close(c->fds[i]);
+    }
+    return NULL;
+}
+
+static bool run_case(bool reuse_port, int loops, int connections, int requests, int client_threads){
+    memset(g_loop_conns, 0, sizeof(g_loop_conns));
+    Event_loop_group group;
+    if (!group.Init(loops, 0, TIMESLOT, 0, reuse_port, on_conn, on_io) || !group.Start()){
+        perror("event loop group");
+        return false;
+    }
+
+    std::vector<Client_arg> clients(client_threads);
+    std::vector<pthread_t> tids(client_threads);
+    long long start = bench_now_ns();
+    for (int i = 0; i < client_threads; ++i){
+        clients[i].port = group.Port();
+        clients[i].connections = connections / client_threads + (i < connections % client_threads ? 1 : 0);
+        clients[i].requests = requests;
+        clients[i].connect_ns = 0;
+        clients[i].errors = 0;
+        pthread_create(&tids[i], NULL, client_main, &clients[i]);
+    }
+    long long errors = 0, connect_ns = 0;
+    for (int i = 0; i < client_threads; ++i){
+        pthread_join(tids[i], NULL);
+        errors += clients[i].errors;
+        if (clients[i].connect_ns > connect_ns)
+            connect_ns = clients[i].connect_ns;
+    }
+    long long elapsed = bench_now_ns() - start;
+    group.Stop();
+
+    long long accepted = 0, min_conns = -1, max_conns = 0;
+    int loops_used = 0;
+    for (int i = 0; i < group.Size(); ++i){
+        long long n = g_loop_conns[i];
+        accepted += n;
+        loops_used += n > 0;
+        if (min_conns < 0 || n < min_conns)
+            min_conns = n;
+        if (n > max_conns)
+            max_conns = n;
+    }
+
+    Bench_report("event_loop", reuse_port ? "reuse_port" : "handoff")
+        .param("loops", group.Size())
+        .param("connections", connections)
+        .param("requests_per_conn", requests)
+        .param("accepted", accepted)
+        .param("loops_used", loops_used)
+        .param("min_loop_conns", min_conns)
+        .param("max_loop_conns", max_conns)
+        .param("errors", errors)
+        .metric("conns_per_sec", connections * 1e9 / connect_ns)
+        .metric("echo_per_sec", (double)connections * requests * 1e9 / elapsed)
+        .print();
+    return errors == 0 && accepted == connections;
+}
+
+int main(int argc, char *argv[]){
+    int loops = 4, connections = 1000, requests = 100, client_threads = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:r:t:")) != -1){
+        switch (opt){
+        case 'n': loops = atoi(optarg); break;
+        case 'c': connections = atoi(optarg); break;
+        case 'r': requests = atoi(optarg); break;
+        case 't': client_threads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n loops] [-c conns] [-r requests_per_conn] [-t client_threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (loops <= 0)
+        loops = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (loops > MAX_LOOPS)
+        loops = MAX_LOOPS;
+    if (client_threads < 1)
+        client_threads = 1;
+
+    //两端的fd都在本进程内
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    bool ok = run_case(false, loops, connections, requests, client_threads);
+    ok = run_case(true, loops, connections, requests, client_threads) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/*************************************************************
+*Log基准测试
+*同步/异步两种模式，T个线程并发调用LOG_INFO，统计每秒写入的记录数和单次调用延迟（关闭限速）；
+*fmt用例用LOGF_INFO写同样的记录，格式串在编译期解析、参数类型化格式化，与vsnprintf路径对比每秒记录数；
+*format用例只比较格式化本身（vsnprintf与log_format_to），不写文件；
+*storm用例模拟故障时同一个调用点反复输出相同的错误，使用默认限速，统计每秒调用数、单次调用延迟和实际写入的行数
+*Log是单例且日志类型在init之前确定，每种模式在单独的子进程中运行
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_log.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp -o bench_log
+*运行: ./bench_log [日志目录] [每个线程的记录数]
+**************************************************************/
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "bench_util.h"
+#include "../log/log.h"
+
+struct Log_case
+{
+    int records;
+    std::vector<long long> latency;
+};
+
+static void *storm_writer(void *arg)
+{
+    Log_case *c = (Log_case *)arg;
+    for (int i = 0; i < c->records; ++i)
+    {
+        long long start = bench_now_ns();
+        LOG_ERROR("%s", "MySQL Error: Too many connections");
+        c->latency.push_back(bench_now_ns() - start);
+    }
+    return NULL;
+}
+
+//文件中的行数，即实际写入的记录数
+static long long count_lines(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    long long lines = 0;
+    int ch;
+    while ((ch = fgetc(fp)) != EOF)
+        lines += ch == '\n';
+    fclose(fp);
+    return lines;
+}
+
+static void *writer(void *arg)
+{
+    Log_case *c = (Log_case *)arg;
+    for (int i = 0; i < c->records; ++i)
+    {
+        long long start = bench_now_ns();
+        LOG_INFO("bench record %d from %p, payload %s", i, (void *)c, "GET /index.html HTTP/1.1");
+        c->latency.push_back(bench_now_ns() - start);
+    }
+    return NULL;
+}
+
+//与writer相同的记录，输出的内容也相同
+static void *fmt_writer(void *arg)
+{
+    Log_case *c = (Log_case *)arg;
+    for (int i = 0; i < c->records; ++i)
+    {
+        long long start = bench_now_ns();
+        LOGF_INFO("bench record {} from {}, payload {}", i, (void *)c, "GET /index.html HTTP/1.1");
+        c->latency.push_back(bench_now_ns() - start);
+    }
+    return NULL;
+}
+
+static int vsnprintf_record(char *buf, int size, const char *format, ...)
+{
+    va_list valst;
+    va_start(valst, format);
+    int m = vsnprintf(buf, size, format, valst);
+    va_end(valst);
+    return m;
+}
+
+//只比较正文的格式化，两种方式各格式化records条，与Log内部的调用方式相同
+static void run_format(int records)
+{
+    static constexpr Log_format format = log_parse("bench record {} from {}, payload {}, took {:.3} ms");
+    char buf[8192];
+    const char *names[] = {"format_vsnprintf", "format_typed"};
+    for (int k = 0; k < 2; ++k)
+    {
+        long long bytes = 0;
+        long long start = bench_now_ns();
+        for (int i = 0; i < records; ++i)
+        {
+            double ms = i * 0.001;
+            if (k == 0)
+            {
+                bytes += vsnprintf_record(buf, sizeof(buf), "bench record %d from %p, payload %s, took %.3f ms",
+                                          i, (void *)buf, "GET /index.html HTTP/1.1", ms);
+            }
+            else
+            {
+                const Log_arg args[] = {Log_arg(i), Log_arg((void *)buf), Log_arg("GET /index.html HTTP/1.1"), Log_arg(ms)};
+                bytes += log_format_to(buf, sizeof(buf), format, args, 4);
+            }
+        }
+        long long elapsed = bench_now_ns() - start;
+        Bench_report report("log", names[k]);
+        report.param("records", records)
+            .param("bytes", bytes)
+            .metric("records_per_sec", records * 1e9 / elapsed)
+            .metric("ns_per_record", (double)elapsed / records)
+            .print();
+    }
+}
+
+static void run_case(const char *dir, LogType type, int threads, int records, bool storm, bool fmt)
+{
+    const char *mode = type == ASYNC_LOG ? "async" : "sync";
+    const char *suffix = storm ? "_storm" : (fmt ? "_fmt" : "");
+    char file[256];
+    snprintf(file, sizeof(file), "%s/bench_%s_%d%s.log", dir, mode, threads, suffix);
+    //Log在文件名前加日期，storm用例结束后要统计这个文件的行数，先删掉上次运行留下的
+    char dated[512];
+    time_t now = time(NULL);
+    struct tm my_tm = *localtime(&now);
+    snprintf(dated, sizeof(dated), "%s/%d_%02d_%02d_bench_%s_%d%s.log", dir, my_tm.tm_year + 1900,
+             my_tm.tm_mon + 1, my_tm.tm_mday, mode, threads, suffix);
+    unlink(dated);
+
+    Log::set_log_type(type);
+    if (!storm)
+        Log::set_rate_limit(0, 0);
+    //异步模式队列容量与服务器默认配置一致
+    if (!Log::get_instance()->init(file, 0, 8192, 5000000, type == ASYNC_LOG ? 800 : 0))
+    {
+        fprintf(stderr, "open %s failed\n", file);
+        exit(1);
+    }
+
+    std::vector<Log_case> cases(threads);
+    std::vector<pthread_t> tids(threads);
+    long long start = bench_now_ns();
+    for (int i = 0; i < threads; ++i)
+    {
+        cases[i].records = records;
+        cases[i].latency.reserve(records);
+        pthread_create(&tids[i], NULL, storm ? storm_writer : (fmt ? fmt_writer : writer), &cases[i]);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(tids[i], NULL);
+    long long elapsed = bench_now_ns() - start;
+
+    std::vector<long long> samples;
+    for (int i = 0; i < threads; ++i)
+        samples.insert(samples.end(), cases[i].latency.begin(), cases[i].latency.end());
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s_threads_%d%s", mode, threads, suffix);
+    Bench_report report("log", name);
+    report.param("mode", mode)
+        .param("threads", threads)
+        .param("records", (long long)samples.size())
+        .metric("records_per_sec", samples.size() * 1e9 / elapsed);
+    if (storm)
+    {
+        Log::get_instance()->shutdown();
+        report.param("lines_written", count_lines(dated));
+    }
+    report.latency(samples).print();
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 ? argv[1] : "./bench_log_out";
+    int records = argc > 2 ? atoi(argv[2]) : 100000;
+    int threads[] = {1, 4};
+    LogType types[] = {SYNC_LOG, ASYNC_LOG};
+    mkdir(dir, 0755);
+
+    run_format(records);
+    for (int f = 0; f < 2; ++f)
+    {
+        for (int t = 0; t < 2; ++t)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                pid_t pid = fork();
+                if (pid == 0)
+                {
+                    run_case(dir, types[t], threads[i], records, false, f == 1);
+                    //异步线程阻塞在队列上，直接退出
+                    _exit(0);
+                }
+                waitpid(pid, NULL, 0);
+            }
+        }
+    }
+    for (int t = 0; t < 2; ++t)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            run_case(dir, types[t], 4, records, true, false);
+            _exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*************************************************************
+*输出路径基准测试
+*同一个响应（约200字节的响应头 + N字节正文）用三种方式发到socketpair：
+*copy:     响应头和正文memcpy进一块连续缓冲区后send，相当于原来的写缓冲区
+*writev:   响应头复制进Output_buffer的池化块，正文以引用方式加入，一次sendmsg发出
+*sendfile: 响应头同上，正文为文件区间，sendfile发送
+*统计每秒响应数、每秒字节数和单个响应从开始组装到发完的延迟
+*读端由发送线程自己在发送缓冲区满和每个响应之后取空，不另开线程：单核机器上读线程的调度会淹没被测的差异
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_output.cpp buffer/Chunk_pool.cpp buffer/Output_buffer.cpp \
+*      log/log.cpp metrics/Metrics.cpp trace/Trace.cpp -o bench_output
+*运行: ./bench_output [每种情况的响应数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <vector>
+#include "bench_util.h"
+#include "../buffer/Output_buffer.h"
+
+static int g_peer = -1;
+
+//取空读端，相当于客户端收走了数据
+static void drain_peer()
+{
+    char buf[65536];
+    while (read(g_peer, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static int header_of(char *header, long body_len)
+{
+    return snprintf(header, 256, "HTTP/1.1 200 OK\r\nContent-Length:%ld\r\nConnection:keep-alive\r\n"
+                                 "Content-Type:text/html\r\nServer:TinyWebServer\r\n\r\n", body_len);
+}
+
+static void send_copy(int fd, const char *body, long body_len, char *scratch)
+{
+    int header_len = header_of(scratch, body_len);
+    memcpy(scratch + header_len, body, body_len);
+    long total = header_len + body_len, sent = 0;
+    while (sent < total)
+    {
+        ssize_t n = send(fd, scratch + sent, total - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN)
+                drain_peer();
+            continue;
+        }
+        sent += n;
+    }
+}
+
+static void send_output(int fd, Output_buffer &out, const char *body, int file_fd, long body_len)
+{
+    char header[256];
+    int header_len = header_of(header, body_len);
+    out.Append(header, header_len);
+    if (file_fd >= 0)
+        out.AppendFile(file_fd, 0, body_len, false);
+    else
+        out.AppendRef(body, body_len);
+    while (out.Flush(fd) == OUTPUT_AGAIN)
+        drain_peer();
+}
+
+static void run_case(const char *name, long body_len, int responses)
+{
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    g_peer = fds[1];
+
+    char *body = (char *)malloc(body_len);
+    memset(body, 'x', body_len);
+    char *scratch = (char *)malloc(body_len + 256);
+
+    int file_fd = -1;
+    if (strcmp(name, "sendfile") == 0)
+    {
+        char path[] = "/tmp/bench_output_XXXXXX";
+        file_fd = mkstemp(path);
+        unlink(path);
+        if (write(file_fd, body, body_len) != body_len)
+            perror("write");
+    }
+
+    Output_buffer out;
+    std::vector<long long> samples(responses);
+    long long start = bench_now_ns();
+    for (int i = 0; i < responses; ++i)
+    {
+        long long begin = bench_now_ns();
+        if (strcmp(name, "copy") == 0)
+            send_copy(fds[0], body, body_len, scratch);
+        else
+            send_output(fds[0], out, body, file_fd, body_len);
+        drain_peer();
+        samples[i] = bench_now_ns() - begin;
+    }
+    long long elapsed = bench_now_ns() - start;
+
+    char case_name[64];
+    snprintf(case_name, sizeof(case_name), "%s_%ld", name, body_len);
+    Bench_report("output", case_name)
+        .param("body_bytes", (long long)body_len)
+        .param("responses", responses)
+        .metric("responses_per_sec", responses * 1e9 / elapsed)
+        .metric("mb_per_sec", (double)responses * body_len * 1e3 / elapsed)
+        .latency(samples)
+        .print();
+
+    close(fds[0]);
+    close(fds[1]);
+    if (file_fd >= 0)
+        close(file_fd);
+    free(body);
+    free(scratch);
+}
+
+int main(int argc, char *argv[])
+{
+    int responses = argc > 1 ? atoi(argv[1]) : 20000;
+    long sizes[] = {1024, 64 * 1024, 1024 * 1024};
+    const char *modes[] = {"copy", "writev", "sendfile"};
+
+    for (int i = 0; i < 3; ++i)
+    {
+        //大响应减少次数，保证每种情况的总字节数相近
+        int count = sizes[i] > 64 * 1024 ? responses / 16 : responses;
+        for (int j = 0; j < 3; ++j)
+            run_case(modes[j], sizes[i], count);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*************************************************************
+*threadpool基准测试
+*actor_model为0（模型2），任务的process()为空操作，
+*测量append_p到工作线程开始处理的派发延迟和每秒完成的任务数
+*编译：g++ -O2 -std=c++14 -pthread bench/bench_threadpool.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp arena/Arena.cpp -o bench_threadpool
+*运行: ./bench_threadpool [每个用例的任务数] [最大请求数]
+**************************************************************/
+#include <sched.h>
+#include <vector>
+#include "bench_util.h"
+//替身连接池必须先于threadpool.h包含
+#include "stub/sql_connection_pool.h"
+#include "../threadpool.h"
+
+static volatile int g_done = 0;
+
+//满足threadpool对任务类型的要求：mysql、m_state、improv、timer_flag、process()
+struct Noop_task
+{
+    MYSQL *mysql;
+    int m_state;
+    int improv;
+    int timer_flag;
+    long long enqueue_ns;
+    long long latency_ns;
+
+    bool read_once() { return true; }
+    bool write() { return true; }
+    void process()
+    {
+        latency_ns = bench_now_ns() - enqueue_ns;
+        __atomic_fetch_add(&g_done, 1, __ATOMIC_RELEASE);
+    }
+};
+
+static void run_case(int thread_number, int total, int max_request)
+{
+    connection_pool *pool = connection_pool::GetInstance();
+    pool->init("localhost", "", "", "", 0, thread_number, 1);
+
+    //测的是队列本身的派发能力，关闭准入控制，队列满时由下面的循环重试
+    threadpool<Noop_task> *workers = new threadpool<Noop_task>(0, pool, thread_number, max_request);
+    workers->set_admission(0, 0);
+    std::vector<Noop_task> tasks(total);
+    g_done = 0;
+
+    long long start = bench_now_ns();
+    for (int i = 0; i < total; ++i)
+    {
+        tasks[i].enqueue_ns = bench_now_ns();
+        while (!workers->append_p(&tasks[i]))
+            sched_yield();
+    }
+    while (__atomic_load_n(&g_done, __ATOMIC_ACQUIRE) < total)
+        sched_yield();
+    long long elapsed = bench_now_ns() - start;
+    workers->shutdown(0);
+    delete workers;
+
+    std::vector<long long> samples(total);
+    for (int i = 0; i < total; ++i)
+        samples[i] = tasks[i].latency_ns;
+
+    char name[32];
+    snprintf(name, sizeof(name), "threads_%d", thread_number);
+    Bench_report("threadpool", name)
+        .param("threads", thread_number)
+        .param("tasks", total)
+        .param("max_request", max_request)
+        .metric("tasks_per_sec", total * 1e9 / elapsed)
+        .latency(samples)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int total = argc > 1 ? atoi(argv[1]) : 200000;
+    int max_request = argc > 2 ? atoi(argv[2]) : 10000;
+    int threads[] = {1, 2, 4, 8};
+
+    for (int i = 0; i < 4; ++i)
+        run_case(threads[i], total, max_request);
+    return 0;
+}
@@ -0,0 +1,504 @@
+/*************************************************************
+*定时器容器基准测试
+*对比Sorted_timer_list、Fifo_timer_list与测试内实现的最小堆、时间轮，
+*定时器数1k~1M，分别测量add/adjust/del的单次耗时和tick清空全部到期定时器的耗时
+*过期时间分布：
+*  keepalive: now+15s+[0,3)s抖动，接近服务器的真实情况
+*  uniform: now+[0,3600)s均匀分布
+*升序链表插入为O(n)，keepalive分布只测到MAX_LIST_TIMERS，uniform分布只测到MAX_LIST_UNIFORM；
+*Fifo_timer_list注册keepalive分布用到的时长，uniform分布绝大部分落到后备链表，同样只测到MAX_LIST_UNIFORM
+*wakeup用例按真实时间运行：定时器稀疏地分布在接下来的若干秒内，对比每秒固定tick与按next_expiry()休眠的唤醒次数、
+*自愿上下文切换次数和定时器的平均推迟时间，idle用例没有任何定时器
+*编译（List_Timer.cpp依赖http_conn，同makefile中server的依赖）：
+*g++ -O2 -std=c++14 -pthread bench/bench_timer.cpp timer/List_Timer.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp \
+*    http/http_conn.cpp CGImysql/sql_connection_pool.cpp -lmysqlclient -o bench_timer
+*运行: ./bench_timer [最大定时器数] [wakeup用例的秒数]
+**************************************************************/
+#include <sys/resource.h>
+#include <vector>
+#include "bench_util.h"
+#include "../timer/List_Timer.h"
+
+//升序链表建表是平方复杂度，超过该规模跳过
+static const int MAX_LIST_TIMERS = 100000;
+static const int MAX_LIST_UNIFORM = 20000;
+
+static long long g_fired = 0;
+
+static void count_cb(client_data *)
+{
+    ++g_fired;
+}
+
+static unsigned int g_seed = 12345;
+
+static unsigned int next_rand()
+{
+    g_seed = g_seed * 1103515245u + 12345u;
+    return g_seed >> 8;
+}
+
+static time_t make_deadline(bool uniform, time_t now)
+{
+    if (uniform)
+        return now + next_rand() % 3600;
+    return now + 15 + next_rand() % 3;
+}
+
+/**********Sorted_timer_list适配********** */
+class List_container
+{
+public:
+    typedef Util_timer Node;
+
+    List_container() { m_list.set_tick_budget(0); }
+
+    Node *make(int, time_t expire)
+    {
+        Util_timer *timer = new Util_timer;
+        //count_cb不使用client_data，所有定时器共用一个
+        timer->user_data = &m_user;
+        timer->cb_func = count_cb;
+        timer->Time_out = expire;
+        return timer;
+    }
+
+    time_t expire_of(Node *timer) { return timer->Time_out; }
+
+    void add(Node *timer) { m_list.add_timer(timer); }
+
+    void adjust(Node *timer, time_t expire)
+    {
+        timer->Time_out = expire;
+        m_list.adjust_timer(timer);
+    }
+
+    void del(Node *timer) { m_list.del_timer(timer); }
+
+    //tick()内部使用time(NULL)
+    void tick(time_t) { m_list.tick(); }
+
+private:
+    Sorted_timer_list m_list;
+    client_data m_user;
+};
+
+/**********Fifo_timer_list适配********** */
+class Fifo_container
+{
+public:
+    typedef Util_timer Node;
+
+    Fifo_container()
+    {
+        m_list.set_tick_budget(0);
+        //keepalive分布加入时的时长、调整后的时长，以及tick测试中已经过期的-1
+        for (int i = 0; i < 3; ++i)
+        {
+            m_list.add_class(15 + i);
+            m_list.add_class(30 + i);
+        }
+        m_list.add_class(-1);
+    }
+
+    Node *make(int, time_t expire)
+    {
+        Util_timer *timer = new Util_timer;
+        timer->user_data = &m_user;
+        timer->cb_func = count_cb;
+        timer->Time_out = expire;
+        return timer;
+    }
+
+    time_t expire_of(Node *timer) { return timer->Time_out; }
+
+    void add(Node *timer) { m_list.add_timer(timer); }
+
+    void adjust(Node *timer, time_t expire)
+    {
+        timer->Time_out = expire;
+        m_list.adjust_timer(timer);
+    }
+
+    void del(Node *timer) { m_list.del_timer(timer); }
+
+    void tick(time_t) { m_list.tick(); }
+
+private:
+    Fifo_timer_list m_list;
+    client_data m_user;
+};
+
+/**********最小堆********** */
+struct Heap_node
+{
+    time_t expire;
+    int index;
+};
+
+class Heap_container
+{
+public:
+    typedef Heap_node Node;
+
+    ~Heap_container()
+    {
+        for (size_t i = 0; i < m_heap.size(); ++i)
+            delete m_heap[i];
+    }
+
+    Node *make(int, time_t expire)
+    {
+        Heap_node *node = new Heap_node;
+        node->expire = expire;
+        node->index = -1;
+        return node;
+    }
+
+    time_t expire_of(Node *node) { return node->expire; }
+
+    void add(Node *node)
+    {
+        node->index = (int)m_heap.size();
+        m_heap.push_back(node);
+        up(node->index);
+    }
+
+    void adjust(Node *node, time_t expire)
+    {
+        node->expire = expire;
+        up(node->index);
+        down(node->index);
+    }
+
+    void del(Node *node)
+    {
+        remove(node->index);
+        delete node;
+    }
+
+    void tick(time_t now)
+    {
+        while (!m_heap.empty() && m_heap[0]->expire <= now)
+        {
+            Heap_node *node = m_heap[0];
+            remove(0);
+            ++g_fired;
+            delete node;
+        }
+    }
+
+private:
+    void swap_node(int a, int b)
+    {
+        Heap_node *temp = m_heap[a];
+        m_heap[a] = m_heap[b];
+        m_heap[b] = temp;
+        m_heap[a]->index = a;
+        m_heap[b]->index = b;
+    }
+
+    void up(int i)
+    {
+        while (i > 0 && m_heap[(i - 1) / 2]->expire > m_heap[i]->expire)
+        {
+            swap_node(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void down(int i)
+    {
+        int n = (int)m_heap.size();
+        while (true)
+        {
+            int smallest = i;
+            int l = 2 * i + 1, r = 2 * i + 2;
+            if (l < n && m_heap[l]->expire < m_heap[smallest]->expire)
+                smallest = l;
+            if (r < n && m_heap[r]->expire < m_heap[smallest]->expire)
+                smallest = r;
+            if (smallest == i)
+                return;
+            swap_node(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void remove(int i)
+    {
+        int last = (int)m_heap.size() - 1;
+        if (i != last)
+            swap_node(i, last);
+        m_heap.pop_back();
+        if (i < last)
+        {
+            up(i);
+            down(i);
+        }
+    }
+
+    std::vector<Heap_node *> m_heap;
+};
+
+/**********时间轮，精度1秒********** */
+struct Wheel_node
+{
+    time_t expire;
+    int slot;
+    Wheel_node *prev;
+    Wheel_node *next;
+};
+
+class Wheel_container
+{
+public:
+    typedef Wheel_node Node;
+
+    static const int SLOTS = 512;
+
+    Wheel_container() : m_last(time(NULL))
+    {
+        for (int i = 0; i < SLOTS; ++i)
+            m_slots[i] = NULL;
+    }
+
+    ~Wheel_container()
+    {
+        for (int i = 0; i < SLOTS; ++i)
+        {
+            while (m_slots[i])
+            {
+                Wheel_node *next = m_slots[i]->next;
+                delete m_slots[i];
+                m_slots[i] = next;
+            }
+        }
+    }
+
+    Node *make(int, time_t expire)
+    {
+        Wheel_node *node = new Wheel_node;
+        node->expire = expire;
+        return node;
+    }
+
+    time_t expire_of(Node *node) { return node->expire; }
+
+    void add(Node *node)
+    {
+        //已经过期的放进当前槽，下一次tick处理
+        time_t when = node->expire > m_last ? node->expire : m_last;
+        node->slot = (int)(when % SLOTS);
+        node->prev = NULL;
+        node->next = m_slots[node->slot];
+        if (node->next)
+            node->next->prev = node;
+        m_slots[node->slot] = node;
+    }
+
+    void adjust(Node *node, time_t expire)
+    {
+        unlink(node);
+        node->expire = expire;
+        add(node);
+    }
+
+    void del(Node *node)
+    {
+        unlink(node);
+        delete node;
+    }
+
+    //逐秒推进，每个槽里未到期（多圈之后）的节点留在原处
+    void tick(time_t now)
+    {
+        for (time_t t = m_last; t <= now; ++t)
+        {
+            Wheel_node *node = m_slots[t % SLOTS];
+            while (node)
+            {
+                Wheel_node *next = node->next;
+                if (node->expire <= now)
+                {
+                    unlink(node);
+                    ++g_fired;
+                    delete node;
+                }
+                node = next;
+            }
+            if (now - t >= SLOTS)
+                t = now - SLOTS;
+        }
+        m_last = now;
+    }
+
+private:
+    void unlink(Node *node)
+    {
+        if (node->prev)
+            node->prev->next = node->next;
+        else
+            m_slots[node->slot] = node->next;
+        if (node->next)
+            node->next->prev = node->prev;
+    }
+
+    Wheel_node *m_slots[SLOTS];
+    time_t m_last;
+};
+
+/**********测试流程********** */
+template <typename Container>
+static void run_case(const char *container, int number, bool uniform)
+{
+    const char *dist = uniform ? "uniform" : "keepalive";
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%s_%d", container, dist, number);
+
+    time_t now = time(NULL);
+    Container *c = new Container;
+    std::vector<typename Container::Node *> nodes(number);
+    for (int i = 0; i < number; ++i)
+        nodes[i] = c->make(i, make_deadline(uniform, now));
+
+    long long start = bench_now_ns();
+    for (int i = 0; i < number; ++i)
+        c->add(nodes[i]);
+    double add_ns = (double)(bench_now_ns() - start) / number;
+
+    //连接有活动：过期时间延后一个超时周期
+    start = bench_now_ns();
+    for (int i = 0; i < number; ++i)
+        c->adjust(nodes[i], c->expire_of(nodes[i]) + 15);
+    double adjust_ns = (double)(bench_now_ns() - start) / number;
+
+    //删除十分之一（主动关闭的连接）
+    int del_number = number / 10;
+    start = bench_now_ns();
+    for (int i = 0; i < del_number; ++i)
+        c->del(nodes[(long long)i * 10 % number]);
+    double del_ns = del_number ? (double)(bench_now_ns() - start) / del_number : 0.0;
+    delete c;
+
+    //tick：全部定时器已经到期，测量一次清空的耗时
+    c = new Container;
+    for (int i = 0; i < number; ++i)
+        c->add(c->make(i, now - 1));
+    g_fired = 0;
+    start = bench_now_ns();
+    c->tick(time(NULL));
+    long long tick_elapsed = bench_now_ns() - start;
+    long long fired = g_fired;
+    delete c;
+
+    Bench_report("timer", name)
+        .param("container", container)
+        .param("distribution", dist)
+        .param("timers", number)
+        .metric("add_ns", add_ns)
+        .metric("adjust_ns", adjust_ns)
+        .metric("del_ns", del_ns)
+        .metric("tick_ns_per_timer", fired ? (double)tick_elapsed / fired : 0.0)
+        .param("fired", fired)
+        .print();
+}
+
+/**********唤醒次数********** */
+static long long g_late_sum = 0;
+
+static void late_cb(client_data *user)
+{
+    //sockfd借用来保存过期时间
+    ++g_fired;
+    g_late_sum += time(NULL) - user->sockfd;
+}
+
+static long voluntary_switches()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+}
+
+//slack<0表示原来的驱动方式：每秒tick一次，不看next_expiry()
+static void run_wakeup_case(const char *name, int timers, int slack, int seconds)
+{
+    Sorted_timer_list list;
+    list.set_default_slack(slack > 0 ? slack : 0);
+    time_t start = time(NULL);
+    std::vector<client_data> users(timers);
+    for (int i = 0; i < timers; ++i)
+    {
+        Util_timer *timer = new Util_timer;
+        timer->Time_out = start + 1 + next_rand() % (seconds - 1);
+        users[i].sockfd = (int)timer->Time_out;
+        timer->user_data = &users[i];
+        timer->cb_func = late_cb;
+        list.add_timer(timer);
+    }
+
+    g_fired = 0;
+    g_late_sum = 0;
+    long long wakeups = 0;
+    long switches = voluntary_switches();
+    time_t end = start + seconds;
+    while (true)
+    {
+        time_t now = time(NULL);
+        time_t wake = slack < 0 ? now + 1 : list.next_expiry();
+        if (wake == 0 || wake > end)
+            wake = end;
+        if (wake > now)
+        {
+            struct timespec t;
+            t.tv_sec = wake;
+            t.tv_nsec = TIMER_WAKE_MARGIN_NS;
+            clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &t, NULL);
+        }
+        if (time(NULL) >= end)
+            break;
+        ++wakeups;
+        list.tick();
+    }
+    switches = voluntary_switches() - switches;
+
+    Bench_report("timer", name)
+        .param("timers", timers)
+        .param("slack", slack)
+        .param("seconds", seconds)
+        .param("fired", g_fired)
+        .metric("wakeups", (double)wakeups)
+        .metric("voluntary_ctx_switches", (double)switches)
+        .metric("avg_late_s", g_fired ? (double)g_late_sum / g_fired : 0.0)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int max_number = argc > 1 ? atoi(argv[1]) : 1000000;
+    int seconds = argc > 2 ? atoi(argv[2]) : 20;
+
+    for (int number = 1000; number <= max_number; number *= 10)
+    {
+        for (int uniform = 0; uniform < 2; ++uniform)
+        {
+            if (number <= (uniform ? MAX_LIST_UNIFORM : MAX_LIST_TIMERS))
+                run_case<List_container>("sorted_list", number, uniform);
+            if (!uniform || number <= MAX_LIST_UNIFORM)
+                run_case<Fifo_container>("fifo_list", number, uniform);
+            run_case<Heap_container>("heap", number, uniform);
+            run_case<Wheel_container>("wheel", number, uniform);
+        }
+    }
+
+    if (seconds >= 2)
+    {
+        run_wakeup_case("idle_periodic", 0, -1, seconds);
+        run_wakeup_case("idle_coalesced", 0, 0, seconds);
+        run_wakeup_case("sparse_periodic", 8, -1, seconds);
+        run_wakeup_case("sparse_slack_0", 8, 0, seconds);
+        run_wakeup_case("sparse_slack_3", 8, 3, seconds);
+    }
+    return 0;
+}
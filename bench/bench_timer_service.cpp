@@ -0,0 +1,185 @@
+/*************************************************************
+*Timer_service多线程压力测试
+*W个工作线程各自管理一组槽位，随机地添加、调整、立即过期、删除定时器，并用已经失效的旧句柄再操作一次；
+*同时一个线程不停地TickAll()，让一半的定时器在工作线程操作它们的同时到期释放。
+*检查：旧句柄的操作必须全部返回false；添加数 = 删除成功数 + 到期回调数 + 结束时剩余数。
+*配合-fsanitize=address / thread编译可以发现到期释放与工作线程操作之间的释放后使用和数据竞争
+*编译（连接池替身只为满足List_Timer.cpp的头文件，不需要MySQL）：
+*g++ -O2 -std=c++14 -pthread -include bench/stub/sql_connection_pool.h \
+*    bench/bench_timer_service.cpp timer/Timer_Service.cpp timer/List_Timer.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp \
+*    -o bench_timer_service
+*运行：./bench_timer_service [-s 分片数] [-w 工作线程数] [-n 每个线程的操作数] [-k 每个线程的槽位数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+#include "bench_util.h"
+#include "../timer/Timer_Service.h"
+#include "../http/http_conn.h"
+
+//cb_func维护该计数，本程序不链接http_conn.cpp
+int http_conn::m_user_count = 0;
+
+static long long g_expired = 0;
+static bool g_stop = false;
+
+//在Tick()的线程里、分片锁内调用
+static void on_expire(client_data *){
+    __atomic_fetch_add(&g_expired, 1, __ATOMIC_RELAXED);
+}
+
+struct Worker_arg
+{
+    Timer_service *service;
+    int first_slot;
+    int slots;
+    int ops;
+    unsigned int seed;
+    std::vector<client_data> users;
+    long long adds;
+    long long dels;
+    long long missed;
+    long long stale_hits;
+};
+
+static void *tick_main(void *arg){
+    Timer_service *service = (Timer_service *)arg;
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)){
+        service->TickAll();
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg){
+    Worker_arg *w = (Worker_arg *)arg;
+    std::vector<Conn_handle> current(w->slots, 0);
+    std::vector<Conn_handle> stale(w->slots, 0);
+    std::vector<uint16_t> generation(w->slots, 0);
+    w->users.resize(w->slots);
+    for (int i = 0; i < w->ops; ++i){
+        int k = rand_r(&w->seed) % w->slots;
+        int slot = w->first_slot + k;
+        time_t now = time(NULL);
+        //一半的定时器已经到期，下一次TickAll()就会释放
+        time_t timeout = (rand_r(&w->seed) & 1) ? now - 1 : now + 100;
+        int op = rand_r(&w->seed) % 8;
+
+        //旧句柄的槽位已经换了代数，任何操作都必须查不到
+        if (stale[k] != 0 && op == 0){
+            bool hit = w->service->AdjustTimer(stale[k], now + 100) || w->service->ExpireTimer(stale[k]) ||
+                       w->service->DelTimer(stale[k]);
+            w->stale_hits += hit;
+            continue;
+        }
+
+        if (current[k] == 0){
+            ++generation[k];
+            if (generation[k] == 0)
+                generation[k] = 1;
+            Conn_handle handle = ((Conn_handle)generation[k] << CONN_INDEX_BITS) | (Conn_handle)slot;
+            w->users[k].sockfd = slot;
+            Util_timer *timer = new Util_timer;
+            timer->Time_out = timeout;
+            timer->cb_func = on_expire;
+            timer->user_data = &w->users[k];
+            w->service->AddTimer(handle, timer);
+            ++w->adds;
+            current[k] = handle;
+            continue;
+        }
+
+        bool alive = true;
+        if (op < 4){
+            alive = w->service->AdjustTimer(current[k], timeout);
+        }else if (op < 6){
+            alive = w->service->ExpireTimer(current[k]);
+        }else if (w->service->DelTimer(current[k])){
+            ++w->dels;
+            stale[k] = current[k];
+            current[k] = 0;
+            continue;
+        }else{
+            alive = false;
+        }
+        //定时器已经被Tick()释放，这次操作是空操作
+        if (!alive){
+            ++w->missed;
+            stale[k] = current[k];
+            current[k] = 0;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    int shards = 4, workers = 4, ops = 200000, slots = 256;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:n:k:")) != -1){
+        switch (opt){
+        case 's': shards = atoi(optarg); break;
+        case 'w': workers = atoi(optarg); break;
+        case 'n': ops = atoi(optarg); break;
+        case 'k': slots = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-s shards] [-w workers] [-n ops_per_worker] [-k slots_per_worker]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (workers < 1)
+        workers = 1;
+    if (slots < 1 || (long long)slots * workers > CONN_MAX_SLOTS)
+        slots = CONN_MAX_SLOTS / workers;
+
+    Timer_service service;
+    service.Init(shards);
+
+    pthread_t tick_tid;
+    pthread_create(&tick_tid, NULL, tick_main, &service);
+
+    std::vector<Worker_arg> args(workers);
+    std::vector<pthread_t> tids(workers);
+    long long start = bench_now_ns();
+    for (int i = 0; i < workers; ++i){
+        args[i].service = &service;
+        args[i].first_slot = i * slots;
+        args[i].slots = slots;
+        args[i].ops = ops;
+        args[i].seed = 12345u + i;
+        args[i].adds = args[i].dels = args[i].missed = args[i].stale_hits = 0;
+        pthread_create(&tids[i], NULL, worker_main, &args[i]);
+    }
+    long long adds = 0, dels = 0, missed = 0, stale_hits = 0;
+    for (int i = 0; i < workers; ++i){
+        pthread_join(tids[i], NULL);
+        adds += args[i].adds;
+        dels += args[i].dels;
+        missed += args[i].missed;
+        stale_hits += args[i].stale_hits;
+    }
+    long long elapsed = bench_now_ns() - start;
+    __atomic_store_n(&g_stop, true, __ATOMIC_RELAXED);
+    pthread_join(tick_tid, NULL);
+
+    long long expired = __atomic_load_n(&g_expired, __ATOMIC_RELAXED);
+    long long remaining = (long long)service.Count();
+    bool ok = stale_hits == 0 && adds == dels + expired + remaining;
+
+    Bench_report("timer_service", "add_adjust_del_vs_tick")
+        .param("shards", service.ShardNumber())
+        .param("workers", workers)
+        .param("ops", (long long)ops * workers)
+        .param("adds", adds)
+        .param("dels", dels)
+        .param("expired", expired)
+        .param("remaining", remaining)
+        .param("missed_after_expiry", missed)
+        .param("stale_hits", stale_hits)
+        .param("consistent", ok ? 1 : 0)
+        .metric("ops_per_sec", (double)ops * workers * 1e9 / elapsed)
+        .print();
+    return ok ? 0 : 1;
+}
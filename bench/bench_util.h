@@ -0,0 +1,197 @@
+/*************************************************************
+*基准测试公共工具
+*计时、延迟分位数统计，以及每个测试用例一行JSON的结果输出，
+*环境变量BENCH_TAG（例如提交号）会写进每一行，便于在提交之间对比回归
+**************************************************************/
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+//单调时钟，纳秒
+inline long long bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//对延迟样本排序后取分位数，q取值0~1
+inline long long bench_percentile(std::vector<long long> &sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(q * (sorted.size() - 1));
+    return sorted[index];
+}
+
+/*
+class: Latency_histogram
+HDR风格的对数-线性直方图
+@ function: 每个2的幂区间再均分为SUB个桶，相对误差约1/SUB，记录为O(1)且不分配内存，
+            适合长时间压测；各线程各自记录，结束后merge()
+@ func: record() 记录一个样本（纳秒）
+@ func: merge() 合并另一个直方图
+@ func: percentile() 返回分位数所在桶的中点，q取值0~1
+*/
+class Latency_histogram
+{
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    Latency_histogram() : m_count(0), m_max(0) { memset(m_buckets, 0, sizeof(m_buckets)); }
+
+    void record(long long value)
+    {
+        if (value < 0)
+            value = 0;
+        ++m_buckets[index_of((unsigned long long)value)];
+        ++m_count;
+        if (value > m_max)
+            m_max = value;
+    }
+
+    void merge(const Latency_histogram &other)
+    {
+        for (int i = 0; i < BUCKETS; ++i)
+            m_buckets[i] += other.m_buckets[i];
+        m_count += other.m_count;
+        if (other.m_max > m_max)
+            m_max = other.m_max;
+    }
+
+    long long percentile(double q) const
+    {
+        if (m_count == 0)
+            return 0;
+        long long rank = (long long)(q * (m_count - 1)) + 1;
+        long long seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= rank)
+                return std::min(middle_of(i), m_max);
+        }
+        return m_max;
+    }
+
+    long long count() const { return m_count; }
+
+    long long max() const { return m_max; }
+
+private:
+    static int index_of(unsigned long long value)
+    {
+        if (value < (unsigned long long)SUB)
+            return (int)value;
+        int exponent = 63 - __builtin_clzll(value);
+        return (exponent - SUB_BITS + 1) * SUB + (int)((value >> (exponent - SUB_BITS)) & (SUB - 1));
+    }
+
+    static long long middle_of(int index)
+    {
+        if (index < SUB)
+            return index;
+        int shift = index / SUB - 1;
+        long long lower = (long long)(SUB + index % SUB) << shift;
+        return lower + ((1LL << shift) >> 1);
+    }
+
+    long long m_buckets[BUCKETS];
+    long long m_count;
+    long long m_max;
+};
+
+/*
+class: Bench_report
+一行JSON结果
+@ func: param() 记录测试参数
+@ func: metric() 记录测试结果
+@ func: latency() 对样本排序并记录p50/p99/p999/max（纳秒）
+@ func: histogram() 从直方图记录p50/p99/p999/max（纳秒）
+@ func: print() 输出到stdout
+*/
+class Bench_report
+{
+public:
+    Bench_report(const char *bench, const char *name)
+    {
+        m_line = "{\"bench\":\"";
+        m_line += bench;
+        m_line += "\",\"case\":\"";
+        m_line += name;
+        m_line += "\"";
+        const char *tag = getenv("BENCH_TAG");
+        if (tag)
+            param("tag", tag);
+    }
+
+    Bench_report &param(const char *key, const char *value)
+    {
+        m_line += ",\"";
+        m_line += key;
+        m_line += "\":\"";
+        m_line += value;
+        m_line += "\"";
+        return *this;
+    }
+
+    Bench_report &param(const char *key, long long value)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%lld", value);
+        m_line += ",\"";
+        m_line += key;
+        m_line += "\":";
+        m_line += buf;
+        return *this;
+    }
+
+    Bench_report &metric(const char *key, double value)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.1f", value);
+        m_line += ",\"";
+        m_line += key;
+        m_line += "\":";
+        m_line += buf;
+        return *this;
+    }
+
+    Bench_report &latency(std::vector<long long> &samples)
+    {
+        std::sort(samples.begin(), samples.end());
+        metric("p50_ns", (double)bench_percentile(samples, 0.50));
+        metric("p99_ns", (double)bench_percentile(samples, 0.99));
+        metric("p999_ns", (double)bench_percentile(samples, 0.999));
+        metric("max_ns", samples.empty() ? 0.0 : (double)samples.back());
+        return *this;
+    }
+
+    Bench_report &histogram(const Latency_histogram &hist)
+    {
+        metric("p50_ns", (double)hist.percentile(0.50));
+        metric("p99_ns", (double)hist.percentile(0.99));
+        metric("p999_ns", (double)hist.percentile(0.999));
+        metric("max_ns", (double)hist.max());
+        return *this;
+    }
+
+    void print()
+    {
+        printf("%s}\n", m_line.c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::string m_line;
+};
+
+#endif
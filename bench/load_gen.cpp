@@ -0,0 +1,807 @@
+/*************************************************************
+*回环端到端负载测试
+*服务端：进程内的桩服务器，使用与webserver相同的组件
+*        Utils::Accept/Addfd/Modfd + EPOLLONESHOT + threadpool(模型2) + Fifo_timer_list，
+*        数据库连接池换成stub中的替身，可用-l注入每个请求的连接池延迟
+*客户端：多个keep-alive连接，按固定速率开环发送（发送时刻事先排好，不等上一个响应），
+*        延迟从计划发送时刻算起，服务端变慢时排队时间也计入延迟，避免coordinated omission
+*结果：对数-线性直方图的p50/p99/p999，一行JSON
+*
+*编译（所有目标文件都先包含连接池替身，不需要MySQL）：
+*g++ -O2 -std=c++14 -pthread -include bench/stub/sql_connection_pool.h \
+*    bench/load_gen.cpp timer/List_Timer.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp \
+*    buffer/Chunk_pool.cpp buffer/Output_buffer.cpp buffer/Input_buffer.cpp arena/Arena.cpp conn/Conn_Table.cpp -o load_gen
+*-a需要协程：改用-std=c++20，并加上coro/Coro_Pool.cpp coro/Coro_Io.cpp
+*运行：./load_gen [-c 连接数] [-r 每秒请求数] [-d 秒数] [-t 客户端线程数]
+*                 [-w 服务端工作线程数] [-l 连接池延迟us] [-p 端口，0为随机]
+*                 [-T 追踪输出文件] [-S 追踪采样率，每N个连接记录1个]
+*                 [-q 线程池排队时延目标ms，0为关闭准入控制] [-e 线程池按截止时间优先调度]
+*                 [-i 空闲秒数，超过后连接归还读缓冲区，0为关闭]
+*                 [-D 数据库连接数，默认等于工作线程数] [-a 协程方式处理请求]
+*过载时被准入控制拒绝的请求收到503后连接被关闭，客户端计入shed并重新连接
+*-a时连接池不再注入延迟，请求由协程处理：co_await租用连接，向bench/stub/stub_db.h的替身数据库发查询，
+*co_await回复的socket可读，延迟都在替身数据库里，等待期间工作线程去处理其他请求
+*连接登记在Conn_table中，连接对象按槽位号存放，交给线程池的请求带着句柄，连接关闭后出队的请求直接丢弃
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <deque>
+#include <vector>
+#include "bench_util.h"
+#include "stub/sql_connection_pool.h"
+#include "../threadpool.h"
+#include "../trace/Trace.h"
+#include "../timer/List_Timer.h"
+#include "../buffer/Output_buffer.h"
+#include "../buffer/Input_buffer.h"
+#include "../conn/Conn_Table.h"
+#include "../coro/Coro_Pool.h"
+#include "../coro/Coro_Io.h"
+#include "stub/stub_db.h"
+#include "../http/http_conn.h"
+
+//cb_func维护该计数，本程序不链接http_conn.cpp
+int http_conn::m_user_count = 0;
+
+static const int MAX_EVENT_NUMBER = 10000;
+static const int TIMESLOT = 5;
+
+static const char REQUEST[] = "GET /ping HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+static const char RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Length: 4\r\nConnection: keep-alive\r\n\r\npong";
+static const int REQUEST_LEN = sizeof(REQUEST) - 1;
+static const int RESPONSE_LEN = sizeof(RESPONSE) - 1;
+static const char BUSY_RESPONSE[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+static volatile bool g_server_stop = false;
+
+/**********桩服务器********** */
+/*
+class: Stub_conn
+桩连接，满足threadpool对任务类型的要求
+@ function: 主线程read_once()读入请求，工作线程process()在持有数据库连接时解析完整请求并生成响应，
+            然后注册EPOLLOUT，主线程write()发送，和http_conn的proactor流程一致；
+            响应是静态字符串，以引用方式放入Output_buffer，不复制；
+            读缓冲区是池化的块，连接空闲时park()归还，下一次read_once()重新取
+*/
+class Stub_conn
+{
+public:
+    void init(int sockfd, const sockaddr_in &address);
+
+    bool read_once();
+
+    void process();
+
+    bool write();
+
+    bool park();
+
+    void drop();
+
+    MYSQL *mysql;
+    int m_state;
+    int improv;
+    int timer_flag;
+
+    static int m_epollfd;
+    static Utils *m_utils;
+
+    client_data m_user;
+
+    //交给线程池到process()结束之间为true，此时park()不能动缓冲区
+    bool m_busy;
+
+    Conn_handle m_handle;
+
+private:
+    int m_sockfd;
+    Input_buffer m_in;
+    Output_buffer m_out;
+};
+
+int Stub_conn::m_epollfd = -1;
+Utils *Stub_conn::m_utils = NULL;
+
+void Stub_conn::init(int sockfd, const sockaddr_in &address){
+    m_sockfd = sockfd;
+    m_handle = 0;
+    m_in.Clear();
+    m_out.Clear();
+    m_busy = false;
+    m_state = 0;
+    improv = 0;
+    timer_flag = 0;
+    m_user.sockfd = sockfd;
+    m_user.address = address;
+    m_user.timer = NULL;
+}
+
+bool Stub_conn::read_once(){
+    return m_in.Read(m_sockfd);
+}
+
+void Stub_conn::process(){
+    //连接池延迟在connectionRAII中注入，这里只解析：每个以空行结尾的请求回一个响应
+    char *data = m_in.Data();
+    int start = 0;
+    while (data){
+        char *end = (char *)memmem(data + start, m_in.Size() - start, "\r\n\r\n", 4);
+        //段数用完时剩下的请求留到下一轮
+        if (!end || !m_out.AppendRef(RESPONSE, RESPONSE_LEN)){
+            break;
+        }
+        start = (int)(end - data) + 4;
+    }
+    m_in.Consume(start);
+
+    __atomic_store_n(&m_busy, false, __ATOMIC_RELEASE);
+    m_utils->Modfd(m_epollfd, m_sockfd, m_out.Empty() ? EPOLLIN : EPOLLOUT, true, 0);
+}
+
+bool Stub_conn::write(){
+    int ret = m_out.Flush(m_sockfd);
+    if (ret == OUTPUT_ERROR){
+        return false;
+    }
+    //EAGAIN时Output_buffer记住了进度，等下一次EPOLLOUT继续
+    m_utils->Modfd(m_epollfd, m_sockfd, ret == OUTPUT_AGAIN ? EPOLLOUT : EPOLLIN, true, 0);
+    return true;
+}
+
+/*
+@ function: 连接空闲时由定时器容器在主线程调用，归还读缓冲区；输出缓冲区发送完时已经不持有块
+@ return: (bool) 请求还在线程池中时返回false
+*/
+bool Stub_conn::park(){
+    if (__atomic_load_n(&m_busy, __ATOMIC_ACQUIRE)){
+        return false;
+    }
+    m_in.Release();
+    return true;
+}
+
+/*
+@ function: 连接关闭时由主线程调用，归还读写缓冲区。槽位按FIFO复用，不能等到下一次init()再清空；
+            请求还在线程池中时由init()清空
+@ return: 无
+*/
+void Stub_conn::drop(){
+    if (__atomic_load_n(&m_busy, __ATOMIC_ACQUIRE)){
+        return;
+    }
+    m_in.Clear();
+    m_out.Clear();
+}
+
+struct Server_arg
+{
+    int listenfd;
+    int workers;
+    int admission_ms;
+    bool edf;
+    int idle_after;
+    bool async;
+    int db_conns;
+    int latency_us;
+};
+
+//服务端线程的连接表；连接对象按槽位号索引，首次用到时分配
+static Conn_table g_table;
+static Stub_conn *g_conns[UTILS_MAX_FD];
+
+//结束时各状态的连接数
+static long g_conn_states[CONN_PARKED + 1];
+
+static Stub_conn *find_conn(int sockfd){
+    Conn_handle handle = g_table.Find(sockfd);
+    return handle ? g_conns[Conn_table::Index(handle)] : NULL;
+}
+
+static void close_conn(Utils &utils, int epollfd, Stub_conn *conn){
+    int sockfd = conn->m_user.sockfd;
+    g_table.Close(conn->m_handle);
+    conn->drop();
+    if (conn->m_user.timer){
+        utils.m_timer_list.del_timer(conn->m_user.timer);
+        conn->m_user.timer = NULL;
+    }
+    utils.Removefd(epollfd, sockfd);
+    __atomic_fetch_sub(&http_conn::m_user_count, 1, __ATOMIC_RELAXED);
+}
+
+/*
+@ function: 线程池拒绝请求时的回调，在主线程append_p内调用：
+            删除定时器和epoll事件后用Utils::ShowError回503并关闭，与webserver连接数超限时的处理相同
+@ param: conn (Stub_conn *)
+@ return: 无
+*/
+static void shed_conn(Stub_conn *conn){
+    Utils &utils = *Stub_conn::m_utils;
+    int sockfd = conn->m_user.sockfd;
+    g_table.Close(conn->m_handle);
+    //被拒绝的请求没有进入队列
+    conn->m_busy = false;
+    conn->drop();
+    if (conn->m_user.timer){
+        utils.m_timer_list.del_timer(conn->m_user.timer);
+        conn->m_user.timer = NULL;
+    }
+    epoll_ctl(Stub_conn::m_epollfd, EPOLL_CTL_DEL, sockfd, NULL);
+    Utils::ForgetFd(sockfd);
+    utils.ShowError(sockfd, BUSY_RESPONSE);
+    __atomic_fetch_sub(&http_conn::m_user_count, 1, __ATOMIC_RELAXED);
+}
+
+//定时器到期回调：先让句柄失效，队列中这个连接的请求出队时直接丢弃，再按原来的方式关闭
+static void expire_conn(client_data *user){
+    Stub_conn *conn = find_conn(user->sockfd);
+    if (conn){
+        g_table.Close(conn->m_handle);
+        conn->drop();
+    }
+    cb_func(user);
+}
+
+//空闲回调，user_data是Stub_conn::m_user
+static void park_conn(client_data *user){
+    Stub_conn *conn = find_conn(user->sockfd);
+    if (conn && conn->park()){
+        g_table.SetState(conn->m_handle, CONN_PARKED);
+    }
+}
+
+#ifdef CORO_ENABLED
+static Coro_conn_pool g_coro_pool;
+static Coro_io g_coro_io;
+static Stub_db g_db;
+
+/*
+@ function: 协程方式处理一个请求：租用连接，向替身数据库发一条查询，等回复期间挂起，
+            然后和同步方式一样在持有连接时process()
+@ param: conn (Stub_conn *)
+@ return: (Coro_task)
+*/
+static Coro_task process_async(Stub_conn *conn){
+    Conn_handle handle = conn->m_handle;
+    Coro_lease lease = co_await g_coro_pool.Acquire();
+    int dbfd = g_db.Fd(lease.slot);
+    bool replied = write(dbfd, "Q\n", 2) == 2;
+    while (replied){
+        char reply[8];
+        ssize_t len = read(dbfd, reply, sizeof(reply));
+        if (len > 0 && reply[len - 1] == '\n'){
+            break;
+        }
+        if (len == 0 || (len < 0 && errno != EAGAIN)){
+            replied = false;
+            break;
+        }
+        if (len < 0 && (co_await g_coro_io.Readable(dbfd) & EPOLLERR)){
+            replied = false;
+            break;
+        }
+    }
+    //等待期间连接可能已被关闭，Stub_conn也可能已经属于复用同一槽位的新连接
+    if (g_table.Valid(handle)){
+        conn->process();
+    }
+    g_coro_pool.Release(lease);
+}
+
+static void start_async(Stub_conn *conn){
+    process_async(conn);
+}
+#endif
+
+//Chunk_pool中被连接持有的块数
+static int g_chunks_held = 0;
+
+static void refresh_timer(Utils &utils, Stub_conn *conn){
+    if (conn->m_user.timer){
+        conn->m_user.timer->Time_out = time(NULL) + 3 * TIMESLOT;
+        utils.m_timer_list.adjust_timer(conn->m_user.timer);
+        g_table.SetDeadline(conn->m_handle, conn->m_user.timer->Time_out);
+    }
+}
+
+static void *server_main(void *arg){
+    Server_arg *server = (Server_arg *)arg;
+    Utils utils;
+    utils.Init(TIMESLOT);
+    g_table.Init(UTILS_MAX_FD);
+    if (server->idle_after > 0){
+        utils.m_timer_list.set_idle_callback(park_conn, server->idle_after);
+    }
+
+    int epollfd = epoll_create1(EPOLL_CLOEXEC);
+    Utils::u_epollfd = epollfd;
+    Stub_conn::m_epollfd = epollfd;
+    Stub_conn::m_utils = &utils;
+
+    epoll_event event;
+    event.data.fd = server->listenfd;
+    event.events = EPOLLIN;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, server->listenfd, &event);
+
+    connection_pool *pool = connection_pool::GetInstance();
+    threadpool<Stub_conn> *workers = new threadpool<Stub_conn>(0, pool, server->workers, 10000);
+    workers->set_admission(server->admission_ms, 100);
+    workers->set_shed_handler(shed_conn);
+    workers->set_edf(server->edf);
+    workers->set_conn_table(&g_table);
+#ifdef CORO_ENABLED
+    if (server->async){
+        g_db.Start(server->db_conns, server->latency_us);
+        g_coro_pool.Init(pool, server->db_conns, workers->executor());
+        g_coro_io.Start(workers->executor());
+        workers->set_async_handler(start_async);
+    }
+#endif
+
+    epoll_event *events = new epoll_event[MAX_EVENT_NUMBER];
+    bool more = false;
+    while (!g_server_stop){
+        //100ms上限用于检查g_server_stop
+        time_t now = time(NULL);
+        time_t wake = more ? now : utils.m_timer_list.next_expiry();
+        int timeout = 100;
+        if (wake != 0 && wake <= now){
+            timeout = 0;
+        }
+        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, timeout);
+        for (int i = 0; i < number; ++i){
+            int sockfd = events[i].data.fd;
+            if (sockfd == server->listenfd){
+                while (true){
+                    sockaddr_in address;
+                    int connfd = utils.Accept(server->listenfd, &address);
+                    if (connfd < 0){
+                        break;
+                    }
+                    time_t deadline = time(NULL) + 3 * TIMESLOT;
+                    Conn_handle handle = g_table.Open(connfd, deadline);
+                    if (!handle){
+                        utils.ShowError(connfd, "Internal server busy");
+                        continue;
+                    }
+                    int index = Conn_table::Index(handle);
+                    if (!g_conns[index]){
+                        g_conns[index] = new Stub_conn;
+                    }
+                    Stub_conn *conn = g_conns[index];
+                    conn->init(connfd, address);
+                    conn->m_handle = handle;
+                    utils.Addfd(epollfd, connfd, true, 0);
+                    __atomic_fetch_add(&http_conn::m_user_count, 1, __ATOMIC_RELAXED);
+
+                    Util_timer *timer = new Util_timer;
+                    timer->user_data = &conn->m_user;
+                    timer->cb_func = expire_conn;
+                    timer->Time_out = deadline;
+                    conn->m_user.timer = timer;
+                    utils.m_timer_list.add_timer(timer);
+                }
+                continue;
+            }
+            Stub_conn *conn = find_conn(sockfd);
+            if (!conn){
+                continue;
+            }
+            if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                close_conn(utils, epollfd, conn);
+            }else if (events[i].events & EPOLLIN){
+                TRACE_REQUEST(conn);
+                bool read_ok;
+                {
+                    TRACE_SCOPE("http.read_once");
+                    read_ok = conn->read_once();
+                }
+                if (!read_ok){
+                    close_conn(utils, epollfd, conn);
+                    continue;
+                }
+                refresh_timer(utils, conn);
+                conn->m_busy = true;
+                g_table.SetState(conn->m_handle, CONN_QUEUED);
+                //被拒绝时shed_conn已经回复并关闭连接
+                workers->append_p(conn, g_table.Deadline(conn->m_handle), conn->m_handle);
+            }else if (events[i].events & EPOLLOUT){
+                TRACE_REQUEST(conn);
+                bool write_ok;
+                {
+                    TRACE_SCOPE("http.write");
+                    write_ok = conn->write();
+                }
+                if (!write_ok){
+                    close_conn(utils, epollfd, conn);
+                    continue;
+                }
+                refresh_timer(utils, conn);
+                g_table.SetState(conn->m_handle, CONN_ACTIVE);
+            }
+        }
+
+        TRACE_REQUEST(0);
+        now = time(NULL);
+        more = false;
+        if (wake != 0 && now >= wake){
+            more = utils.m_timer_list.tick();
+        }
+    }
+
+    //客户端已经收尾，连接仍然打开
+    Chunk_pool *chunks = Chunk_pool::GetInstance();
+    g_chunks_held = chunks->TotalCount() - chunks->FreeCount();
+    g_table.CountStates(g_conn_states);
+
+#ifdef CORO_ENABLED
+    //挂起的协程还要靠线程池恢复，等它们结束后再停线程池，最多1秒
+    for (int i = 0; i < 1000 && Coro_task::InFlight() > 0; ++i){
+        usleep(1000);
+    }
+    g_coro_io.Stop();
+#endif
+    //队列中剩余的请求最多再处理1秒
+    workers->shutdown(1000);
+    delete workers;
+    delete[] events;
+    close(epollfd);
+    return NULL;
+}
+
+/**********开环客户端********** */
+struct Client_conn
+{
+    int fd;
+    bool busy;                    //有请求已发出、响应未收全
+    int received;                 //当前响应已收到的字节数
+    long long intended;           //在途请求的计划发送时刻
+    std::deque<long long> backlog; //到了计划时刻但连接忙，排队等待的请求
+    bool shed;                    //收到503，等待服务端关闭后重连
+};
+
+struct Client_arg
+{
+    std::vector<Client_conn> conns;
+    double rate;                  //本线程每秒请求数
+    long long start_ns;
+    long long end_ns;
+    Latency_histogram hist;
+    long long sent;
+    long long errors;
+    long long shed;
+    int port;
+};
+
+static bool send_request(Client_conn &conn, long long intended){
+    int sent = 0;
+    while (sent < REQUEST_LEN){
+        int bytes = send(conn.fd, REQUEST + sent, REQUEST_LEN - sent, MSG_NOSIGNAL);
+        if (bytes < 0){
+            //请求很小，发送缓冲区满时短暂重试
+            if (errno == EAGAIN || errno == EWOULDBLOCK){
+                continue;
+            }
+            return false;
+        }
+        sent += bytes;
+    }
+    conn.busy = true;
+    conn.received = 0;
+    conn.intended = intended;
+    return true;
+}
+
+static int connect_to(int port);
+
+static void *client_main(void *arg){
+    Client_arg *client = (Client_arg *)arg;
+    int epollfd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < client->conns.size(); ++i){
+        epoll_event event;
+        event.data.u32 = (uint32_t)i;
+        event.events = EPOLLIN;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, client->conns[i].fd, &event);
+    }
+
+    epoll_event events[256];
+    char buf[4096];
+    double interval = 1e9 / client->rate;
+    long long index = 0;
+    size_t next_conn = 0;
+
+    //发送结束后再等一秒收尾，仍未收到的响应计为错误
+    long long drain_end = client->end_ns + 1000000000LL;
+    while (true){
+        long long now = bench_now_ns();
+        long long next_send = client->start_ns + (long long)(index * interval);
+        bool sending = next_send < client->end_ns;
+        if (!sending && now >= drain_end){
+            break;
+        }
+
+        //到期的请求全部发出，连接忙时进入该连接的排队
+        while (sending && next_send <= now){
+            Client_conn &conn = client->conns[next_conn];
+            next_conn = (next_conn + 1) % client->conns.size();
+            if (conn.busy){
+                conn.backlog.push_back(next_send);
+            }else if (!send_request(conn, next_send)){
+                ++client->errors;
+            }
+            ++client->sent;
+            ++index;
+            next_send = client->start_ns + (long long)(index * interval);
+            sending = next_send < client->end_ns;
+        }
+
+        //小于1ms的等待不睡眠，保证发送时刻准确
+        long long wait_ns = (sending ? next_send : drain_end) - bench_now_ns();
+        int timeout = wait_ns > 1000000 ? (int)(wait_ns / 1000000) : 0;
+        int number = epoll_wait(epollfd, events, 256, timeout);
+        for (int i = 0; i < number; ++i){
+            Client_conn &conn = client->conns[events[i].data.u32];
+            int bytes = recv(conn.fd, buf, sizeof(buf), 0);
+            if (bytes <= 0){
+                if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                    continue;
+                }
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, conn.fd, NULL);
+                close(conn.fd);
+                conn.fd = -1;
+                client->errors += conn.busy && !conn.shed ? 1 : 0;
+                conn.busy = false;
+                //被拒绝后重连，排队中的请求在新连接上继续发送
+                if (conn.shed && (conn.fd = connect_to(client->port)) >= 0){
+                    conn.shed = false;
+                    epoll_event event;
+                    event.data.u32 = events[i].data.u32;
+                    event.events = EPOLLIN;
+                    epoll_ctl(epollfd, EPOLL_CTL_ADD, conn.fd, &event);
+                    if (!conn.backlog.empty()){
+                        long long intended = conn.backlog.front();
+                        conn.backlog.pop_front();
+                        if (!send_request(conn, intended)){
+                            ++client->errors;
+                        }
+                    }
+                    continue;
+                }
+                client->errors += conn.backlog.size();
+                conn.backlog.clear();
+                //连接已失效，之后轮到它的请求都计为错误
+                conn.busy = true;
+                conn.shed = false;
+                continue;
+            }
+            if (conn.received == 0 && bytes >= 12 && memcmp(buf, BUSY_RESPONSE, 12) == 0){
+                //连接保持busy，之后分到它的请求进入排队，重连后发送
+                ++client->shed;
+                conn.shed = true;
+                continue;
+            }
+            conn.received += bytes;
+            if (conn.received < RESPONSE_LEN){
+                continue;
+            }
+            client->hist.record(bench_now_ns() - conn.intended);
+            conn.busy = false;
+            if (!conn.backlog.empty()){
+                long long intended = conn.backlog.front();
+                conn.backlog.pop_front();
+                if (!send_request(conn, intended)){
+                    ++client->errors;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < client->conns.size(); ++i){
+        Client_conn &conn = client->conns[i];
+        client->errors += (conn.busy && !conn.shed && conn.fd >= 0 ? 1 : 0) + conn.backlog.size();
+    }
+    close(epollfd);
+    return NULL;
+}
+
+static int connect_to(int port){
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0){
+        close(fd);
+        return -1;
+    }
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int main(int argc, char *argv[]){
+    int connections = 100, client_threads = 2, workers = 8, latency_us = 0, port = 0, sample_rate = 1;
+    int admission_ms = 5, idle_after = 0, db_conns = 0;
+    bool edf = false, async = false;
+    const char *trace_path = NULL;
+    double rate = 20000, seconds = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:d:t:w:l:p:T:S:q:ei:D:a")) != -1){
+        switch (opt){
+        case 'c': connections = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 't': client_threads = atoi(optarg); break;
+        case 'w': workers = atoi(optarg); break;
+        case 'l': latency_us = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        case 'T': trace_path = optarg; break;
+        case 'S': sample_rate = atoi(optarg); break;
+        case 'q': admission_ms = atoi(optarg); break;
+        case 'e': edf = true; break;
+        case 'i': idle_after = atoi(optarg); break;
+        case 'D': db_conns = atoi(optarg); break;
+        case 'a': async = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-c conns] [-r rate] [-d seconds] [-t client_threads] "
+                            "[-w workers] [-l pool_latency_us] [-p port] [-T trace.json] [-S sample_rate] "
+                            "[-q admission_target_ms] [-e] [-i idle_seconds] [-D db_conns] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (connections < client_threads){
+        client_threads = connections;
+    }
+    if (db_conns <= 0){
+        db_conns = workers;
+    }
+#ifndef CORO_ENABLED
+    if (async){
+        fprintf(stderr, "-a requires C++20 coroutines (-std=c++20)\n");
+        return 1;
+    }
+#endif
+
+    //两端的fd都在本进程内
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    connection_pool *pool = connection_pool::GetInstance();
+    pool->init("localhost", "", "", "", 0, db_conns, 1);
+    //协程方式下延迟注入在替身数据库里
+    pool->SetLatency(async ? 0 : latency_us);
+
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int flag = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(listenfd, (sockaddr *)&address, sizeof(address)) < 0 || listen(listenfd, 4096) < 0 ||
+        getsockname(listenfd, (sockaddr *)&address, &length) < 0){
+        perror("listen");
+        return 1;
+    }
+    port = ntohs(address.sin_port);
+
+    if (trace_path){
+        Tracer::Start(sample_rate, 1 << 16);
+    }
+
+    Server_arg server;
+    server.listenfd = listenfd;
+    server.workers = workers;
+    server.admission_ms = admission_ms;
+    server.edf = edf;
+    server.idle_after = idle_after;
+    server.async = async;
+    server.db_conns = db_conns;
+    server.latency_us = latency_us;
+    pthread_t server_tid;
+    pthread_create(&server_tid, NULL, server_main, &server);
+
+    std::vector<Client_arg> clients(client_threads);
+    for (int i = 0; i < connections; ++i){
+        Client_conn conn;
+        conn.fd = connect_to(port);
+        if (conn.fd < 0){
+            perror("connect");
+            return 1;
+        }
+        conn.busy = false;
+        conn.received = 0;
+        conn.intended = 0;
+        conn.shed = false;
+        clients[i % client_threads].conns.push_back(conn);
+    }
+
+    long long start = bench_now_ns() + 100000000LL;
+    long long end = start + (long long)(seconds * 1e9);
+    std::vector<pthread_t> client_tids(client_threads);
+    for (int i = 0; i < client_threads; ++i){
+        clients[i].rate = rate / client_threads;
+        clients[i].start_ns = start;
+        clients[i].end_ns = end;
+        clients[i].sent = 0;
+        clients[i].errors = 0;
+        clients[i].shed = 0;
+        clients[i].port = port;
+        pthread_create(&client_tids[i], NULL, client_main, &clients[i]);
+    }
+
+    Latency_histogram hist;
+    long long sent = 0, errors = 0, shed = 0;
+    for (int i = 0; i < client_threads; ++i){
+        pthread_join(client_tids[i], NULL);
+        hist.merge(clients[i].hist);
+        sent += clients[i].sent;
+        errors += clients[i].errors;
+        shed += clients[i].shed;
+    }
+
+    g_server_stop = true;
+    pthread_join(server_tid, NULL);
+
+    if (trace_path){
+        Tracer::Stop();
+        if (!Tracer::Export(trace_path)){
+            perror("trace export");
+        }
+    }
+
+    //服务端经Utils发起的系统调用，按完成的请求数平均
+    double requests = (double)hist.count();
+    char name[64];
+    snprintf(name, sizeof(name), "c%d_r%.0f", connections, rate);
+    Bench_report("load_gen", name)
+        .param("connections", connections)
+        .param("target_rps", (long long)rate)
+        .param("workers", workers)
+        .param("pool_latency_us", latency_us)
+        .param("db_conns", db_conns)
+        .param("async", async ? 1 : 0)
+        .param("sent", sent)
+        .param("completed", hist.count())
+        .param("errors", errors)
+        .param("shed", shed)
+        .param("admission_ms", admission_ms)
+        .param("idle_after", idle_after)
+        .param("chunks_held", g_chunks_held)
+        .param("conns_active", g_conn_states[CONN_ACTIVE] + g_conn_states[CONN_QUEUED])
+        .param("conns_parked", g_conn_states[CONN_PARKED])
+        .param("accept_calls", (long long)Utils::u_syscalls.accept)
+        .param("epoll_ctl_calls", (long long)Utils::u_syscalls.epoll_ctl)
+        .param("fcntl_calls", (long long)Utils::u_syscalls.fcntl)
+        .param("epoll_ctl_saved", (long long)Utils::u_syscalls.epoll_ctl_saved)
+        .param("fcntl_saved", (long long)Utils::u_syscalls.fcntl_saved)
+        .metric("epoll_ctl_per_req", requests > 0 ? (double)Utils::u_syscalls.epoll_ctl / requests : 0)
+        .metric("fcntl_per_req", requests > 0 ? (double)Utils::u_syscalls.fcntl / requests : 0)
+        .metric("achieved_rps", hist.count() / seconds)
+        .histogram(hist)
+        .print();
+
+    for (int i = 0; i < client_threads; ++i){
+        for (size_t j = 0; j < clients[i].conns.size(); ++j){
+            close(clients[i].conns[j].fd);
+        }
+    }
+    close(listenfd);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*************************************************************
+*数据库连接池的本地替身，用于基准测试和负载测试，不需要MySQL服务
+*与CGImysql/sql_connection_pool.h使用相同的头文件保护宏，先包含本文件，
+*threadpool.h等再包含真正的连接池头文件时会被跳过
+*SetLatency()可以给每次取连接注入固定延迟，模拟慢查询
+**************************************************************/
+#ifndef _CONNECTION_POOL_
+#define _CONNECTION_POOL_
+#include <unistd.h>
+#include "../../lock/locker.h"
+
+typedef struct st_mysql MYSQL;
+
+class connection_pool
+{
+public:
+    static connection_pool *GetInstance()
+    {
+        static connection_pool connPool;
+        return &connPool;
+    }
+
+    //与真实连接池的init保持参数个数一致，只使用MaxConn
+    void init(const char *url, const char *User, const char *PassWord, const char *DataBaseName,
+              int Port, int MaxConn, int close_log)
+    {
+        m_lock.lock();
+        m_MaxConn = MaxConn > 0 ? MaxConn : 1;
+        m_FreeConn = m_MaxConn;
+        m_lock.unlock();
+    }
+
+    //每次取连接前等待注入的延迟（微秒）
+    void SetLatency(int latency_us) { m_latency_us = latency_us; }
+
+    int GetLatency() const { return m_latency_us; }
+
+    //没有空闲连接时阻塞等待，与真实连接池的行为一致
+    MYSQL *GetConnection()
+    {
+        m_lock.lock();
+        while (m_FreeConn <= 0)
+            m_cond.wait(m_lock.get());
+        --m_FreeConn;
+        m_lock.unlock();
+        if (m_latency_us > 0)
+            usleep(m_latency_us);
+        return (MYSQL *)this;
+    }
+
+    bool ReleaseConnection(MYSQL *conn)
+    {
+        if (!conn)
+            return false;
+        m_lock.lock();
+        ++m_FreeConn;
+        m_cond.signal();
+        m_lock.unlock();
+        return true;
+    }
+
+    int GetFreeConn() { return m_FreeConn; }
+
+private:
+    connection_pool() : m_MaxConn(8), m_FreeConn(8), m_latency_us(0) {}
+
+    int m_MaxConn;
+    int m_FreeConn;
+    int m_latency_us;
+    locker m_lock;
+    cond m_cond;
+};
+
+class connectionRAII
+{
+public:
+    connectionRAII(MYSQL **con, connection_pool *connPool)
+    {
+        *con = connPool->GetConnection();
+        conRAII = *con;
+        poolRAII = connPool;
+    }
+    ~connectionRAII() { poolRAII->ReleaseConnection(conRAII); }
+
+private:
+    MYSQL *conRAII;
+    connection_pool *poolRAII;
+};
+
+#endif
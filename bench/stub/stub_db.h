@@ -0,0 +1,158 @@
+/*************************************************************
+*本地替身数据库，用于测试协程方式的请求处理
+*每个连接是一对非阻塞的socketpair，客户端写入以'\n'结尾的查询，
+*服务线程在注入的延迟之后回复"OK\n"；等待回复时调用方可以co_await Coro_io::Readable，
+*与connection_pool替身在GetConnection中usleep不同，延迟期间不占用调用线程
+*延迟固定，回复按收到查询的顺序发出
+**************************************************************/
+#ifndef STUB_DB_H
+#define STUB_DB_H
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <deque>
+#include <vector>
+
+class Stub_db
+{
+public:
+    Stub_db() : m_latency_us(0), m_epollfd(-1), m_stop(false), m_started(false) {}
+
+    ~Stub_db() { Stop(); }
+
+    //connections个连接，每个查询延迟latency_us微秒后回复
+    bool Start(int connections, int latency_us)
+    {
+        m_latency_us = latency_us;
+        m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epollfd < 0)
+            return false;
+        for (int i = 0; i < connections; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+                return false;
+            m_client.push_back(fds[0]);
+            m_server.push_back(fds[1]);
+            epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = fds[1];
+            epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fds[1], &event);
+        }
+        m_stop = false;
+        if (pthread_create(&m_thread, NULL, worker, this) != 0)
+            return false;
+        m_started = true;
+        return true;
+    }
+
+    void Stop()
+    {
+        if (m_started)
+        {
+            m_stop = true;
+            pthread_join(m_thread, NULL);
+            m_started = false;
+        }
+        for (size_t i = 0; i < m_client.size(); ++i)
+        {
+            close(m_client[i]);
+            close(m_server[i]);
+        }
+        m_client.clear();
+        m_server.clear();
+        if (m_epollfd >= 0)
+            close(m_epollfd);
+        m_epollfd = -1;
+    }
+
+    //第index个连接的客户端fd（非阻塞）
+    int Fd(int index) const { return m_client[index]; }
+
+    int Size() const { return (int)m_client.size(); }
+
+private:
+    struct Pending
+    {
+        long long due_ns;
+        int fd;
+    };
+
+    static long long now_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    static void *worker(void *arg)
+    {
+        ((Stub_db *)arg)->run();
+        return NULL;
+    }
+
+    void run()
+    {
+        std::deque<Pending> pending;
+        epoll_event events[64];
+        while (!m_stop)
+        {
+            //等到队首到期，最多100ms以便检查m_stop
+            int timeout = 100;
+            if (!pending.empty())
+            {
+                long long wait_ns = pending.front().due_ns - now_ns();
+                timeout = wait_ns <= 0 ? 0 : (int)((wait_ns + 999999) / 1000000);
+                if (timeout > 100)
+                    timeout = 100;
+            }
+            int number = epoll_wait(m_epollfd, events, 64, timeout);
+            long long now = now_ns();
+            for (int i = 0; i < number; ++i)
+            {
+                char buf[4096];
+                ssize_t len;
+                while ((len = read(events[i].data.fd, buf, sizeof(buf))) > 0)
+                {
+                    for (ssize_t j = 0; j < len; ++j)
+                    {
+                        if (buf[j] == '\n')
+                        {
+                            Pending query = {now + (long long)m_latency_us * 1000, events[i].data.fd};
+                            pending.push_back(query);
+                        }
+                    }
+                }
+            }
+            //epoll_wait按毫秒取整，到期前1ms内的也一起回复，避免再睡一轮
+            now = now_ns();
+            while (!pending.empty() && pending.front().due_ns <= now + 1000000)
+            {
+                if (pending.front().due_ns > now)
+                {
+                    struct timespec ts = {0, (long)(pending.front().due_ns - now)};
+                    nanosleep(&ts, NULL);
+                    now = now_ns();
+                }
+                ssize_t ret = write(pending.front().fd, "OK\n", 3);
+                (void)ret;
+                pending.pop_front();
+            }
+        }
+    }
+
+    int m_latency_us;
+    int m_epollfd;
+    volatile bool m_stop;
+    bool m_started;
+    pthread_t m_thread;
+    std::vector<int> m_client;
+    std::vector<int> m_server;
+};
+
+#endif
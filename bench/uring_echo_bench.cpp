@@ -0,0 +1,261 @@
+/*************************************************************
+*epoll与io_uring两种I/O后端的回环echo对比测试
+*服务端：epoll模式使用Utils::Addfd + epoll_wait + read/write，
+*        io_uring模式使用multishot accept + provided buffer ring + 批量提交
+*客户端：本进程内的回环负载线程，每个连接循环发送固定大小消息并等待回显
+*输出每种模式一行JSON，便于在提交之间对比
+*
+*编译（与服务器其余目标文件一起链接，同makefile中server的依赖）：
+*g++ -O2 -std=c++14 -pthread bench/uring_echo_bench.cpp reactor/Io_Uring.cpp \
+*    timer/List_Timer.cpp log/log.cpp metrics/Metrics.cpp trace/Trace.cpp http/http_conn.cpp CGImysql/sql_connection_pool.cpp \
+*    -lmysqlclient -o uring_echo_bench
+*运行：./uring_echo_bench [连接数] [秒数] [消息字节数]
+**************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <vector>
+#include "../timer/List_Timer.h"
+#include "../reactor/Io_Uring.h"
+
+static volatile bool g_stop = false;
+static volatile bool g_server_stop = false;
+static int g_port = 0;
+
+static double now_sec(){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int open_listen(){
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    int flag = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    bind(listenfd, (struct sockaddr *)&address, sizeof(address));
+    listen(listenfd, 1024);
+    socklen_t len = sizeof(address);
+    getsockname(listenfd, (struct sockaddr *)&address, &len);
+    g_port = ntohs(address.sin_port);
+    return listenfd;
+}
+
+/**********epoll服务端********** */
+static void *epoll_server(void *arg){
+    int listenfd = *(int *)arg;
+    Utils utils;
+    int epollfd = epoll_create(5);
+    utils.Addfd(epollfd, listenfd, false, 0);
+
+    epoll_event events[1024];
+    char buf[4096];
+    while(!g_server_stop){
+        int number = epoll_wait(epollfd, events, 1024, 100);
+        for(int i = 0; i < number; ++i){
+            int sockfd = events[i].data.fd;
+            if(sockfd == listenfd){
+                int connfd;
+                while((connfd = accept(listenfd, NULL, NULL)) >= 0){
+                    int one = 1;
+                    setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    utils.Addfd(epollfd, connfd, false, 0);
+                }
+                continue;
+            }
+            int n = read(sockfd, buf, sizeof(buf));
+            if(n <= 0){
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, sockfd, NULL);
+                close(sockfd);
+                continue;
+            }
+            send(sockfd, buf, n, MSG_NOSIGNAL);
+        }
+    }
+    close(epollfd);
+    return NULL;
+}
+
+/**********io_uring服务端********** */
+static void *uring_server(void *arg){
+    int listenfd = *(int *)arg;
+    Io_uring ring;
+    if(!ring.Init(4096, 4096, 4096)){
+        return NULL;
+    }
+
+    //send完成前数据还在recv缓冲区内，按fd记录缓冲区编号，send完成后归还
+    std::vector<int> send_bid(65536, -1);
+    Uring_event events[256];
+    ring.PrepAccept(listenfd);
+
+    while(!g_server_stop){
+        ring.Submit(1);
+        int number = ring.Reap(events, 256);
+        for(int i = 0; i < number; ++i){
+            Uring_event &ev = events[i];
+            switch(ev.op){
+            case URING_ACCEPT:
+                if(ev.res >= 0){
+                    int one = 1;
+                    setsockopt(ev.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    ring.PrepRecv(ev.res);
+                }
+                if(!ev.more){
+                    ring.PrepAccept(listenfd);
+                }
+                break;
+            case URING_RECV:
+                if(ev.res <= 0){
+                    ring.RecycleBuffer(ev.bid);
+                    ring.PrepClose(ev.fd);
+                    break;
+                }
+                send_bid[ev.fd] = ev.bid;
+                ring.PrepSend(ev.fd, ev.buf, ev.res);
+                break;
+            case URING_SEND:
+                ring.RecycleBuffer(send_bid[ev.fd]);
+                send_bid[ev.fd] = -1;
+                if(ev.res < 0){
+                    ring.PrepClose(ev.fd);
+                }else{
+                    ring.PrepRecv(ev.fd);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**********回环负载生成********** */
+struct client_arg{
+    int conns;
+    int msg_size;
+    long long round_trips;
+};
+
+static void *client_worker(void *arg){
+    client_arg *ca = (client_arg *)arg;
+    std::vector<int> fds;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(g_port);
+
+    for(int i = 0; i < ca->conns; ++i){
+        int fd = socket(PF_INET, SOCK_STREAM, 0);
+        if(connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0){
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fds.push_back(fd);
+    }
+
+    std::vector<char> msg(ca->msg_size, 'x');
+    std::vector<char> buf(ca->msg_size);
+    while(!g_stop){
+        //每个连接先发出一条消息，再依次收齐回显，保持所有连接同时在途
+        for(size_t i = 0; i < fds.size(); ++i){
+            send(fds[i], &msg[0], msg.size(), MSG_NOSIGNAL);
+        }
+        for(size_t i = 0; i < fds.size(); ++i){
+            int got = 0;
+            while(got < ca->msg_size){
+                int n = recv(fds[i], &buf[got], ca->msg_size - got, 0);
+                if(n <= 0){
+                    break;
+                }
+                got += n;
+            }
+        }
+        ca->round_trips += fds.size();
+    }
+    for(size_t i = 0; i < fds.size(); ++i){
+        close(fds[i]);
+    }
+    return NULL;
+}
+
+static void run_mode(IO_BACKEND backend, int conns, int seconds, int msg_size){
+    g_stop = false;
+    g_server_stop = false;
+    int listenfd = open_listen();
+    pthread_t server;
+    pthread_create(&server, NULL, backend == URING_BACKEND ? uring_server : epoll_server, &listenfd);
+
+    const int client_threads = 4;
+    pthread_t clients[client_threads];
+    client_arg args[client_threads];
+    for(int i = 0; i < client_threads; ++i){
+        args[i].conns = conns / client_threads > 0 ? conns / client_threads : 1;
+        args[i].msg_size = msg_size;
+        args[i].round_trips = 0;
+        pthread_create(&clients[i], NULL, client_worker, &args[i]);
+    }
+
+    double start = now_sec();
+    sleep(seconds);
+    g_stop = true;
+    double elapsed = now_sec() - start;
+
+    long long total = 0;
+    for(int i = 0; i < client_threads; ++i){
+        pthread_join(clients[i], NULL);
+        total += args[i].round_trips;
+    }
+
+    //io_uring服务端可能阻塞在等待完成事件上，发起一次连接把它唤醒
+    g_server_stop = true;
+    int wake = socket(PF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(g_port);
+    connect(wake, (struct sockaddr *)&address, sizeof(address));
+    close(wake);
+    pthread_join(server, NULL);
+    close(listenfd);
+
+    printf("{\"bench\":\"echo\",\"backend\":\"%s\",\"conns\":%d,\"msg_size\":%d,"
+           "\"seconds\":%.2f,\"round_trips\":%lld,\"rps\":%.0f}\n",
+           backend == URING_BACKEND ? "io_uring" : "epoll", args[0].conns * client_threads,
+           msg_size, elapsed, total, total / elapsed);
+}
+
+int main(int argc, char *argv[]){
+    int conns = argc > 1 ? atoi(argv[1]) : 64;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    int msg_size = argc > 3 ? atoi(argv[3]) : 64;
+
+    //关闭日志，避免写文件干扰测试
+    Log::get_instance()->init("./uring_echo_bench_log", 1);
+
+    run_mode(EPOLL_BACKEND, conns, seconds, msg_size);
+    if(Io_uring::ChooseBackend(true) == URING_BACKEND){
+        run_mode(URING_BACKEND, conns, seconds, msg_size);
+    }else{
+        printf("{\"bench\":\"echo\",\"backend\":\"io_uring\",\"skipped\":\"unsupported\"}\n");
+    }
+    return 0;
+}
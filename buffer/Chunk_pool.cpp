@@ -0,0 +1,124 @@
+#include "Chunk_pool.h"
+#include <stdlib.h>
+#include "../metrics/Metrics.h"
+
+Chunk_pool::Chunk_pool(){
+    m_free = NULL;
+    m_free_count = 0;
+    m_max_free = 1024;
+    m_total = 0;
+}
+
+/*
+@ function: 释放池中的空闲块，仍被连接持有的块由持有者归还时释放
+@ return: 无
+*/
+Chunk_pool::~Chunk_pool(){
+    while(m_free){
+        Buffer_chunk *next = m_free->m_next;
+        free(m_free);
+        m_free = next;
+    }
+}
+
+/*
+@ function: 取一个块，池为空时新分配
+@ return: (Buffer_chunk *)
+*/
+Buffer_chunk *Chunk_pool::Acquire(){
+    m_lock.lock();
+    Buffer_chunk *chunk = m_free;
+    if(chunk){
+        m_free = chunk->m_next;
+        --m_free_count;
+    }else{
+        ++m_total;
+    }
+    int free_count = m_free_count;
+    int total = m_total;
+    m_lock.unlock();
+
+    if(!chunk){
+        chunk = (Buffer_chunk *)malloc(sizeof(Buffer_chunk));
+        if(!chunk){
+            m_lock.lock();
+            --m_total;
+            m_lock.unlock();
+            return NULL;
+        }
+        METRICS_GAUGE_SET("buffer.chunks_total", total);
+    }
+    METRICS_GAUGE_SET("buffer.chunks_free", free_count);
+    chunk->m_next = NULL;
+    chunk->m_used = 0;
+    return chunk;
+}
+
+/*
+@ function: 归还一个块
+@ param: chunk (Buffer_chunk *)
+@ return: 无
+*/
+void Chunk_pool::Release(Buffer_chunk *chunk){
+    if(!chunk){
+        return;
+    }
+    m_lock.lock();
+    bool keep = m_free_count < m_max_free;
+    if(keep){
+        chunk->m_next = m_free;
+        m_free = chunk;
+        ++m_free_count;
+    }else{
+        --m_total;
+    }
+    int free_count = m_free_count;
+    int total = m_total;
+    m_lock.unlock();
+
+    if(!keep){
+        free(chunk);
+        METRICS_GAUGE_SET("buffer.chunks_total", total);
+    }
+    METRICS_GAUGE_SET("buffer.chunks_free", free_count);
+}
+
+/*
+@ function: 设置空闲块上限，超出的部分立即释放
+@ param: max_free (int)
+@ return: 无
+*/
+void Chunk_pool::SetMaxFree(int max_free){
+    Buffer_chunk *extra = NULL;
+    m_lock.lock();
+    m_max_free = max_free > 0 ? max_free : 0;
+    while(m_free_count > m_max_free){
+        Buffer_chunk *chunk = m_free;
+        m_free = chunk->m_next;
+        chunk->m_next = extra;
+        extra = chunk;
+        --m_free_count;
+        --m_total;
+    }
+    m_lock.unlock();
+
+    while(extra){
+        Buffer_chunk *next = extra->m_next;
+        free(extra);
+        extra = next;
+    }
+}
+
+int Chunk_pool::FreeCount(){
+    m_lock.lock();
+    int count = m_free_count;
+    m_lock.unlock();
+    return count;
+}
+
+int Chunk_pool::TotalCount(){
+    m_lock.lock();
+    int count = m_total;
+    m_lock.unlock();
+    return count;
+}
@@ -0,0 +1,85 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include "../lock/locker.h"
+
+//每个块总大小为一页，头部（连同对齐共16字节）之后全部用于数据
+const int CHUNK_TOTAL_SIZE = 4096;
+const int CHUNK_DATA_SIZE = CHUNK_TOTAL_SIZE - 16;
+
+/*
+struct: Buffer_chunk
+缓冲区块
+@ param m_next: (Buffer_chunk *) 空闲链表中的下一个块
+@ param m_used: (int) 已写入的字节数
+@ param m_data: (char[]) 数据区
+*/
+struct Buffer_chunk
+{
+    Buffer_chunk *m_next;
+    int m_used;
+    char m_data[CHUNK_DATA_SIZE];
+};
+
+/*
+class: Chunk_pool
+缓冲区块池（单例）
+@ function: 连接的输出缓冲区从这里取块、用完归还，避免每个响应都malloc/free；
+            块在工作线程中取出、在主线程发送完后归还，所以使用一把全局锁而不是线程局部缓存，
+            每个块只在取出和归还时各加锁一次
+public:
+@ func: GetInstance() 静态函数
+@ return: (Chunk_pool *)
+
+@ func: Acquire()
+@ return: (Buffer_chunk *) m_used已清零，内存不足时返回NULL
+
+@ func: Release()
+@ param chunk: (Buffer_chunk *) 空闲块超过上限时直接释放
+@ return: 无
+
+@ func: SetMaxFree()
+@ param max_free: (int) 池中最多保留的空闲块数，默认1024（4MB）
+@ return: 无
+
+@ func: FreeCount() / TotalCount()
+@ return: (int) 空闲块数 / 已分配且未释放的块数
+*/
+class Chunk_pool{
+public:
+    static Chunk_pool *GetInstance()
+    {
+        static Chunk_pool instance;
+        return &instance;
+    }
+
+    Buffer_chunk *Acquire();
+
+    void Release(Buffer_chunk *chunk);
+
+    void SetMaxFree(int max_free);
+
+    int FreeCount();
+
+    int TotalCount();
+
+private:
+    Chunk_pool();
+
+    ~Chunk_pool();
+
+    locker m_lock;
+
+    Buffer_chunk *m_free;
+
+    int m_free_count;
+
+    int m_max_free;
+
+    int m_total;
+};
+
+#endif
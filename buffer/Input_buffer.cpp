@@ -0,0 +1,72 @@
+#include "Input_buffer.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "../metrics/Metrics.h"
+
+/*
+@ function: 读到EAGAIN或缓冲区满为止，没有块时先取一个
+@ param: sockfd (int)
+@ return: (bool)
+*/
+bool Input_buffer::Read(int sockfd){
+    if(!m_chunk){
+        m_chunk = Chunk_pool::GetInstance()->Acquire();
+        if(!m_chunk){
+            return false;
+        }
+        METRICS_COUNT("buffer.input_acquire", 1);
+    }
+    while(m_chunk->m_used < CHUNK_DATA_SIZE){
+        int bytes_read = recv(sockfd, m_chunk->m_data + m_chunk->m_used, CHUNK_DATA_SIZE - m_chunk->m_used, 0);
+        if(bytes_read < 0){
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if(bytes_read == 0){
+            return false;
+        }
+        m_chunk->m_used += bytes_read;
+    }
+    return true;
+}
+
+/*
+@ function: 丢弃已处理的前n字节
+@ param: n (int)
+@ return: 无
+*/
+void Input_buffer::Consume(int n){
+    if(!m_chunk || n <= 0){
+        return;
+    }
+    if(n >= m_chunk->m_used){
+        m_chunk->m_used = 0;
+        return;
+    }
+    memmove(m_chunk->m_data, m_chunk->m_data + n, m_chunk->m_used - n);
+    m_chunk->m_used -= n;
+}
+
+/*
+@ function: 空闲时归还块
+@ return: (bool) 是否已经不持有块
+*/
+bool Input_buffer::Release(){
+    if(!m_chunk){
+        return true;
+    }
+    if(m_chunk->m_used > 0){
+        return false;
+    }
+    Chunk_pool::GetInstance()->Release(m_chunk);
+    m_chunk = NULL;
+    METRICS_COUNT("buffer.input_release", 1);
+    return true;
+}
+
+void Input_buffer::Clear(){
+    if(m_chunk){
+        Chunk_pool::GetInstance()->Release(m_chunk);
+        m_chunk = NULL;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef INPUT_BUFFER_H
+#define INPUT_BUFFER_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include "Chunk_pool.h"
+
+/*
+class: Input_buffer
+每个连接一个的读缓冲区
+@ function: 数据放在从Chunk_pool取出的块里，第一次Read()时才取块；
+            没有未处理的数据时可以用Release()把块还给池，连接空闲时只剩下这个对象本身（十几个字节），
+            下一次EPOLLIN再Read()时重新取块。容量为一个块（CHUNK_DATA_SIZE）
+public:
+@ func: Read()
+@ param sockfd: (int) 非阻塞socket
+@ return: (bool) 读到EAGAIN或缓冲区满时返回true；对端关闭、出错或取不到块时返回false
+
+@ func: Data()
+@ return: (char *) 未处理数据的起点，没有持有块时为NULL
+
+@ func: Size()
+@ return: (int) 未处理的字节数
+
+@ func: Consume()
+@ param n: (int) 前n字节已经处理，剩下的移到块的开头
+@ return: 无
+
+@ func: Release()
+@ return: (bool) 没有未处理的数据时归还块并返回true，有数据时不做任何事
+
+@ func: Clear()
+@ function: 丢弃未处理的数据并归还块，关闭连接时调用
+@ return: 无
+
+@ func: Holding()
+@ return: (bool) 当前是否持有块
+*/
+class Input_buffer{
+public:
+    Input_buffer() : m_chunk(NULL) {}
+
+    ~Input_buffer() { Clear(); }
+
+    bool Read(int sockfd);
+
+    char *Data() { return m_chunk ? m_chunk->m_data : NULL; }
+
+    int Size() const { return m_chunk ? m_chunk->m_used : 0; }
+
+    void Consume(int n);
+
+    bool Release();
+
+    void Clear();
+
+    bool Holding() const { return m_chunk != NULL; }
+
+private:
+    Buffer_chunk *m_chunk;
+
+    Input_buffer(const Input_buffer &);
+    Input_buffer &operator=(const Input_buffer &);
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include "Output_buffer.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include "../metrics/Metrics.h"
+
+Output_buffer::Output_buffer(){
+    m_head = 0;
+    m_count = 0;
+    m_pending = 0;
+    m_copied = 0;
+    m_limit = 64 * 1024;
+}
+
+Output_buffer::~Output_buffer(){
+    Clear();
+}
+
+Output_segment *Output_buffer::Push(){
+    if(m_count >= OUTPUT_MAX_SEGMENTS){
+        return NULL;
+    }
+    Output_segment *segment = &At(m_count++);
+    segment->m_type = OUTPUT_REF;
+    segment->m_data = NULL;
+    segment->m_len = 0;
+    segment->m_chunk = NULL;
+    segment->m_fd = -1;
+    segment->m_offset = 0;
+    segment->m_owns_fd = false;
+    return segment;
+}
+
+void Output_buffer::Pop(){
+    Output_segment &segment = At(0);
+    if(segment.m_type == OUTPUT_CHUNK){
+        m_copied -= segment.m_len;
+        Chunk_pool::GetInstance()->Release(segment.m_chunk);
+    }else if(segment.m_type == OUTPUT_FILE && segment.m_owns_fd){
+        close(segment.m_fd);
+    }
+    m_pending -= segment.m_len;
+    m_head = (m_head + 1) % OUTPUT_MAX_SEGMENTS;
+    --m_count;
+}
+
+/*
+@ function: 复制数据，优先写入最后一个块的剩余空间
+@ param: data (const char *)
+@ param: len (long)
+@ return: (bool)
+*/
+bool Output_buffer::Append(const char *data, long len){
+    if(len <= 0){
+        return true;
+    }
+    if(m_copied + len > m_limit){
+        return false;
+    }
+
+    //先确认段数够用，失败时不留下写了一半的数据
+    long room = 0;
+    if(m_count > 0 && At(m_count - 1).m_type == OUTPUT_CHUNK){
+        room = CHUNK_DATA_SIZE - At(m_count - 1).m_chunk->m_used;
+    }
+    long need = len > room ? (len - room + CHUNK_DATA_SIZE - 1) / CHUNK_DATA_SIZE : 0;
+    if(m_count + need > OUTPUT_MAX_SEGMENTS){
+        return false;
+    }
+
+    while(len > 0){
+        Output_segment *segment = m_count > 0 ? &At(m_count - 1) : NULL;
+        if(!segment || segment->m_type != OUTPUT_CHUNK || segment->m_chunk->m_used == CHUNK_DATA_SIZE){
+            Buffer_chunk *chunk = Chunk_pool::GetInstance()->Acquire();
+            if(!chunk){
+                return false;
+            }
+            segment = Push();
+            segment->m_type = OUTPUT_CHUNK;
+            segment->m_chunk = chunk;
+            segment->m_data = chunk->m_data;
+        }
+        Buffer_chunk *chunk = segment->m_chunk;
+        long n = CHUNK_DATA_SIZE - chunk->m_used;
+        if(n > len){
+            n = len;
+        }
+        memcpy(chunk->m_data + chunk->m_used, data, n);
+        chunk->m_used += n;
+        segment->m_len += n;
+        m_pending += n;
+        m_copied += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+@ function: 格式化后复制，放得下时直接写进最后一个块
+@ param: format (const char *)
+@ return: (bool)
+*/
+bool Output_buffer::Printf(const char *format, ...){
+    char buf[1024];
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(buf, sizeof(buf), format, arg_list);
+    va_end(arg_list);
+    if(len < 0){
+        return false;
+    }
+    if(len < (int)sizeof(buf)){
+        return Append(buf, len);
+    }
+
+    //超过栈上缓冲区的长行很少见，临时分配
+    char *large = new char[len + 1];
+    va_start(arg_list, format);
+    vsnprintf(large, len + 1, format, arg_list);
+    va_end(arg_list);
+    bool ret = Append(large, len);
+    delete[] large;
+    return ret;
+}
+
+bool Output_buffer::AppendRef(const void *data, long len){
+    if(len <= 0){
+        return true;
+    }
+    //小数据承诺复制，复制失败（超过m_limit或段数不够）时不能退回引用，否则调用方释放后Flush会读到已释放的内存
+    if(len <= OUTPUT_INLINE_REF){
+        return Append((const char *)data, len);
+    }
+    Output_segment *segment = Push();
+    if(!segment){
+        return false;
+    }
+    segment->m_type = OUTPUT_REF;
+    segment->m_data = (const char *)data;
+    segment->m_len = len;
+    m_pending += len;
+    return true;
+}
+
+bool Output_buffer::AppendFile(int fd, off_t offset, long len, bool owns_fd){
+    if(len <= 0){
+        if(owns_fd){
+            close(fd);
+        }
+        return true;
+    }
+    if(len <= OUTPUT_INLINE_FILE && AppendSmallFile(fd, offset, len)){
+        if(owns_fd){
+            close(fd);
+        }
+        return true;
+    }
+    Output_segment *segment = Push();
+    if(!segment){
+        return false;
+    }
+    segment->m_type = OUTPUT_FILE;
+    segment->m_fd = fd;
+    segment->m_offset = offset;
+    segment->m_len = len;
+    segment->m_owns_fd = owns_fd;
+    m_pending += len;
+    return true;
+}
+
+/*
+@ function: 把小文件直接读进最后一个块的剩余空间，放不下时读进一个新块
+@ param: fd (int)
+@ param: offset (off_t)
+@ param: len (long) 不超过CHUNK_DATA_SIZE
+@ return: (bool) 失败时缓冲区内容不变，由调用方改用sendfile
+*/
+bool Output_buffer::AppendSmallFile(int fd, off_t offset, long len){
+    if(m_copied + len > m_limit){
+        return false;
+    }
+    Output_segment *tail = m_count > 0 ? &At(m_count - 1) : NULL;
+    Buffer_chunk *chunk = NULL;
+    bool fresh = false;
+    if(tail && tail->m_type == OUTPUT_CHUNK && CHUNK_DATA_SIZE - tail->m_chunk->m_used >= len){
+        chunk = tail->m_chunk;
+    }else{
+        if(m_count >= OUTPUT_MAX_SEGMENTS){
+            return false;
+        }
+        chunk = Chunk_pool::GetInstance()->Acquire();
+        if(!chunk){
+            return false;
+        }
+        fresh = true;
+    }
+
+    long got = 0;
+    while(got < len){
+        ssize_t n = pread(fd, chunk->m_data + chunk->m_used + got, len - got, offset + got);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            if(fresh){
+                Chunk_pool::GetInstance()->Release(chunk);
+            }
+            return false;
+        }
+        got += n;
+    }
+
+    if(fresh){
+        tail = Push();
+        tail->m_type = OUTPUT_CHUNK;
+        tail->m_chunk = chunk;
+        tail->m_data = chunk->m_data;
+    }
+    chunk->m_used += len;
+    tail->m_len += len;
+    m_pending += len;
+    m_copied += len;
+    return true;
+}
+
+/*
+@ function: 已发送n字节，依次推进各内存段
+@ param: n (long)
+@ return: 无
+*/
+void Output_buffer::Consume(long n){
+    while(n > 0 && m_count > 0){
+        Output_segment &segment = At(0);
+        if(n >= segment.m_len){
+            n -= segment.m_len;
+            Pop();
+            continue;
+        }
+        segment.m_data += n;
+        segment.m_len -= n;
+        m_pending -= n;
+        if(segment.m_type == OUTPUT_CHUNK){
+            m_copied -= n;
+        }
+        n = 0;
+    }
+}
+
+/*
+@ function: 用sendfile发送文件段，内核直接从页缓存拷到socket
+@ param: sockfd (int)
+@ param: segment (Output_segment &)
+@ return: (int) OUTPUT_STATUS
+*/
+int Output_buffer::FlushFile(int sockfd, Output_segment &segment){
+    while(segment.m_len > 0){
+        ssize_t n = sendfile(sockfd, segment.m_fd, &segment.m_offset, (size_t)segment.m_len);
+        METRICS_COUNT("output.sendfile", 1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                METRICS_COUNT("output.eagain", 1);
+                return OUTPUT_AGAIN;
+            }
+            return OUTPUT_ERROR;
+        }
+        //文件在发送过程中被截断
+        if(n == 0){
+            return OUTPUT_ERROR;
+        }
+        segment.m_len -= n;
+        m_pending -= n;
+    }
+    Pop();
+    return OUTPUT_DONE;
+}
+
+/*
+@ function: 发送所有段，EAGAIN时保留进度返回
+@ param: sockfd (int)
+@ return: (int) OUTPUT_STATUS
+连续的内存段合并为一次sendmsg（等价于writev，另外带MSG_NOSIGNAL）；
+后面紧跟文件段时带MSG_MORE，响应头和文件开头可以合并进同一个报文
+*/
+int Output_buffer::Flush(int sockfd){
+    struct iovec iov[OUTPUT_MAX_SEGMENTS];
+    while(m_count > 0){
+        if(At(0).m_type == OUTPUT_FILE){
+            int ret = FlushFile(sockfd, At(0));
+            if(ret != OUTPUT_DONE){
+                return ret;
+            }
+            continue;
+        }
+
+        int iovcnt = 0;
+        while(iovcnt < m_count && At(iovcnt).m_type != OUTPUT_FILE){
+            iov[iovcnt].iov_base = (void *)At(iovcnt).m_data;
+            iov[iovcnt].iov_len = At(iovcnt).m_len;
+            ++iovcnt;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        int flags = MSG_NOSIGNAL | (iovcnt < m_count ? MSG_MORE : 0);
+
+        ssize_t n = sendmsg(sockfd, &msg, flags);
+        METRICS_COUNT("output.writev", 1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                METRICS_COUNT("output.eagain", 1);
+                return OUTPUT_AGAIN;
+            }
+            return OUTPUT_ERROR;
+        }
+        Consume(n);
+    }
+    return OUTPUT_DONE;
+}
+
+void Output_buffer::Clear(){
+    while(m_count > 0){
+        Pop();
+    }
+    m_head = 0;
+}
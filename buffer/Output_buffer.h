@@ -0,0 +1,161 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <stdarg.h>
+#include <sys/types.h>
+#include "Chunk_pool.h"
+
+//每个连接最多排队的段数，也是一次sendmsg的iovec上限
+const int OUTPUT_MAX_SEGMENTS = 16;
+
+//不超过该长度的引用直接复制进块：多一个iovec的内核开销比复制这点数据更大
+const long OUTPUT_INLINE_REF = 2048;
+
+//不超过一个块的文件用pread直接读进块，和响应头一次发出，小文件sendfile反而更慢
+const long OUTPUT_INLINE_FILE = CHUNK_DATA_SIZE;
+
+//段类型
+enum OUTPUT_SEGMENT_TYPE
+{
+    OUTPUT_CHUNK = 0, //复制进池化块的数据，例如响应头
+    OUTPUT_REF,       //调用方持有的内存，发送前不得释放，例如mmap的文件或静态字符串
+    OUTPUT_FILE       //文件区间，用sendfile发送
+};
+
+//Flush()的结果
+enum OUTPUT_STATUS
+{
+    OUTPUT_DONE = 0, //全部发送完毕
+    OUTPUT_AGAIN,    //socket发送缓冲区满，等EPOLLOUT后再次调用Flush()
+    OUTPUT_ERROR     //对端关闭或其他错误，应关闭连接
+};
+
+/*
+struct: Output_segment
+一段待发送的数据
+@ param m_type: (int) OUTPUT_SEGMENT_TYPE
+@ param m_data: (const char *) 内存段尚未发送部分的起点
+@ param m_len: (long) 尚未发送的字节数
+@ param m_chunk: (Buffer_chunk *) OUTPUT_CHUNK段所在的块，发送完后归还
+@ param m_fd / m_offset: 文件段的描述符和下一次发送的偏移
+@ param m_owns_fd: (bool) 发送完或清空时是否关闭m_fd
+*/
+struct Output_segment
+{
+    int m_type;
+    const char *m_data;
+    long m_len;
+    Buffer_chunk *m_chunk;
+    int m_fd;
+    off_t m_offset;
+    bool m_owns_fd;
+};
+
+/*
+class: Output_buffer
+每个连接一个的输出缓冲区
+@ function: 响应由若干段组成：响应头等小数据复制进池化的块，正文可以引用调用方的内存或文件区间，不再整体拷贝；
+            Flush()把连续的内存段收集成iovec一次sendmsg发出，遇到文件段用sendfile，
+            EAGAIN时记下每段已发送的位置直接返回，下次从断点继续，不做任何拷贝；
+            复制的数据总量受SetLimit()限制，超出时追加失败，调用方按响应过大处理
+public:
+@ func: Append()
+@ param data: (const char *) 数据，复制进块
+@ param len: (long)
+@ return: (bool) 超出段数或复制上限时返回false，缓冲区内容不变
+
+@ func: Printf()
+@ param format: (const char *) 格式化后复制进块，用于拼响应头
+@ return: (bool)
+
+@ func: AppendRef()
+@ param data: (const void *) 不复制，发送完成前调用方必须保证内存有效；
+                             不超过OUTPUT_INLINE_REF的数据会复制，调用方可以立即释放
+@ param len: (long)
+@ return: (bool) 段数不够，或不超过OUTPUT_INLINE_REF而复制量超过上限时返回false，此时没有保留对data的引用
+
+@ func: AppendFile()
+@ param fd: (int) 打开的文件
+@ param offset: (off_t) 起始偏移
+@ param len: (long) 字节数
+@ param owns_fd: (bool) 为true时发送完或Clear()时关闭fd
+@ return: (bool)
+不超过OUTPUT_INLINE_FILE的区间在这里读进块，owns_fd时随即关闭
+
+@ func: Flush()
+@ param sockfd: (int) 非阻塞socket
+@ return: (int) OUTPUT_STATUS
+
+@ func: Clear()
+@ function: 丢弃未发送的数据，归还所有块，关闭持有的文件
+@ return: 无
+
+@ func: Pending()
+@ return: (long) 尚未发送的字节数
+
+@ func: Empty()
+@ return: (bool) 没有待发送的段
+
+@ func: SetLimit()
+@ param limit: (long) 复制进块的字节上限，默认64KB
+@ return: 无
+*/
+class Output_buffer{
+public:
+    Output_buffer();
+
+    ~Output_buffer();
+
+    bool Append(const char *data, long len);
+
+    bool Printf(const char *format, ...);
+
+    bool AppendRef(const void *data, long len);
+
+    bool AppendFile(int fd, off_t offset, long len, bool owns_fd);
+
+    int Flush(int sockfd);
+
+    void Clear();
+
+    long Pending() const { return m_pending; }
+
+    bool Empty() const { return m_count == 0; }
+
+    void SetLimit(long limit) { m_limit = limit; }
+
+private:
+    //第i个排队的段
+    Output_segment &At(int i) { return m_segments[(m_head + i) % OUTPUT_MAX_SEGMENTS]; }
+
+    //在队尾追加一段，段数已满时返回NULL
+    Output_segment *Push();
+
+    //弹出队首段，归还块或关闭文件
+    void Pop();
+
+    //已发送n字节，推进各段的位置
+    void Consume(long n);
+
+    int FlushFile(int sockfd, Output_segment &segment);
+
+    bool AppendSmallFile(int fd, off_t offset, long len);
+
+    Output_segment m_segments[OUTPUT_MAX_SEGMENTS];
+
+    int m_head;
+
+    int m_count;
+
+    long m_pending;
+
+    //当前复制进块、尚未发送的字节数
+    long m_copied;
+
+    long m_limit;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "Conn_Table.h"
+#include <stddef.h>
+#include "../metrics/Metrics.h"
+
+Conn_table::Conn_table(){
+    m_capacity = 0;
+    m_count = 0;
+    m_fd = NULL;
+    m_deadline = NULL;
+    m_state = NULL;
+    m_generation = NULL;
+    m_free = NULL;
+    m_free_head = 0;
+    m_free_count = 0;
+    m_by_fd = NULL;
+}
+
+Conn_table::~Conn_table(){
+    delete[] m_fd;
+    delete[] m_deadline;
+    delete[] m_state;
+    delete[] m_generation;
+    delete[] m_free;
+    delete[] m_by_fd;
+}
+
+/*
+@ function: 分配各字段数组，所有槽位空闲
+@ param: capacity (int)
+@ return: (bool)
+*/
+bool Conn_table::Init(int capacity){
+    if(m_capacity > 0 || capacity <= 0 || capacity > CONN_MAX_SLOTS){
+        return false;
+    }
+    m_capacity = capacity;
+    m_fd = new int[capacity];
+    m_deadline = new time_t[capacity];
+    m_state = new uint8_t[capacity];
+    m_generation = new uint16_t[capacity];
+    m_free = new int[capacity];
+    m_by_fd = new int[CONN_MAX_SLOTS];
+    for(int i = 0; i < capacity; ++i){
+        m_fd[i] = -1;
+        m_deadline[i] = 0;
+        m_state[i] = CONN_FREE;
+        //代数从1开始，句柄0永远无效
+        m_generation[i] = 1;
+        m_free[i] = i;
+    }
+    for(int i = 0; i < CONN_MAX_SLOTS; ++i){
+        m_by_fd[i] = -1;
+    }
+    m_free_head = 0;
+    m_free_count = capacity;
+    return true;
+}
+
+/*
+@ function: 从空闲队列头部取一个槽位
+@ param: fd (int)
+@ param: deadline (time_t)
+@ return: (Conn_handle)
+*/
+Conn_handle Conn_table::Open(int fd, time_t deadline){
+    if(m_free_count == 0 || fd < 0 || fd >= CONN_MAX_SLOTS){
+        return 0;
+    }
+    int index = m_free[m_free_head];
+    m_free_head = (m_free_head + 1) % m_capacity;
+    --m_free_count;
+    ++m_count;
+
+    m_fd[index] = fd;
+    m_deadline[index] = deadline;
+    m_state[index] = CONN_ACTIVE;
+    m_by_fd[fd] = index;
+    METRICS_GAUGE_SET("conn.open", m_count);
+    return MakeHandle(index);
+}
+
+/*
+@ function: 关闭连接，槽位放回空闲队列尾部
+@ param: handle (Conn_handle)
+@ return: (bool)
+*/
+bool Conn_table::Close(Conn_handle handle){
+    if(!Valid(handle)){
+        METRICS_COUNT("conn.stale", 1);
+        return false;
+    }
+    int index = Index(handle);
+    if(m_by_fd[m_fd[index]] == index){
+        m_by_fd[m_fd[index]] = -1;
+    }
+    m_fd[index] = -1;
+    m_deadline[index] = 0;
+    m_state[index] = CONN_FREE;
+    uint16_t generation = m_generation[index] + 1;
+    __atomic_store_n(&m_generation[index], generation ? generation : (uint16_t)1, __ATOMIC_RELEASE);
+
+    m_free[(m_free_head + m_free_count) % m_capacity] = index;
+    ++m_free_count;
+    --m_count;
+    METRICS_GAUGE_SET("conn.open", m_count);
+    return true;
+}
+
+/*
+@ function: 按fd查找连接
+@ param: fd (int)
+@ return: (Conn_handle)
+*/
+Conn_handle Conn_table::Find(int fd) const{
+    if(fd < 0 || fd >= CONN_MAX_SLOTS || m_by_fd[fd] < 0){
+        return 0;
+    }
+    return MakeHandle(m_by_fd[fd]);
+}
+
+bool Conn_table::SetDeadline(Conn_handle handle, time_t deadline){
+    if(!Valid(handle)){
+        return false;
+    }
+    m_deadline[Index(handle)] = deadline;
+    return true;
+}
+
+bool Conn_table::SetState(Conn_handle handle, int state){
+    if(!Valid(handle) || state == CONN_FREE){
+        return false;
+    }
+    m_state[Index(handle)] = (uint8_t)state;
+    return true;
+}
+
+/*
+@ function: 顺序扫描到期时间数组
+@ param: now (time_t)
+@ param: out (std::vector<Conn_handle> &)
+@ return: (int)
+只读一个连续数组，不碰连接对象
+*/
+int Conn_table::Expired(time_t now, std::vector<Conn_handle> &out) const{
+    int count = 0;
+    for(int i = 0; i < m_capacity; ++i){
+        time_t deadline = m_deadline[i];
+        if(deadline != 0 && deadline <= now){
+            out.push_back(MakeHandle(i));
+            ++count;
+        }
+    }
+    return count;
+}
+
+/*
+@ function: 按状态统计连接数
+@ param: counts (long *)
+@ return: 无
+*/
+void Conn_table::CountStates(long *counts) const{
+    for(int i = 0; i < m_capacity; ++i){
+        ++counts[m_state[i]];
+    }
+}
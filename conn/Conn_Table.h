@@ -0,0 +1,163 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+/*
+@ type Conn_handle: 连接句柄，低CONN_INDEX_BITS位是槽位下标，高位是槽位的代数；0不是有效句柄
+*/
+typedef uint32_t Conn_handle;
+
+const int CONN_INDEX_BITS = 16;
+
+//最多的槽位数，与UTILS_MAX_FD相同
+const int CONN_MAX_SLOTS = 1 << CONN_INDEX_BITS;
+
+//连接状态，只由所属线程修改
+enum CONN_STATE
+{
+    CONN_FREE = 0, //空闲槽位
+    CONN_ACTIVE,   //等待或正在读写
+    CONN_QUEUED,   //已交给线程池
+    CONN_PARKED    //空闲，读写缓冲区已归还
+};
+
+/*
+class: Conn_table
+连接表
+@ function: 热字段（fd、到期时间、状态、代数）按字段分别存成数组，下标就是槽位号，
+            调用方的冷数据（连接对象）也按槽位号存放；定时器和线程池持有32位句柄而不是裸指针。
+            槽位关闭时代数加一，持有旧句柄的一方在使用前做一次比较就能发现连接已经换了人，
+            不会再像按fd号索引那样把过期的请求作用到复用了同一个fd的新连接上。
+            空闲槽位按FIFO复用，同一个槽位要在其余空闲槽位都用过之后才会再次分配，
+            旧句柄即使在检查之后才失效，撞上新连接的窗口也很小；代数16位，同一槽位复用65535次后才会回绕。
+            Open / Close / Set* 只在所属线程（主线程或事件循环）调用，Valid()可以在任意线程调用
+public:
+@ func: Init()
+@ param capacity: (int) 槽位数，不超过CONN_MAX_SLOTS
+@ return: (bool)
+
+@ func: Open()
+@ param fd: (int)
+@ param deadline: (time_t) 到期时间，0表示没有
+@ return: (Conn_handle) 槽位已满或fd不小于CONN_MAX_SLOTS时返回0
+
+@ func: Close()
+@ param handle: (Conn_handle)
+@ return: (bool) 句柄已经失效时返回false
+@ function: 代数加一并归还槽位，之后该句柄的所有操作都会失败
+
+@ func: Valid()
+@ param handle: (Conn_handle)
+@ return: (bool) 槽位仍然属于这个句柄
+
+@ func: Find()
+@ param fd: (int)
+@ return: (Conn_handle) fd当前对应的连接，没有时返回0
+
+@ func: Fd() / Deadline() / State()
+@ param handle: (Conn_handle)
+@ return: 句柄失效时分别返回-1 / 0 / CONN_FREE
+
+@ func: SetDeadline() / SetState()
+@ param handle: (Conn_handle)
+@ return: (bool) 句柄失效时返回false
+
+@ func: Index() 静态函数
+@ param handle: (Conn_handle)
+@ return: (int) 槽位下标，用于索引调用方的冷数据
+
+@ func: Expired()
+@ param now: (time_t)
+@ param out: (std::vector<Conn_handle> &) 追加到期连接的句柄
+@ return: (int) 到期的连接数
+@ function: 顺序扫描到期时间数组，空闲槽位的到期时间为0
+
+@ func: CountStates()
+@ param counts: (long *) 长度至少为CONN_PARKED+1，按状态累计连接数
+@ return: 无
+
+@ func: Count() / Capacity()
+@ return: (int) 已打开的连接数 / 槽位数
+*/
+class Conn_table{
+public:
+    Conn_table();
+
+    ~Conn_table();
+
+    bool Init(int capacity);
+
+    Conn_handle Open(int fd, time_t deadline);
+
+    bool Close(Conn_handle handle);
+
+    bool Valid(Conn_handle handle) const
+    {
+        int index = Index(handle);
+        //空闲槽位的当前代数还没有发出过句柄，只比较代数就够了
+        return index < m_capacity &&
+               __atomic_load_n(&m_generation[index], __ATOMIC_ACQUIRE) == (uint16_t)(handle >> CONN_INDEX_BITS);
+    }
+
+    Conn_handle Find(int fd) const;
+
+    int Fd(Conn_handle handle) const { return Valid(handle) ? m_fd[Index(handle)] : -1; }
+
+    time_t Deadline(Conn_handle handle) const { return Valid(handle) ? m_deadline[Index(handle)] : 0; }
+
+    int State(Conn_handle handle) const { return Valid(handle) ? m_state[Index(handle)] : (int)CONN_FREE; }
+
+    bool SetDeadline(Conn_handle handle, time_t deadline);
+
+    bool SetState(Conn_handle handle, int state);
+
+    static int Index(Conn_handle handle) { return (int)(handle & (CONN_MAX_SLOTS - 1)); }
+
+    int Expired(time_t now, std::vector<Conn_handle> &out) const;
+
+    void CountStates(long *counts) const;
+
+    int Count() const { return m_count; }
+
+    int Capacity() const { return m_capacity; }
+
+private:
+    Conn_handle MakeHandle(int index) const
+    {
+        return ((Conn_handle)m_generation[index] << CONN_INDEX_BITS) | (Conn_handle)index;
+    }
+
+    int m_capacity;
+
+    int m_count;
+
+    //热字段，每个数组按槽位下标索引
+    int *m_fd;
+
+    time_t *m_deadline;
+
+    uint8_t *m_state;
+
+    uint16_t *m_generation;
+
+    //空闲槽位的环形队列
+    int *m_free;
+
+    int m_free_head;
+
+    int m_free_count;
+
+    //fd到槽位的映射，epoll事件只带fd；-1表示没有
+    int *m_by_fd;
+
+    Conn_table(const Conn_table &);
+    Conn_table &operator=(const Conn_table &);
+};
+
+#endif
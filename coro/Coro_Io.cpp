@@ -0,0 +1,130 @@
+#include "Coro_Io.h"
+#ifdef CORO_ENABLED
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include "../metrics/Metrics.h"
+
+//每次epoll_wait最多取出的事件数
+static const int CORO_IO_EVENTS = 256;
+
+Coro_io::Coro_io(){
+    m_epollfd = -1;
+    m_wakeupfd = -1;
+    m_stop = false;
+    m_started = false;
+    m_executor.context = NULL;
+    m_executor.post = NULL;
+}
+
+Coro_io::~Coro_io(){
+    Stop();
+}
+
+/*
+@ function: 创建epoll和eventfd并启动线程
+@ param: executor (Coro_executor)
+@ return: (bool)
+*/
+bool Coro_io::Start(Coro_executor executor){
+    if(m_started || !executor.post){
+        return false;
+    }
+    m_executor = executor;
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_epollfd < 0 || m_wakeupfd < 0){
+        Stop();
+        return false;
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeupfd, &event);
+
+    m_stop = false;
+    if(pthread_create(&m_thread, NULL, Worker, this) != 0){
+        Stop();
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void Coro_io::Stop(){
+    if(m_started){
+        m_stop = true;
+        uint64_t one = 1;
+        ssize_t ret = write(m_wakeupfd, &one, sizeof(one));
+        (void)ret;
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+    if(m_epollfd >= 0){
+        close(m_epollfd);
+    }
+    if(m_wakeupfd >= 0){
+        close(m_wakeupfd);
+    }
+    m_epollfd = -1;
+    m_wakeupfd = -1;
+}
+
+/*
+@ function: 以EPOLLONESHOT注册fd，先MOD（fd已经等待过），失败再ADD
+@ param: awaiter (Io_awaiter *)
+@ param: address (void *) 协程地址
+@ return: (bool) true表示协程已挂起
+*/
+bool Coro_io::Arm(Io_awaiter *awaiter, void *address){
+    epoll_event event;
+    event.events = awaiter->m_events | EPOLLONESHOT | EPOLLRDHUP;
+    event.data.ptr = awaiter;
+    int fd = awaiter->m_fd;
+    //由Coro_io线程读取，先读完awaiter的其他字段再显式发布，不依赖epoll_ctl在内核里的同步
+    __atomic_store_n(&awaiter->m_address, address, __ATOMIC_RELEASE);
+    if(epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event) == 0){
+        //注册之后协程可能已经在其他线程上恢复，不能再访问awaiter
+        METRICS_COUNT("coro.io_wait", 1);
+        return true;
+    }
+    if(errno == ENOENT && epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) == 0){
+        METRICS_COUNT("coro.io_wait", 1);
+        return true;
+    }
+    awaiter->m_events = EPOLLERR;
+    return false;
+}
+
+void *Coro_io::Worker(void *arg){
+    ((Coro_io *)arg)->Run();
+    return NULL;
+}
+
+void Coro_io::Run(){
+    epoll_event events[CORO_IO_EVENTS];
+    while(!m_stop){
+        int number = epoll_wait(m_epollfd, events, CORO_IO_EVENTS, -1);
+        if(number < 0 && errno != EINTR){
+            break;
+        }
+        for(int i = 0; i < number; ++i){
+            Io_awaiter *awaiter = (Io_awaiter *)events[i].data.ptr;
+            if(!awaiter){
+                uint64_t count;
+                ssize_t ret = read(m_wakeupfd, &count, sizeof(count));
+                (void)ret;
+                continue;
+            }
+            void *address = __atomic_load_n(&awaiter->m_address, __ATOMIC_ACQUIRE);
+            awaiter->m_events = events[i].events;
+            //执行器已经停止时在本线程恢复，协程可能持有连接池租约
+            if(!m_executor.Post(Coro_resume, address)){
+                METRICS_COUNT("coro.resume_inline", 1);
+                Coro_resume(address);
+            }
+        }
+    }
+}
+
+#endif
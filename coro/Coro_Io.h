@@ -0,0 +1,95 @@
+#ifndef CORO_IO_H
+#define CORO_IO_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include "Coro_Task.h"
+#ifdef CORO_ENABLED
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+/*
+class: Coro_io
+可等待的socket就绪
+@ function: 一个独立线程上的epoll，co_await Readable(fd) / Writable(fd)把fd以EPOLLONESHOT注册后挂起协程，
+            就绪时经执行器在工作线程上恢复，工作线程不阻塞在数据库或后端socket上。
+            fd必须是非阻塞的；恢复后返回的事件中有EPOLLERR / EPOLLHUP时应当按出错处理。
+            fd第一次等待时加入epoll，之后只重新启用，关闭fd时epoll自动删除，不需要通知Coro_io
+public:
+@ func: Start()
+@ param executor: (Coro_executor) 恢复协程的执行器。线程不检查执行器是否还存在，
+                  执行器对象（threadpool）必须在Stop()返回之后才能销毁
+@ return: (bool)
+
+@ func: Stop()
+@ function: 通过eventfd唤醒线程并等待退出，仍在等待的协程不会再恢复；
+            之后的Readable() / Writable()都注册失败，调用前应先等协程结束（Coro_task::InFlight()）。
+            执行器已经停止时就绪的协程在Coro_io线程上直接恢复，因此顺序是
+            Coro_io::Stop() → threadpool::shutdown() → delete threadpool，析构函数也会调用Stop()
+@ return: 无
+
+@ func: Readable() / Writable()
+@ param fd: (int)
+@ return: (Io_awaiter) co_await得到就绪的事件（uint32_t），注册失败时不挂起，返回EPOLLERR
+*/
+class Coro_io{
+public:
+    class Io_awaiter{
+    public:
+        Io_awaiter(Coro_io *io, int fd, uint32_t events) : m_io(io), m_fd(fd), m_events(events), m_address(NULL) {}
+
+        bool await_ready() { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) { return m_io->Arm(this, handle.address()); }
+
+        uint32_t await_resume() { return m_events; }
+
+    private:
+        friend class Coro_io;
+
+        Coro_io *m_io;
+        int m_fd;
+        uint32_t m_events;
+        void *m_address;
+    };
+
+    Coro_io();
+
+    ~Coro_io();
+
+    bool Start(Coro_executor executor);
+
+    void Stop();
+
+    Io_awaiter Readable(int fd) { return Io_awaiter(this, fd, EPOLLIN); }
+
+    Io_awaiter Writable(int fd) { return Io_awaiter(this, fd, EPOLLOUT); }
+
+private:
+    static void *Worker(void *arg);
+
+    void Run();
+
+    bool Arm(Io_awaiter *awaiter, void *address);
+
+    int m_epollfd;
+
+    int m_wakeupfd;
+
+    volatile bool m_stop;
+
+    bool m_started;
+
+    pthread_t m_thread;
+
+    Coro_executor m_executor;
+
+    Coro_io(const Coro_io &);
+    Coro_io &operator=(const Coro_io &);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include "Coro_Pool.h"
+#ifdef CORO_ENABLED
+#include "../metrics/Metrics.h"
+
+Coro_conn_pool::Coro_conn_pool(){
+    m_pool = NULL;
+    m_executor.context = NULL;
+    m_executor.post = NULL;
+    m_head = NULL;
+    m_tail = NULL;
+    m_waiting = 0;
+    LOCK_NAME(m_lock, "coro.conn_pool");
+}
+
+/*
+@ function: 设置连接池和执行器，所有槽位空闲
+@ param: pool (connection_pool *)
+@ param: max_conn (int)
+@ param: executor (Coro_executor)
+@ return: (bool)
+*/
+bool Coro_conn_pool::Init(connection_pool *pool, int max_conn, Coro_executor executor){
+    if(!pool || max_conn <= 0 || !executor.post){
+        return false;
+    }
+    m_pool = pool;
+    m_executor = executor;
+    m_free_slots.clear();
+    for(int i = max_conn - 1; i >= 0; --i){
+        m_free_slots.push_back(i);
+    }
+    return true;
+}
+
+bool Coro_conn_pool::TakeSlot(Coro_lease *lease){
+    if(m_free_slots.empty()){
+        return false;
+    }
+    lease->slot = m_free_slots.back();
+    m_free_slots.pop_back();
+    return true;
+}
+
+/*
+@ function: 不挂起地尝试借一个连接
+@ param: lease (Coro_lease *)
+@ return: (bool)
+*/
+bool Coro_conn_pool::TryAcquire(Coro_lease *lease){
+    m_lock.lock();
+    bool taken = TakeSlot(lease);
+    m_lock.unlock();
+    if(!taken){
+        return false;
+    }
+    //借出数不超过MaxConn，这里不会阻塞
+    lease->mysql = m_pool->GetConnection();
+    METRICS_COUNT("coro.lease", 1);
+    return true;
+}
+
+/*
+@ function: 加锁后再试一次，仍没有空闲连接时把协程排到等待队列尾部
+@ param: awaiter (Lease_awaiter *)
+@ return: (bool) true表示协程已挂起
+*/
+bool Coro_conn_pool::Wait(Lease_awaiter *awaiter){
+    m_lock.lock();
+    if(TakeSlot(&awaiter->m_lease)){
+        m_lock.unlock();
+        awaiter->m_lease.mysql = m_pool->GetConnection();
+        METRICS_COUNT("coro.lease", 1);
+        return false;
+    }
+    awaiter->m_next = NULL;
+    if(m_tail){
+        m_tail->m_next = awaiter;
+    }else{
+        m_head = awaiter;
+    }
+    m_tail = awaiter;
+    ++m_waiting;
+    m_lock.unlock();
+    //解锁之后协程可能已经在其他线程上恢复，不能再访问awaiter
+    METRICS_COUNT("coro.lease_wait", 1);
+    return true;
+}
+
+/*
+@ function: 归还连接，有协程在等时直接转交
+@ param: lease (const Coro_lease &)
+@ return: 无
+执行器已停止（threadpool::shutdown之后）时，等待的协程在调用线程上恢复
+*/
+void Coro_conn_pool::Release(const Coro_lease &lease){
+    m_lock.lock();
+    Lease_awaiter *awaiter = PopWaiter();
+    if(awaiter){
+        awaiter->m_lease = lease;
+        m_lock.unlock();
+        Resume(awaiter);
+        return;
+    }
+    m_lock.unlock();
+
+    //先归还connection_pool再放回槽位：槽位一旦可见就可能被TryAcquire取走并GetConnection()，
+    //此时连接必须已经在池中，否则工作线程会阻塞在connection_pool的条件变量上
+    m_pool->ReleaseConnection(lease.mysql);
+    m_lock.lock();
+    awaiter = PopWaiter();
+    if(!awaiter){
+        m_free_slots.push_back(lease.slot);
+        m_lock.unlock();
+        return;
+    }
+    //解锁期间有协程排进了等待队列，槽位直接交给它；槽位没有放回，借出数不变，GetConnection()不会阻塞
+    m_lock.unlock();
+    awaiter->m_lease.slot = lease.slot;
+    awaiter->m_lease.mysql = m_pool->GetConnection();
+    Resume(awaiter);
+}
+
+//调用时必须持有m_lock
+Coro_conn_pool::Lease_awaiter *Coro_conn_pool::PopWaiter(){
+    Lease_awaiter *awaiter = m_head;
+    if(!awaiter){
+        return NULL;
+    }
+    m_head = awaiter->m_next;
+    if(!m_head){
+        m_tail = NULL;
+    }
+    --m_waiting;
+    return awaiter;
+}
+
+/*
+@ function: 经执行器恢复拿到租约的协程
+@ param: awaiter (Lease_awaiter *)
+@ return: 无
+*/
+void Coro_conn_pool::Resume(Lease_awaiter *awaiter){
+    METRICS_COUNT("coro.lease", 1);
+    //执行器已经停止时在当前线程恢复，租约已经转交给这个协程，不恢复它连接就永远不会归还；
+    //它用完后再Release()时可能又恢复下一个等待者，递归深度不超过等待的协程数
+    if(!m_executor.Post(Coro_resume, awaiter->m_handle.address())){
+        METRICS_COUNT("coro.resume_inline", 1);
+        Coro_resume(awaiter->m_handle.address());
+    }
+}
+
+#endif
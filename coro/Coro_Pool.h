@@ -0,0 +1,121 @@
+#ifndef CORO_POOL_H
+#define CORO_POOL_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include "Coro_Task.h"
+#ifdef CORO_ENABLED
+#include <vector>
+#include "../lock/lock_profile.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+/*
+struct: Coro_lease
+一次连接租约
+@ param mysql: (MYSQL *) 数据库连接
+@ param slot: (int) 租约槽位，0 ~ max_conn-1，同一时刻持有的租约槽位各不相同，
+              可以用来索引每个连接附带的状态（例如替身数据库的socket）
+*/
+struct Coro_lease
+{
+    MYSQL *mysql;
+    int slot;
+};
+
+/*
+class: Coro_conn_pool
+可等待的数据库连接池租约
+@ function: 包装connection_pool，最多同时借出max_conn个连接；没有空闲连接时co_await Acquire()
+            挂起协程而不是像connectionRAII那样阻塞工作线程。Release()时若有协程在等，
+            连接直接转交给队首的协程并经执行器恢复它，不归还connection_pool；
+            借出数不超过connection_pool的MaxConn时GetConnection()不会阻塞，
+            因此同一个connection_pool不要再同时被其他地方同步使用
+public:
+@ func: Init()
+@ param pool: (connection_pool *)
+@ param max_conn: (int) 最多借出的连接数，不超过pool的MaxConn
+@ param executor: (Coro_executor) 恢复等待协程的执行器，停止后在Release()的线程上恢复；执行器对象要比最后一次Release()活得久
+@ return: (bool)
+
+@ func: Acquire()
+@ return: (Lease_awaiter) co_await得到Coro_lease
+
+@ func: Release()
+@ param lease: (const Coro_lease &) 协程用完连接后调用，同一个租约只能归还一次
+@ return: 无
+
+@ func: Waiting()
+@ return: (int) 正在等待连接的协程数
+*/
+class Coro_conn_pool{
+public:
+    class Lease_awaiter{
+    public:
+        explicit Lease_awaiter(Coro_conn_pool *pool) : m_pool(pool), m_next(NULL) {}
+
+        bool await_ready() { return m_pool->TryAcquire(&m_lease); }
+
+        //返回false表示加锁后已经拿到连接，不挂起
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            m_handle = handle;
+            return m_pool->Wait(this);
+        }
+
+        Coro_lease await_resume() { return m_lease; }
+
+    private:
+        friend class Coro_conn_pool;
+
+        Coro_conn_pool *m_pool;
+        Lease_awaiter *m_next;
+        std::coroutine_handle<> m_handle;
+        Coro_lease m_lease;
+    };
+
+    Coro_conn_pool();
+
+    bool Init(connection_pool *pool, int max_conn, Coro_executor executor);
+
+    Lease_awaiter Acquire() { return Lease_awaiter(this); }
+
+    void Release(const Coro_lease &lease);
+
+    int Waiting() const { return m_waiting; }
+
+private:
+    bool TryAcquire(Coro_lease *lease);
+
+    bool Wait(Lease_awaiter *awaiter);
+
+    //调用时必须持有m_lock，有空闲槽位时取一个
+    bool TakeSlot(Coro_lease *lease);
+
+    //调用时必须持有m_lock，取出等待队列的队首
+    Lease_awaiter *PopWaiter();
+
+    void Resume(Lease_awaiter *awaiter);
+
+    connection_pool *m_pool;
+
+    Coro_executor m_executor;
+
+    Profiled_locker m_lock;
+
+    std::vector<int> m_free_slots;
+
+    //等待连接的协程，FIFO
+    Lease_awaiter *m_head;
+
+    Lease_awaiter *m_tail;
+
+    int m_waiting;
+
+    Coro_conn_pool(const Coro_conn_pool &);
+    Coro_conn_pool &operator=(const Coro_conn_pool &);
+};
+
+#endif
+
+#endif
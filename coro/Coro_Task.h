@@ -0,0 +1,87 @@
+#ifndef CORO_TASK_H
+#define CORO_TASK_H
+/*
+头文件定义
+@function: 使用到的头文件
+编译器支持C++20协程（g++ 11及以上加-std=c++20）时定义CORO_ENABLED，
+否则只保留Coro_executor，threadpool等C++14代码照常编译
+*/
+#include <stddef.h>
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CORO_ENABLED 1
+#endif
+#endif
+
+#ifdef CORO_ENABLED
+#include <coroutine>
+#include <exception>
+#endif
+
+/*
+struct: Coro_executor
+执行器，挂起的协程就绪后通过它回到线程池
+@ param context: (void *) 执行器对象，例如threadpool
+@ param post: 把fn(arg)交给执行器的某个线程执行，执行器已停止时返回false
+*/
+struct Coro_executor
+{
+    void *context;
+    bool (*post)(void *context, void (*fn)(void *), void *arg);
+
+    bool Post(void (*fn)(void *), void *arg) const { return post && post(context, fn, arg); }
+};
+
+#ifdef CORO_ENABLED
+
+/*
+@ function: 按地址恢复协程，作为Coro_executor::Post的fn
+@ param: address (void *) std::coroutine_handle<>::address()
+@ return: 无
+*/
+inline void Coro_resume(void *address)
+{
+    std::coroutine_handle<>::from_address(address).resume();
+}
+
+/*
+class: Coro_task
+请求协程的返回类型，不等待结果（fire-and-forget）
+@ function: 调用协程函数时立即在当前线程执行到第一个挂起点后返回，
+            之后由等待对象（连接池租约、socket就绪）在就绪时经执行器在任意工作线程上恢复，
+            执行完时自动释放协程帧。协程中抛出的异常没有人接收，直接终止进程
+            协程跨越co_await时不能持有Arena分配的内存，工作线程在每次执行完后都会Reset()
+public:
+@ func: InFlight() 静态函数
+@ return: (long) 已开始但尚未结束的协程数，停止线程池前应等它归零，
+          否则仍挂起的协程会随丢弃的队列一起泄漏
+*/
+class Coro_task
+{
+public:
+    struct promise_type
+    {
+        promise_type() { __atomic_fetch_add(&u_in_flight, 1, __ATOMIC_RELAXED); }
+
+        ~promise_type() { __atomic_fetch_sub(&u_in_flight, 1, __ATOMIC_RELEASE); }
+
+        Coro_task get_return_object() { return Coro_task(); }
+
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    static long InFlight() { return __atomic_load_n(&u_in_flight, __ATOMIC_ACQUIRE); }
+
+private:
+    static inline long u_in_flight = 0;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,240 @@
+#include "lock_profile.h"
+
+//未定义LOCK_PROFILE时本文件为空，可以无条件加入编译
+#ifdef LOCK_PROFILE
+
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+Lock_stats Lock_profiler::u_stats[LOCK_PROFILE_MAX];
+int Lock_profiler::u_count = 0;
+pthread_mutex_t Lock_profiler::u_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+@ function: 按名字查找统计，不存在时登记
+@ param: name (const char *)
+@ param: kind (int) LOCK_PROFILE_KIND，只在登记时使用
+@ return: (Lock_stats *)
+统计表是定长数组，登记后位置不变，Report()不加锁也能安全遍历
+*/
+Lock_stats *Lock_profiler::Stats(const char *name, int kind){
+    pthread_mutex_lock(&u_mutex);
+    if(u_count == 0){
+        atexit(OnExit);
+    }
+    int count = u_count;
+    for(int i = 0; i < count; ++i){
+        if(strncmp(u_stats[i].m_name, name, sizeof(u_stats[i].m_name) - 1) == 0){
+            pthread_mutex_unlock(&u_mutex);
+            return &u_stats[i];
+        }
+    }
+    Lock_stats *stats = &u_stats[LOCK_PROFILE_MAX - 1];
+    if(count < LOCK_PROFILE_MAX - 1){
+        stats = &u_stats[count];
+        strncpy(stats->m_name, name, sizeof(stats->m_name) - 1);
+        stats->m_kind = kind;
+        __atomic_store_n(&u_count, count + 1, __ATOMIC_RELEASE);
+    }else if(count == LOCK_PROFILE_MAX - 1){
+        strncpy(stats->m_name, "(other)", sizeof(stats->m_name) - 1);
+        __atomic_store_n(&u_count, count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&u_mutex);
+    return stats;
+}
+
+/*
+@ function: 把非负整数value按decimals位小数（value已放大10^decimals倍）写进out
+@ param: out (char *) 至少32字节
+@ param: value (long)
+@ param: decimals (int)
+@ return: (int) 写入的长度
+信号处理函数中不能用snprintf，报告只用这个函数和put_field格式化
+*/
+static int format_fixed(char *out, long value, int decimals){
+    char digits[32];
+    int n = 0;
+    if(value < 0){
+        value = 0;
+    }
+    do{
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    }while(value > 0 || n <= decimals);
+    int len = 0;
+    while(n > 0){
+        out[len++] = digits[--n];
+        if(n == decimals && decimals > 0){
+            out[len++] = '.';
+        }
+    }
+    return len;
+}
+
+/*
+@ function: 按宽度对齐追加一个字段，字段之间空一格
+@ param: line (char *)
+@ param: pos (int) 当前长度
+@ param: text (const char *)
+@ param: len (int)
+@ param: width (int)
+@ param: left (bool) 左对齐
+@ return: (int) 追加后的长度
+*/
+static int put_field(char *line, int pos, const char *text, int len, int width, bool left){
+    if(pos > 0){
+        line[pos++] = ' ';
+    }
+    int pad = width > len ? width - len : 0;
+    if(!left){
+        memset(line + pos, ' ', pad);
+        pos += pad;
+    }
+    memcpy(line + pos, text, len);
+    pos += len;
+    if(left){
+        memset(line + pos, ' ', pad);
+        pos += pad;
+    }
+    return pos;
+}
+
+static int put_number(char *line, int pos, long value, int decimals, int width){
+    char text[32];
+    return put_field(line, pos, text, format_fixed(text, value, decimals), width, false);
+}
+
+/*
+@ function: 输出报告
+@ param: fd (int)
+@ return: 无
+互斥锁一张表，条件变量和信号量一张表，各自按总等待时间降序；
+后者的阻塞大多是线程空闲（例如工作线程等任务），和互斥锁一起排序会盖过真正的锁竞争
+*/
+void Lock_profiler::Report(int fd){
+    int count = __atomic_load_n(&u_count, __ATOMIC_ACQUIRE);
+    if(count > LOCK_PROFILE_MAX){
+        count = LOCK_PROFILE_MAX;
+    }
+    ReportKind(fd, LOCK_KIND_MUTEX, count);
+    ReportKind(fd, LOCK_KIND_WAIT, count);
+}
+
+/*
+@ function: 输出一种统计
+@ param: fd (int)
+@ param: kind (int) LOCK_PROFILE_KIND
+@ param: count (int) 已登记的统计数
+@ return: 无
+互斥锁：name acquisitions contended cont% wait_ms avg_wait_us max_wait_us hold_ms max_hold_us
+条件变量/信号量：name waits blocked blocked% wait_ms avg_wait_us max_wait_us
+*/
+void Lock_profiler::ReportKind(int fd, int kind, int count){
+    //按总等待时间插入排序，只用栈上的数组
+    int order[LOCK_PROFILE_MAX];
+    long wait[LOCK_PROFILE_MAX];
+    int number = 0;
+    for(int i = 0; i < count; ++i){
+        if(u_stats[i].m_kind != kind){
+            continue;
+        }
+        wait[i] = __atomic_load_n(&u_stats[i].m_wait_ns, __ATOMIC_RELAXED);
+        int j = number++;
+        while(j > 0 && wait[order[j - 1]] < wait[i]){
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    bool mutex = kind == LOCK_KIND_MUTEX;
+    static const char *const mutex_titles[] = {"acquisitions", "contended", "cont%", "wait_ms", "avg_wait_us",
+                                               "max_wait_us", "hold_ms", "max_hold_us"};
+    static const char *const wait_titles[] = {"waits", "blocked", "block%", "wait_ms", "avg_wait_us", "max_wait_us"};
+    static const int widths[] = {12, 10, 6, 10, 10, 10, 10, 10};
+    const char *const *titles = mutex ? mutex_titles : wait_titles;
+    int columns = mutex ? 8 : 6;
+
+    char line[256];
+    const char *first = mutex ? "lock" : "cond/sem (idle waits)";
+    int len = put_field(line, 0, first, (int)strlen(first), 32, true);
+    for(int c = 0; c < columns; ++c){
+        len = put_field(line, len, titles[c], (int)strlen(titles[c]), widths[c], false);
+    }
+    line[len++] = '\n';
+    if(write(fd, line, len) < 0){
+        return;
+    }
+    for(int i = 0; i < number; ++i){
+        const Lock_stats &stats = u_stats[order[i]];
+        long acquisitions = __atomic_load_n(&stats.m_acquisitions, __ATOMIC_RELAXED);
+        long contended = __atomic_load_n(&stats.m_contended, __ATOMIC_RELAXED);
+        //构造时的默认名在LOCK_NAME改名后不再使用，不输出
+        if(acquisitions == 0){
+            continue;
+        }
+        long total = wait[order[i]];
+        //时间统一保留3位小数：毫秒列用微秒数，微秒列用纳秒数
+        len = put_field(line, 0, stats.m_name, (int)strnlen(stats.m_name, sizeof(stats.m_name)), 32, true);
+        len = put_number(line, len, acquisitions, 0, widths[0]);
+        len = put_number(line, len, contended, 0, widths[1]);
+        len = put_number(line, len, contended * 10000 / acquisitions, 2, widths[2]);
+        len = put_number(line, len, total / 1000, 3, widths[3]);
+        len = put_number(line, len, contended ? total / contended : 0, 3, widths[4]);
+        len = put_number(line, len, __atomic_load_n(&stats.m_max_wait_ns, __ATOMIC_RELAXED), 3, widths[5]);
+        if(mutex){
+            len = put_number(line, len, __atomic_load_n(&stats.m_hold_ns, __ATOMIC_RELAXED) / 1000, 3, widths[6]);
+            len = put_number(line, len, __atomic_load_n(&stats.m_max_hold_ns, __ATOMIC_RELAXED), 3, widths[7]);
+        }
+        line[len++] = '\n';
+        if(write(fd, line, len) < 0){
+            return;
+        }
+    }
+}
+
+/*
+@ function: 注册输出报告的信号
+@ param: sig (int)
+@ return: 无
+*/
+void Lock_profiler::InstallSignal(int sig){
+    struct sigaction sa;
+    memset(&sa, '\0', sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sa.sa_flags |= SA_RESTART;
+    sigfillset(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+/*
+@ function: 清零统计，锁名保留
+@ return: 无
+*/
+void Lock_profiler::Reset(){
+    int count = __atomic_load_n(&u_count, __ATOMIC_ACQUIRE);
+    for(int i = 0; i < count && i < LOCK_PROFILE_MAX; ++i){
+        __atomic_store_n(&u_stats[i].m_acquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&u_stats[i].m_contended, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&u_stats[i].m_wait_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&u_stats[i].m_max_wait_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&u_stats[i].m_hold_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&u_stats[i].m_max_hold_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void Lock_profiler::OnSignal(int){
+    //保留errno，避免影响被打断的系统调用的错误处理
+    int save_errno = errno;
+    Report(STDERR_FILENO);
+    errno = save_errno;
+}
+
+void Lock_profiler::OnExit(){
+    Report(STDERR_FILENO);
+}
+
+#endif
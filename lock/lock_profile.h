@@ -0,0 +1,302 @@
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include "locker.h"
+
+/*
+锁竞争分析
+@ function: 定义LOCK_PROFILE编译时，Profiled_locker / Profiled_cond / Profiled_sem是带统计的封装，
+            按名字汇总每把锁的获取次数、竞争次数、等待时间和持有时间，进程退出或收到指定信号时
+            按总等待时间从大到小输出报告；条件变量和信号量的等待大多是空闲（例如工作线程等任务），
+            单独成表，不和互斥锁的竞争一起排序；
+            未定义时三者只是locker / cond / sem的别名，LOCK_NAME展开为空，没有任何额外开销。
+            需要分析的锁把成员类型从locker改为Profiled_locker，并在构造时用LOCK_NAME命名，
+            同名的多个实例（例如每个block_queue）汇总到同一行
+*/
+#ifndef LOCK_PROFILE
+
+typedef locker Profiled_locker;
+typedef cond Profiled_cond;
+typedef sem Profiled_sem;
+
+#define LOCK_NAME(lock, name) do {} while (0)
+
+#else
+
+#include <time.h>
+#include <semaphore.h>
+
+//最多统计的锁名数，超出后的锁汇总到最后一行
+const int LOCK_PROFILE_MAX = 128;
+
+//统计的种类：互斥锁的阻塞是竞争，条件变量和信号量的阻塞是等待事件
+enum LOCK_PROFILE_KIND
+{
+    LOCK_KIND_MUTEX = 0,
+    LOCK_KIND_WAIT
+};
+
+/*
+struct: Lock_stats
+一个锁名的统计，所有字段由持锁或等锁的线程用relaxed原子操作更新
+@ param m_acquisitions: (long) 获取次数，条件变量为wait次数，信号量为wait次数
+@ param m_contended: (long) 获取时需要阻塞的次数
+@ param m_wait_ns / m_max_wait_ns: (long) 阻塞等待的总时间 / 最长一次
+@ param m_hold_ns / m_max_hold_ns: (long) 持有的总时间 / 最长一次，只对互斥锁有意义
+@ param m_kind: (int) LOCK_PROFILE_KIND，第一次登记时确定
+*/
+struct Lock_stats
+{
+    char m_name[48];
+    int m_kind;
+    long m_acquisitions;
+    long m_contended;
+    long m_wait_ns;
+    long m_max_wait_ns;
+    long m_hold_ns;
+    long m_max_hold_ns;
+};
+
+/*
+class: Lock_profiler
+统计表（全部为静态成员）
+public:
+@ func: Stats()
+@ param name: (const char *) 锁名，同名返回同一份统计
+@ param kind: (int) LOCK_PROFILE_KIND
+@ return: (Lock_stats *) 第一次调用时注册退出时的报告
+
+@ func: Report()
+@ param fd: (int) 输出的文件描述符
+@ return: 无
+@ function: 互斥锁和条件变量/信号量分成两张表，各自按总等待时间降序输出；
+            只用整数运算格式化到栈上的缓冲区再write()，不调用snprintf，可以在信号处理函数中调用
+
+@ func: InstallSignal()
+@ param sig: (int) 例如SIGUSR2，收到后向stderr输出一次报告，不影响统计继续进行
+@ return: 无
+
+@ func: Reset()
+@ function: 清零所有统计，用于只观察某一段时间，例如压测预热之后
+@ return: 无
+*/
+class Lock_profiler{
+public:
+    static Lock_stats *Stats(const char *name, int kind = LOCK_KIND_MUTEX);
+
+    static void Report(int fd);
+
+    static void InstallSignal(int sig);
+
+    static void Reset();
+
+    static long Now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+    }
+
+    static void Acquired(Lock_stats *stats, long wait_ns, bool contended)
+    {
+        __atomic_fetch_add(&stats->m_acquisitions, 1, __ATOMIC_RELAXED);
+        if(contended){
+            __atomic_fetch_add(&stats->m_contended, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stats->m_wait_ns, wait_ns, __ATOMIC_RELAXED);
+            UpdateMax(&stats->m_max_wait_ns, wait_ns);
+        }
+    }
+
+    static void Released(Lock_stats *stats, long hold_ns)
+    {
+        __atomic_fetch_add(&stats->m_hold_ns, hold_ns, __ATOMIC_RELAXED);
+        UpdateMax(&stats->m_max_hold_ns, hold_ns);
+    }
+
+private:
+    static void UpdateMax(long *max, long value)
+    {
+        long current = __atomic_load_n(max, __ATOMIC_RELAXED);
+        while(value > current &&
+              !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        }
+    }
+
+    static void ReportKind(int fd, int kind, int count);
+
+    static void OnSignal(int sig);
+
+    static void OnExit();
+
+    static Lock_stats u_stats[LOCK_PROFILE_MAX];
+
+    static int u_count;
+
+    static pthread_mutex_t u_mutex;
+};
+
+class Profiled_locker;
+
+/*
+@ func: LockProfileHeld()
+@ function: 当前线程最近获取的Profiled_locker，条件变量wait时据此把等待期间从持有时间中扣除
+@ return: (Profiled_locker *&)
+*/
+inline Profiled_locker *&LockProfileHeld()
+{
+    static thread_local Profiled_locker *held = NULL;
+    return held;
+}
+
+/*
+class: Profiled_locker
+带统计的互斥锁
+@ function: 先trylock，失败才计为一次竞争并记录阻塞时间；持有时间从获得锁到unlock()
+*/
+class Profiled_locker : public locker{
+public:
+    explicit Profiled_locker(const char *name = "locker") : m_stats(Lock_profiler::Stats(name)), m_acquired(0) {}
+
+    void SetName(const char *name) { m_stats = Lock_profiler::Stats(name); }
+
+    bool lock()
+    {
+        long begin = 0;
+        bool contended = pthread_mutex_trylock(get()) != 0;
+        if(contended){
+            begin = Lock_profiler::Now();
+            if(!locker::lock()){
+                return false;
+            }
+        }
+        m_acquired = Lock_profiler::Now();
+        Lock_profiler::Acquired(m_stats, m_acquired - begin, contended);
+        LockProfileHeld() = this;
+        return true;
+    }
+
+    bool unlock()
+    {
+        Lock_profiler::Released(m_stats, Lock_profiler::Now() - m_acquired);
+        if(LockProfileHeld() == this){
+            LockProfileHeld() = NULL;
+        }
+        return locker::unlock();
+    }
+
+    //条件变量wait前后调用，等待期间锁已释放，不计入持有时间
+    void Suspend() { Lock_profiler::Released(m_stats, Lock_profiler::Now() - m_acquired); }
+
+    void Resume() { m_acquired = Lock_profiler::Now(); }
+
+private:
+    Lock_stats *m_stats;
+    long m_acquired;
+};
+
+/*
+class: Profiled_cond
+带统计的条件变量
+@ function: 每次wait计为一次竞争，等待时间为阻塞在wait中的时间；
+            传入的互斥锁是当前线程持有的Profiled_locker时，等待期间从其持有时间中扣除
+*/
+class Profiled_cond : public cond{
+public:
+    explicit Profiled_cond(const char *name = "cond") : m_stats(Lock_profiler::Stats(name, LOCK_KIND_WAIT)) {}
+
+    void SetName(const char *name) { m_stats = Lock_profiler::Stats(name, LOCK_KIND_WAIT); }
+
+    bool wait(pthread_mutex_t *m_mutex)
+    {
+        Profiled_locker *held = Holder(m_mutex);
+        long begin = Lock_profiler::Now();
+        bool ret = cond::wait(m_mutex);
+        Finish(held, begin);
+        return ret;
+    }
+
+    bool timewait(pthread_mutex_t *m_mutex, struct timespec t)
+    {
+        Profiled_locker *held = Holder(m_mutex);
+        long begin = Lock_profiler::Now();
+        bool ret = cond::timewait(m_mutex, t);
+        Finish(held, begin);
+        return ret;
+    }
+
+private:
+    static Profiled_locker *Holder(pthread_mutex_t *m_mutex)
+    {
+        Profiled_locker *held = LockProfileHeld();
+        if(held && held->get() == m_mutex){
+            held->Suspend();
+            return held;
+        }
+        return NULL;
+    }
+
+    void Finish(Profiled_locker *held, long begin)
+    {
+        long now = Lock_profiler::Now();
+        Lock_profiler::Acquired(m_stats, now - begin, true);
+        if(held){
+            held->Resume();
+            LockProfileHeld() = held;
+        }
+    }
+
+    Lock_stats *m_stats;
+};
+
+/*
+class: Profiled_sem
+带统计的信号量
+@ function: 先sem_trywait，失败才计为一次竞争并记录阻塞时间；
+            sem不暴露内部的sem_t，这里与sem接口相同、单独实现
+*/
+class Profiled_sem{
+public:
+    explicit Profiled_sem(int num = 0, const char *name = "sem") : m_stats(Lock_profiler::Stats(name, LOCK_KIND_WAIT))
+    {
+        if(sem_init(&m_sem, 0, num) != 0){
+            throw std::exception();
+        }
+    }
+
+    ~Profiled_sem()
+    {
+        sem_destroy(&m_sem);
+    }
+
+    void SetName(const char *name) { m_stats = Lock_profiler::Stats(name, LOCK_KIND_WAIT); }
+
+    bool wait()
+    {
+        if(sem_trywait(&m_sem) == 0){
+            Lock_profiler::Acquired(m_stats, 0, false);
+            return true;
+        }
+        long begin = Lock_profiler::Now();
+        bool ret = sem_wait(&m_sem) == 0;
+        Lock_profiler::Acquired(m_stats, Lock_profiler::Now() - begin, true);
+        return ret;
+    }
+
+    bool post()
+    {
+        return sem_post(&m_sem) == 0;
+    }
+
+private:
+    sem_t m_sem;
+    Lock_stats *m_stats;
+};
+
+#define LOCK_NAME(lock, name) (lock).SetName(name)
+
+#endif
+
+#endif
@@ -1,6 +1,10 @@
 /*************************************************************
 *循环数组实现的阻塞队列，m_back = (m_back + 1) % m_max_size;  
 *线程安全，每个操作前都要先加互斥锁，操作完后，再解锁
+*第二个模板参数选择同步方式：
+*mutex_policy（默认）任意多个生产者和消费者，互斥锁 + 条件变量
+*spsc_policy 只有一个生产者和一个消费者（生产者可以是多个线程，但必须在同一把锁内push），
+*            push/pop不加锁，只在消费者已经睡下、队列由空变为非空时用futex唤醒一次
 **************************************************************/
 
 #ifndef BLOCK_QUEUE_H
@@ -10,10 +14,21 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <sys/time.h>
-#include "../lock/locker.h"
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <utility>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "../lock/lock_profile.h"
+#include "../metrics/Metrics.h"
 using namespace std;
 
-template <class T>
+//同步方式标签
+struct mutex_policy {};
+struct spsc_policy {};
+
+template <class T, class Policy = mutex_policy>
 class block_queue
 {
 public:
@@ -30,6 +45,20 @@ public:
         m_size = 0;
         m_front = -1;
         m_back = -1;
+        m_size_gauge = NULL;
+        m_full_counter = NULL;
+        m_closed = false;
+        LOCK_NAME(m_mutex, "block_queue.mutex");
+        LOCK_NAME(m_cond, "block_queue.cond");
+    }
+    //注册指标：<name>.size为当前元素数，<name>.full为队列满导致push失败的次数
+    void set_metrics(const char *name)
+    {
+        string prefix(name);
+        m_size_gauge = Metrics_registry::GetInstance()->Gauge((prefix + ".size").c_str());
+        m_full_counter = Metrics_registry::GetInstance()->Counter((prefix + ".full").c_str());
+        LOCK_NAME(m_mutex, (prefix + ".mutex").c_str());
+        LOCK_NAME(m_cond, (prefix + ".cond").c_str());
     }
 //清空队列
     void clear()
@@ -41,6 +70,23 @@ public:
         m_mutex.unlock();
     }
 
+    //关闭队列：之后push失败，pop取完剩余元素后返回false，等待中的消费者立即被唤醒
+    void close()
+    {
+        m_mutex.lock();
+        m_closed = true;
+        m_cond.broadcast();
+        m_mutex.unlock();
+    }
+
+    bool closed()
+    {
+        m_mutex.lock();
+        bool tmp = m_closed;
+        m_mutex.unlock();
+        return tmp;
+    }
+
     ~block_queue()
     {
 	//不再需要手动释放m_array,智能指针会自动管理
@@ -130,11 +176,18 @@ public:
     {
 
         m_mutex.lock();
+        if (m_closed)
+        {
+            m_mutex.unlock();
+            return false;
+        }
         if (m_size >= m_max_size)//如果队列中的元素已经达到上限
         {
 
             m_cond.broadcast();//全部唤醒，先把队列里的元素写进日志
             m_mutex.unlock();
+            if (m_full_counter)
+                m_full_counter->Add(1);
             return false;
         }
 
@@ -142,6 +195,8 @@ public:
         m_array[m_back] = item;
 
         m_size++;
+        if (m_size_gauge)
+            m_size_gauge->Set(m_size);
 
         m_cond.broadcast();
         m_mutex.unlock();
@@ -154,7 +209,11 @@ public:
         m_mutex.lock();
         while (m_size <= 0)
         {
-            
+            if (m_closed)//已关闭且取空
+            {
+                m_mutex.unlock();
+                return false;
+            }
             if (!m_cond.wait(m_mutex.get()))//等待
             {
                 m_mutex.unlock();
@@ -165,6 +224,8 @@ public:
         m_front = (m_front + 1) % m_max_size;
         item = m_array[m_front];
         m_size--;
+        if (m_size_gauge)
+            m_size_gauge->Set(m_size);
         m_mutex.unlock();
         return true;
     }
@@ -176,10 +237,12 @@ public:
         struct timeval now = {0, 0};
         gettimeofday(&now, NULL);
         m_mutex.lock();
-        if (m_size <= 0)
+        if (m_size <= 0 && !m_closed)
         {
-            t.tv_sec = now.tv_sec + ms_timeout / 1000;
-            t.tv_nsec = (ms_timeout % 1000) * 1000;
+            //绝对时刻，纳秒部分要加上当前的微秒数并进位
+            long nsec = now.tv_usec * 1000L + (ms_timeout % 1000) * 1000000L;
+            t.tv_sec = now.tv_sec + ms_timeout / 1000 + nsec / 1000000000L;
+            t.tv_nsec = nsec % 1000000000L;
             if (!m_cond.timewait(m_mutex.get(), t))
             {
                 m_mutex.unlock();
@@ -196,19 +259,258 @@ public:
         m_front = (m_front + 1) % m_max_size;
         item = m_array[m_front];
         m_size--;
+        if (m_size_gauge)
+            m_size_gauge->Set(m_size);
         m_mutex.unlock();
         return true;
     }
 
 private:
-    locker m_mutex;
-    cond m_cond;
+    Profiled_locker m_mutex;
+    Profiled_cond m_cond;
 
     unique_ptr<T[]> m_array; //改为智能指针
     int m_size;
     int m_max_size;
     int m_front;
     int m_back;
+    bool m_closed;
+
+    Metrics_gauge *m_size_gauge;
+    Metrics_counter *m_full_counter;
+};
+
+//生产者和消费者各自写的变量之间填充一个缓存行，避免伪共享；
+//不用alignas，C++17之前的new不保证超过16字节的对齐（-Waligned-new）
+#define BLOCK_QUEUE_CACHE_LINE 64
+
+/*
+单生产者单消费者版本，接口与默认版本相同
+下标单调递增，取模得到数组位置；生产者缓存上次看到的m_head，消费者缓存上次看到的m_tail，
+只有缓存的值显示队列满/空时才去读对方的下标。
+back()只能由生产者调用，front()只能由消费者调用，clear()只能在没有并发操作时调用
+*/
+template <class T>
+class block_queue<T, spsc_policy>
+{
+public:
+    block_queue(int max_size = 1000)
+    {
+        if (max_size <= 0)
+        {
+            printf("the max_size must >0");
+            exit(-1);
+        }
+
+        m_max_size = max_size;
+        m_array = make_unique<T[]>(max_size);
+        m_head = 0;
+        m_cached_tail = 0;
+        m_tail = 0;
+        m_cached_head = 0;
+        m_waiting = 0;
+        m_wake_seq = 0;
+        m_closed = false;
+        m_size_gauge = NULL;
+        m_full_counter = NULL;
+        m_wake_counter = NULL;
+    }
+
+    //注册指标：<name>.size为当前元素数，<name>.full为队列满导致push失败的次数，<name>.wakeups为futex唤醒次数
+    void set_metrics(const char *name)
+    {
+        string prefix(name);
+        m_size_gauge = Metrics_registry::GetInstance()->Gauge((prefix + ".size").c_str());
+        m_full_counter = Metrics_registry::GetInstance()->Counter((prefix + ".full").c_str());
+        m_wake_counter = Metrics_registry::GetInstance()->Counter((prefix + ".wakeups").c_str());
+    }
+
+    void clear()
+    {
+        uint64_t tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&m_head, tail, __ATOMIC_RELEASE);
+        m_cached_tail = tail;
+        m_cached_head = tail;
+    }
+
+    void close()
+    {
+        __atomic_store_n(&m_closed, true, __ATOMIC_SEQ_CST);
+        wake(true);
+    }
+
+    bool closed() { return __atomic_load_n(&m_closed, __ATOMIC_ACQUIRE); }
+
+    bool full() { return size() >= m_max_size; }
+
+    bool empty() { return size() == 0; }
+
+    bool front(T &value)
+    {
+        uint64_t head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+        if (head == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE))
+            return false;
+        value = m_array[head % m_max_size];
+        return true;
+    }
+
+    bool back(T &value)
+    {
+        uint64_t tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+        if (tail == __atomic_load_n(&m_head, __ATOMIC_ACQUIRE))
+            return false;
+        value = m_array[(tail - 1) % m_max_size];
+        return true;
+    }
+
+    int size()
+    {
+        uint64_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+        return tail > head ? (int)(tail - head) : 0;
+    }
+
+    int max_size() { return m_max_size; }
+
+    //队列满时与默认版本一样唤醒消费者并返回false
+    bool push(const T &item)
+    {
+        if (__atomic_load_n(&m_closed, __ATOMIC_ACQUIRE))
+            return false;
+        uint64_t tail = m_tail;
+        if (tail - m_cached_head >= (uint64_t)m_max_size)
+        {
+            m_cached_head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+            if (tail - m_cached_head >= (uint64_t)m_max_size)
+            {
+                wake(false);
+                if (m_full_counter)
+                    m_full_counter->Add(1);
+                return false;
+            }
+        }
+
+        m_array[tail % m_max_size] = item;
+        //SEQ_CST与wake()中对m_waiting的读取配对，见wait()
+        __atomic_store_n(&m_tail, tail + 1, __ATOMIC_SEQ_CST);
+        if (m_size_gauge)
+            m_size_gauge->Set((long)(tail + 1 - m_cached_head));
+        wake(false);
+        return true;
+    }
+
+    //已关闭且取空时返回false
+    bool pop(T &item)
+    {
+        while (true)
+        {
+            if (take(item))
+                return true;
+            if (__atomic_load_n(&m_closed, __ATOMIC_ACQUIRE))
+                return take(item);
+            wait(NULL);
+        }
+    }
+
+    //ms_timeout内一直为空时返回false
+    bool pop(T &item, int ms_timeout)
+    {
+        if (take(item))
+            return true;
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += ms_timeout / 1000;
+        deadline.tv_nsec += (long)(ms_timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!__atomic_load_n(&m_closed, __ATOMIC_ACQUIRE))
+        {
+            struct timespec now, left;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left.tv_sec = deadline.tv_sec - now.tv_sec;
+            left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (left.tv_nsec < 0)
+            {
+                left.tv_sec -= 1;
+                left.tv_nsec += 1000000000L;
+            }
+            if (left.tv_sec < 0)
+                break;
+            wait(&left);
+            if (take(item))
+                return true;
+        }
+        return take(item);
+    }
+
+private:
+    //消费者取一个元素，空时返回false
+    bool take(T &item)
+    {
+        uint64_t head = m_head;
+        if (head == m_cached_tail)
+        {
+            m_cached_tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+            if (head == m_cached_tail)
+                return false;
+        }
+        item = std::move(m_array[head % m_max_size]);
+        __atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /*
+    消费者睡眠：先登记m_waiting再检查一次是否为空，与生产者"先发布m_tail再检查m_waiting"配对，
+    两边都用SEQ_CST，不会出现生产者看不到登记、消费者也看不到新元素的情况；
+    m_wake_seq在检查之前读取，之后有唤醒时FUTEX_WAIT立即返回
+    */
+    void wait(const struct timespec *timeout)
+    {
+        uint32_t seq = __atomic_load_n(&m_wake_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&m_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_tail, __ATOMIC_SEQ_CST) == m_head && !__atomic_load_n(&m_closed, __ATOMIC_SEQ_CST))
+            syscall(SYS_futex, &m_wake_seq, FUTEX_WAIT_PRIVATE, seq, timeout, NULL, 0);
+        __atomic_store_n(&m_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    //生产者或close()调用：消费者已登记睡眠时才进入内核，并清掉登记，消费者真正醒来之前的push不再重复唤醒
+    void wake(bool always)
+    {
+        if (!__atomic_load_n(&m_waiting, __ATOMIC_SEQ_CST) && !always)
+            return;
+        if (!__atomic_exchange_n(&m_waiting, 0, __ATOMIC_SEQ_CST) && !always)
+            return;
+        __atomic_fetch_add(&m_wake_seq, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &m_wake_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        if (m_wake_counter)
+            m_wake_counter->Add(1);
+    }
+
+    unique_ptr<T[]> m_array;
+    int m_max_size;
+    Metrics_gauge *m_size_gauge;
+    Metrics_counter *m_full_counter;
+    Metrics_counter *m_wake_counter;
+
+    char m_pad0[BLOCK_QUEUE_CACHE_LINE];
+
+    //消费者写
+    uint64_t m_head;
+    uint64_t m_cached_tail;
+    int m_waiting;
+    char m_pad1[BLOCK_QUEUE_CACHE_LINE];
+
+    //生产者写
+    uint64_t m_tail;
+    uint64_t m_cached_head;
+    uint32_t m_wake_seq;
+    char m_pad2[BLOCK_QUEUE_CACHE_LINE];
+
+    bool m_closed;
+    char m_pad3[BLOCK_QUEUE_CACHE_LINE];
 };
 
 #endif
@@ -2,21 +2,48 @@
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <unistd.h>
+#include "../trace/Trace.h"
 
 // 初始化静态成员
 LogType Log::m_log_type = SYNC_LOG;  // 默认同步日志
 
+// 默认每个调用点每秒100条，突发200条
+std::atomic<long long> Log_limiter::u_interval_ns(10000000LL);
+std::atomic<long long> Log_limiter::u_tolerance_ns(199 * 10000000LL);
+
+// 相同记录折叠超过该秒数时先输出一次汇总，避免长时间看不到仍在发生的错误
+static const int LOG_REPEAT_REPORT = 10;
+
 Log::Log() : m_log_queue(nullptr), m_fp(nullptr), m_buf(nullptr), 
-             m_is_async(false), m_close_log(0), m_count(0) {}
+             m_is_async(false), m_close_log(0), m_count(0)
+{
+    m_thread_started = false;
+    m_unflushed = 0;
+    m_stream_buf = nullptr;
+    m_last_buf = nullptr;
+    m_last_len = -1;
+    m_last_tag[0] = '\0';
+    m_repeat = 0;
+    m_repeat_start = 0;
+    LOCK_NAME(m_mutex, "log.mutex");
+}
 
 Log::~Log()
 {
+    shutdown();
     if (m_fp != nullptr) {
         fclose(m_fp);
     }
+    if (m_stream_buf != nullptr) {
+        delete[] m_stream_buf;
+    }
     if (m_buf != nullptr) {
         delete[] m_buf;
     }
+    if (m_last_buf != nullptr) {
+        delete[] m_last_buf;
+    }
     if (m_log_queue != nullptr) {
         delete m_log_queue;
     }
@@ -38,15 +65,16 @@ bool Log::async_init(const char *file_name, int close_log, int log_buf_size,
 {
     if (max_queue_size >= 1) {
         m_is_async = true;
-        m_log_queue = new block_queue<string>(max_queue_size);
-        pthread_t tid;
-        pthread_create(&tid, NULL, async_flush_thread, NULL);
+        m_log_queue = new block_queue<string, spsc_policy>(max_queue_size);
+        m_log_queue->set_metrics("log.queue");
+        m_thread_started = pthread_create(&m_thread, NULL, async_flush_thread, NULL) == 0;
     }
     
     m_close_log = close_log;
     m_log_buf_size = log_buf_size;
     m_buf = new char[m_log_buf_size];
     memset(m_buf, '\0', m_log_buf_size);
+    m_last_buf = new char[m_log_buf_size];
     m_split_lines = split_lines;
 
     time_t t = time(NULL);
@@ -68,7 +96,28 @@ bool Log::async_init(const char *file_name, int close_log, int log_buf_size,
 
     m_today = my_tm.tm_mday;
     m_fp = fopen(log_full_name, "a");
-    return m_fp != nullptr;
+    if (m_fp == nullptr)
+        return false;
+    set_stream_buffer();
+
+    //上次进程没有正常退出时，环形缓冲区中还有没写进文件的记录，先补写
+    if (m_is_async) {
+        char ring_name[300] = {0};
+        snprintf(ring_name, sizeof(ring_name), "%s.ring", file_name);
+        if (m_ring.Open(ring_name)) {
+            size_t recovered = m_ring.Recover(m_fp);
+            if (recovered > 0) {
+                struct timeval now = {0, 0};
+                gettimeofday(&now, NULL);
+                fprintf(m_fp, "%d-%02d-%02d %02d:%02d:%02d.%06ld [warn]: recovered %zu bytes of log records from %s\n",
+                        my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                        my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, recovered, ring_name);
+                fflush(m_fp);
+                METRICS_COUNT("log.ring_recovered_bytes", (long)recovered);
+            }
+        }
+    }
+    return true;
 }
 
 bool Log::sync_init(const char *file_name, int close_log, int log_buf_size, 
@@ -78,6 +127,7 @@ bool Log::sync_init(const char *file_name, int close_log, int log_buf_size,
     m_log_buf_size = log_buf_size;
     m_buf = new char[m_log_buf_size];
     memset(m_buf, '\0', m_log_buf_size);
+    m_last_buf = new char[m_log_buf_size];
     m_split_lines = split_lines;
 
     time_t t = time(NULL);
@@ -116,7 +166,66 @@ void Log::write_log(int level, const char *format, ...)
     va_end(valst);
 }
 
+void Log::write_log_args(int level, const Log_format &format, const Log_arg *args, int nargs)
+{
+    Log_body body = {NULL, NULL, &format, args, nargs};
+    if (m_log_type == ASYNC_LOG) {
+        async_write_body(level, body);
+    } else {
+        sync_write_body(level, body);
+    }
+}
+
 void Log::async_write_log(int level, const char *format, va_list valst)
+{
+    //va_list作为参数时可能已退化为指针，复制一份再取地址
+    va_list copy;
+    va_copy(copy, valst);
+    Log_body body = {format, &copy, NULL, NULL, 0};
+    async_write_body(level, body);
+    va_end(copy);
+}
+
+void Log::sync_write_log(int level, const char *format, va_list valst)
+{
+    va_list copy;
+    va_copy(copy, valst);
+    Log_body body = {format, &copy, NULL, NULL, 0};
+    sync_write_body(level, body);
+    va_end(copy);
+}
+
+/*
+@ function: 格式化正文，类型化参数走log_format_to，否则走vsnprintf
+@ param: buf (char *)
+@ param: size (int)
+@ param: body (const Log_body &)
+@ return: (int) 正文长度，不超过size - 1
+*/
+int Log::format_body(char *buf, int size, const Log_body &body)
+{
+    if (body.fmt != NULL)
+        return log_format_to(buf, size, *body.fmt, body.args, body.nargs);
+    int m = vsnprintf(buf, size, body.format, *body.valst);
+    //截断时vsnprintf返回的是完整长度
+    if (m > size - 1)
+        m = size - 1;
+    return m < 0 ? 0 : m;
+}
+
+int Log::write_prefix(const struct tm &tm, long usec, const char *tag)
+{
+    //与"%d-%02d-%02d %02d:%02d:%02d.%06ld %s "一致，不经过snprintf
+    int n = log_fmt_time(m_buf, tm, usec);
+    int len = (int)strlen(tag);
+    m_buf[n++] = ' ';
+    memcpy(m_buf + n, tag, len);
+    n += len;
+    m_buf[n++] = ' ';
+    return n;
+}
+
+void Log::async_write_body(int level, const Log_body &body)
 {
     struct timeval now = {0, 0};
     gettimeofday(&now, NULL);
@@ -133,12 +242,13 @@ void Log::async_write_log(int level, const char *format, va_list valst)
     default: strcpy(s, "[info]:"); break;
     }
 
-    m_mutex.lock();
+    TRACE_LOCK(m_mutex, "log.lock_wait");
     m_count++;
 
     if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) {
         char new_log[256] = {0};
-        fflush(m_fp);
+        //写线程fputs过、还没提交的记录随fclose写进旧文件，同时推进提交位置，恢复时不会再补写一遍
+        commit_flushed();
         fclose(m_fp);
         char tail[16] = {0};
        
@@ -152,33 +262,61 @@ void Log::async_write_log(int level, const char *format, va_list valst)
             snprintf(new_log, 255, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
         }
         m_fp = fopen(new_log, "a");
+        set_stream_buffer();
     }
     m_mutex.unlock();
 
     string log_str;
-    m_mutex.lock();
+    TRACE_LOCK(m_mutex, "log.lock_wait");
 
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    
-    int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    int n = write_prefix(my_tm, now.tv_usec, s);
+    int m = format_body(m_buf + n, m_log_buf_size - n - 1, body);
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
 
-    m_mutex.unlock();
+    //与上一条相同的记录只计数；汇总行和这一条作为一个字符串入队，保持先后顺序
+    char summary[128];
+    bool repeated = collapse_repeat(s, m_buf + n, m, m_buf, n - (int)strlen(s) - 2, t, summary, sizeof(summary));
+    if (summary[0] != '\0')
+        log_str = summary;
+    if (!repeated)
+        log_str += m_buf;
+
+    //先暂存进环形缓冲区再入队，都在m_mutex内，两者的顺序一致，写线程按字节数推进提交位置即可
+    bool queued = false;
+    if (!log_str.empty() && m_is_async) {
+        bool staged = !m_ring.IsOpen() || m_ring.Append(log_str.data(), log_str.size());
+        if (!staged)
+            METRICS_COUNT("log.ring_full", 1);
+        queued = staged && m_log_queue->push(log_str);
+        if (staged && !queued && m_ring.IsOpen())
+            m_ring.Unappend(log_str.size());
+    }
 
-    if (m_is_async && !m_log_queue->full()) {
-        m_log_queue->push(log_str);
-    } else {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
-        m_mutex.unlock();
+    m_mutex.unlock();
+    if (repeated)
+        METRICS_COUNT("log.repeated", 1);
+    if (log_str.empty())
+        return;
+    METRICS_COUNT("log.records", 1);
+    METRICS_COUNT("log.bytes", (long)log_str.size());
+
+    if (queued) {
+        return;
     }
+
+    //异步队列满、环形缓冲区满或已关闭时退回同步写，这部分写入会阻塞调用线程；
+    //这条记录不在环形缓冲区中，不计入提交位置；fflush会连带写出写线程未提交的记录，所以一并提交
+    if (m_is_async)
+        METRICS_COUNT("log.sync_fallback", 1);
+    TRACE_LOCK(m_mutex, "log.lock_wait");
+    fputs(log_str.c_str(), m_fp);
+    if (m_ring.IsOpen())
+        commit_flushed();
+    m_mutex.unlock();
 }
 
-void Log::sync_write_log(int level, const char *format, va_list valst)
+void Log::sync_write_body(int level, const Log_body &body)
 {
     struct timeval now = {0, 0};
     gettimeofday(&now, NULL);
@@ -195,7 +333,7 @@ void Log::sync_write_log(int level, const char *format, va_list valst)
     default: strcpy(s, "[info]:"); break;
     }
 
-    m_mutex.lock();
+    TRACE_LOCK(m_mutex, "log.lock_wait");
     m_count++;
 
     if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) {
@@ -217,23 +355,95 @@ void Log::sync_write_log(int level, const char *format, va_list valst)
     }
     m_mutex.unlock();
 
-    string log_str;
-    m_mutex.lock();
+    //同步模式下格式化和写入在同一次加锁内完成，直接写m_buf，不再复制成string
+    TRACE_LOCK(m_mutex, "log.lock_wait");
 
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    
-    int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    int n = write_prefix(my_tm, now.tv_usec, s);
+    int m = format_body(m_buf + n, m_log_buf_size - n - 1, body);
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
 
-    m_mutex.unlock();
+    char summary[128];
+    bool repeated = collapse_repeat(s, m_buf + n, m, m_buf, n - (int)strlen(s) - 2, t, summary, sizeof(summary));
+    if (summary[0] != '\0')
+        fputs(summary, m_fp);
+    if (!repeated)
+        fputs(m_buf, m_fp);
 
-    m_mutex.lock();
-    fputs(log_str.c_str(), m_fp);
     m_mutex.unlock();
+    if (repeated) {
+        METRICS_COUNT("log.repeated", 1);
+        return;
+    }
+    METRICS_COUNT("log.records", 1);
+    METRICS_COUNT("log.bytes", n + m + 1);
+}
+
+/*
+@ function: 折叠连续的相同记录
+@ param: tag (const char *) 级别，例如"[erro]:"
+@ param: body (const char *) 去掉时间戳和级别后的内容，含换行
+@ param: len (int) body不含换行的长度
+@ param: date / date_len: 这一条的时间戳，用于汇总行
+@ param: now (time_t)
+@ param: summary (char *) 输出汇总行，没有时为空串
+@ param: summary_size (int)
+@ return: (bool) true表示这一条被折叠，不输出
+*/
+bool Log::collapse_repeat(const char *tag, const char *body, int len, const char *date, int date_len,
+                          time_t now, char *summary, int summary_size)
+{
+    summary[0] = '\0';
+    bool same = m_last_len == len && strcmp(m_last_tag, tag) == 0 && memcmp(m_last_buf, body, len) == 0;
+    if (same) {
+        if (m_repeat == 0)
+            m_repeat_start = now;
+        ++m_repeat;
+        //持续重复时定期汇总一次
+        if (now - m_repeat_start < LOG_REPEAT_REPORT)
+            return true;
+    }
+    if (m_repeat > 0) {
+        snprintf(summary, summary_size, "%.*s %s last message repeated %lld times\n",
+                 date_len, date, m_last_tag, m_repeat);
+        m_repeat = 0;
+    }
+    if (same)
+        return true;
+
+    memcpy(m_last_buf, body, len);
+    m_last_len = len;
+    strcpy(m_last_tag, tag);
+    return false;
+}
+
+/*
+@ function: 异步模式下把文件流的缓冲区放大到能装下一批未fflush的记录，
+            只有写线程显式fflush时才真正写文件，提交位置与文件内容一致，恢复时不会重复补写
+@ return: 无
+*/
+void Log::set_stream_buffer()
+{
+    if (m_fp == nullptr || !m_is_async)
+        return;
+    //glibc在buf为NULL时忽略size，必须自己提供缓冲区；轮转时旧文件先fclose，新文件可以复用
+    if (m_stream_buf == nullptr)
+        m_stream_buf = new char[LOG_FLUSH_BYTES + m_log_buf_size];
+    setvbuf(m_fp, m_stream_buf, _IOFBF, LOG_FLUSH_BYTES + m_log_buf_size);
+}
+
+void Log::set_rate_limit(int records_per_sec, int burst)
+{
+    Log_limiter::SetRate(records_per_sec, burst);
+}
+
+void Log_limiter::SetRate(int records_per_sec, int burst)
+{
+    long long interval = records_per_sec > 0 ? 1000000000LL / records_per_sec : 0;
+    if (burst < 1)
+        burst = 1;
+    u_tolerance_ns.store((burst - 1) * interval, std::memory_order_relaxed);
+    u_interval_ns.store(interval, std::memory_order_relaxed);
 }
 
 void Log::flush()
@@ -247,18 +457,52 @@ void Log::flush()
 
 void Log::async_flush()
 {
-    m_mutex.lock();
+    //写线程会在队列取空时fflush，记录在此之前已在环形缓冲区中，崩溃也不会丢失
+    if (m_ring.IsOpen() && m_is_async)
+        return;
+    TRACE_LOCK(m_mutex, "log.lock_wait");
     fflush(m_fp);
     m_mutex.unlock();
 }
 
 void Log::sync_flush()
 {
-    m_mutex.lock();
+    TRACE_LOCK(m_mutex, "log.lock_wait");
     fflush(m_fp);
     m_mutex.unlock();
 }
 
+void Log::shutdown()
+{
+    if (m_thread_started) {
+        //写线程取完队列中剩余的日志后pop返回false，线程退出
+        m_log_queue->close();
+        pthread_join(m_thread, NULL);
+        m_thread_started = false;
+        m_is_async = false;
+    }
+
+    TRACE_LOCK(m_mutex, "log.lock_wait");
+    if (m_fp != nullptr) {
+        //写线程已退出，剩下的都已fputs，fflush后环形缓冲区中不再有未提交的记录
+        commit_flushed();
+        //最后一批被折叠的记录
+        if (m_repeat > 0) {
+            struct timeval now = {0, 0};
+            gettimeofday(&now, NULL);
+            time_t t = now.tv_sec;
+            struct tm my_tm = *localtime(&t);
+            fprintf(m_fp, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s last message repeated %lld times\n",
+                    my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
+                    my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, m_last_tag, m_repeat);
+            m_repeat = 0;
+        }
+        fflush(m_fp);
+        fsync(fileno(m_fp));
+    }
+    m_mutex.unlock();
+}
+
 void *Log::async_flush_thread(void *args)
 {
     Log::get_instance()->async_log();
@@ -6,10 +6,18 @@
 #include <string>
 #include <stdarg.h>
 #include <pthread.h>
+#include <time.h>
+#include <atomic>
 #include "block_queue.h"
+#include "log_ring.h"
+#include "log_format.h"
 
 using namespace std;
 
+// 写线程最多攒这么多字节，或空闲这么多毫秒后fflush
+const size_t LOG_FLUSH_BYTES = 64 * 1024;
+const int LOG_FLUSH_MS = 200;
+
 enum LogType {
     SYNC_LOG,   // 同步日志
     ASYNC_LOG   // 异步日志
@@ -64,6 +72,23 @@ public:
     void write_log(int level, const char *format, ...);
     void flush(void);
 
+    // 类型化接口：format由log_parse在编译期解析，参数不经过vsnprintf，一般通过LOGF_*宏调用
+    template <class... Args>
+    void write_log_fmt(int level, const Log_format &format, const Args &... args)
+    {
+        const Log_arg list[sizeof...(Args) + 1] = {Log_arg(args)...};
+        write_log_args(level, format, list, (int)sizeof...(Args));
+    }
+    void write_log_args(int level, const Log_format &format, const Log_arg *args, int nargs);
+
+    // 关闭前调用：关闭异步队列，等待写线程把剩余日志写完并回收，然后fflush + fsync；
+    // 之后的日志同步写入，可重复调用，析构时也会调用
+    void shutdown();
+
+    // 每个LOG_*调用点的限速：每秒records_per_sec条，允许突发burst条，超出的记录在格式化之前丢弃，
+    // 恢复后补一条被丢弃的条数；records_per_sec为0时不限速。默认每秒100条、突发200条
+    static void set_rate_limit(int records_per_sec, int burst);
+
     // 用于宏定义访问成员变量
     int get_close_log() const { return m_close_log; }
     static void *async_flush_thread(void *args);
@@ -81,17 +106,64 @@ private:
     void sync_write_log(int level, const char *format, va_list valst) override;
     void async_flush() override;
     void sync_flush() override;
+
+    // 一条记录的正文：printf格式串和va_list，或编译期解析的格式串和类型化参数（fmt不为空时）
+    struct Log_body
+    {
+        const char *format;
+        va_list *valst;
+        const Log_format *fmt;
+        const Log_arg *args;
+        int nargs;
+    };
+    void async_write_body(int level, const Log_body &body);
+    void sync_write_body(int level, const Log_body &body);
+    // 正文写进buf，最多size - 1字节，返回截断后的长度
+    int format_body(char *buf, int size, const Log_body &body);
+    // 在m_mutex内调用：时间戳和级别写进m_buf，返回长度
+    int write_prefix(const struct tm &tm, long usec, const char *tag);
+
+    // 在m_mutex内调用：与上一条内容和级别都相同时只计数，返回true；
+    // 否则把被折叠记录的汇总行写进summary（没有时为空串），并把这一条记为上一条
+    bool collapse_repeat(const char *tag, const char *body, int len, const char *date, int date_len,
+                         time_t now, char *summary, int summary_size);
     
     void *async_log()
     {
         string single_log;
-        //从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log))
+        //从阻塞队列中取出一个日志string，写入文件；
+        //记录已暂存在环形缓冲区中，不必每条都fflush：攒够一批或空闲LOG_FLUSH_MS后才fflush并推进提交位置
+        while (true)
         {
+            if (!m_log_queue->pop(single_log, LOG_FLUSH_MS))
+            {
+                m_mutex.lock();
+                if (m_unflushed > 0)
+                    commit_flushed();
+                m_mutex.unlock();
+                //已关闭且取空
+                if (m_log_queue->closed() && m_log_queue->empty())
+                    break;
+                continue;
+            }
             m_mutex.lock();
             fputs(single_log.c_str(), m_fp);
+            m_unflushed += single_log.size();
+            if (m_unflushed >= LOG_FLUSH_BYTES)
+                commit_flushed();
             m_mutex.unlock();
         }
+        return NULL;
+    }
+
+    void set_stream_buffer();
+
+    // 在m_mutex内调用：fflush并把已写入的字节标记为已提交
+    void commit_flushed()
+    {
+        fflush(m_fp);
+        m_ring.Commit(m_unflushed);
+        m_unflushed = 0;
     }
 
     static LogType m_log_type;  // 日志类型
@@ -105,22 +177,121 @@ private:
     int m_today;               // 按天分类记录当前日期
     FILE *m_fp;                // 打开log的文件指针
     char *m_buf;
-    locker m_mutex;
+    Profiled_locker m_mutex;
     int m_close_log;           // 关闭日志标志
     
     // 异步日志特有成员
-    block_queue<string> *m_log_queue; // 阻塞队列
+    block_queue<string, spsc_policy> *m_log_queue; // 阻塞队列，只在m_mutex内push，只有写线程pop
     bool m_is_async;                 // 是否异步标志位
+    pthread_t m_thread;              // 异步写线程
+    bool m_thread_started;           // 异步写线程已创建且尚未回收
+    Log_ring m_ring;                 // 已入队记录的崩溃保护副本，打开失败时退回每条fflush
+    size_t m_unflushed;              // 写线程已fputs但还没有fflush的字节数
+    char *m_stream_buf;              // 文件流的缓冲区，保证只有显式fflush才写文件
+
+    // 连续重复记录的折叠
+    char *m_last_buf;          // 上一条记录去掉时间戳后的内容
+    int m_last_len;
+    char m_last_tag[16];       // 上一条记录的级别
+    long long m_repeat;        // 上一条之后被折叠的相同记录数
+    time_t m_repeat_start;     // 第一条被折叠的时刻，折叠超过LOG_REPEAT_REPORT秒先输出一次汇总
 
     // 禁止拷贝
     Log(const Log&) = delete;
     Log& operator=(const Log&) = delete;
 };
 
-// 保持原有宏定义，但改为使用get_close_log()
-#define LOG_DEBUG(format, ...) if(0 == Log::get_instance()->get_close_log()) {Log::get_instance()->write_log(0, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_INFO(format, ...) if(0 == Log::get_instance()->get_close_log()) {Log::get_instance()->write_log(1, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_WARN(format, ...) if(0 == Log::get_instance()->get_close_log()) {Log::get_instance()->write_log(2, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_ERROR(format, ...) if(0 == Log::get_instance()->get_close_log()) {Log::get_instance()->write_log(3, format, ##__VA_ARGS__); Log::get_instance()->flush();}
+/*
+class: Log_limiter
+单个日志调用点的令牌桶
+@ function: 用GCRA实现，整个状态是一个原子变量（下一个令牌的理论到达时刻），
+            判断只需一次读取和一次CAS，不加锁、不格式化，被拒绝的记录只做一次原子加；
+            时钟用CLOCK_MONOTONIC_COARSE，精度为毫秒级，对每秒上百条的限速足够
+@ func: Allow()
+@ param suppressed: (long long *) 放行时返回自上次放行以来被丢弃的条数
+@ return: (bool) 是否放行
+
+@ func: SetRate() 静态函数，见Log::set_rate_limit
+*/
+class Log_limiter
+{
+public:
+    Log_limiter() : m_tat(0), m_suppressed(0) {}
+
+    bool Allow(long long *suppressed)
+    {
+        long long interval = u_interval_ns.load(std::memory_order_relaxed);
+        *suppressed = 0;
+        if (interval == 0)
+            return true;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        long long tolerance = u_tolerance_ns.load(std::memory_order_relaxed);
+
+        long long tat = m_tat.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (tat - now > tolerance)
+            {
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                METRICS_COUNT("log.rate_limited", 1);
+                return false;
+            }
+            long long next = (tat > now ? tat : now) + interval;
+            if (m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+                break;
+        }
+        if (m_suppressed.load(std::memory_order_relaxed) > 0)
+            *suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    static void SetRate(int records_per_sec, int burst);
+
+private:
+    std::atomic<long long> m_tat;
+    std::atomic<long long> m_suppressed;
+
+    // 两条记录之间的间隔，0为不限速
+    static std::atomic<long long> u_interval_ns;
+    // 允许超前的时间，即(burst - 1) * interval
+    static std::atomic<long long> u_tolerance_ns;
+};
+
+// 保持原有宏定义，但改为使用get_close_log()；每个调用点先经过自己的Log_limiter，被限速的记录不格式化
+#define LOG_WRITE(level, format, ...) if(0 == Log::get_instance()->get_close_log()) { \
+    static Log_limiter log_limiter_; \
+    long long log_suppressed_; \
+    if (log_limiter_.Allow(&log_suppressed_)) { \
+        if (log_suppressed_ > 0) \
+            Log::get_instance()->write_log(level, "rate limit suppressed %lld records at %s:%d", log_suppressed_, __FILE__, __LINE__); \
+        Log::get_instance()->write_log(level, format, ##__VA_ARGS__); \
+        Log::get_instance()->flush(); \
+    }}
+#define LOG_DEBUG(format, ...) LOG_WRITE(0, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_WRITE(1, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_WRITE(2, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_WRITE(3, format, ##__VA_ARGS__)
+
+// 类型化的日志宏，格式串必须是字面量，用{}占位（见log_format.h）；
+// 格式串在编译期解析，格式有误或占位符个数与参数个数不一致时编译失败；限速与LOG_WRITE相同
+#define LOG_WRITE_FMT(level, format, ...) if(0 == Log::get_instance()->get_close_log()) { \
+    static constexpr Log_format log_format_ = log_parse(format); \
+    static_assert(log_format_.valid, "invalid log format: " format); \
+    static_assert(log_format_.args == decltype(log_arg_count(__VA_ARGS__))::size, \
+                  "log format placeholders do not match arguments: " format); \
+    static Log_limiter log_limiter_; \
+    long long log_suppressed_; \
+    if (log_limiter_.Allow(&log_suppressed_)) { \
+        if (log_suppressed_ > 0) \
+            Log::get_instance()->write_log(level, "rate limit suppressed %lld records at %s:%d", log_suppressed_, __FILE__, __LINE__); \
+        Log::get_instance()->write_log_fmt(level, log_format_, ##__VA_ARGS__); \
+        Log::get_instance()->flush(); \
+    }}
+#define LOGF_DEBUG(format, ...) LOG_WRITE_FMT(0, format, ##__VA_ARGS__)
+#define LOGF_INFO(format, ...) LOG_WRITE_FMT(1, format, ##__VA_ARGS__)
+#define LOGF_WARN(format, ...) LOG_WRITE_FMT(2, format, ##__VA_ARGS__)
+#define LOGF_ERROR(format, ...) LOG_WRITE_FMT(3, format, ##__VA_ARGS__)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,427 @@
+/*************************************************************
+*日志的编译期格式串和类型化格式化
+*格式串用{}占位，在编译期解析成字面量片段和占位符，占位符个数不对或格式串有误时编译失败；
+*参数按实际类型转成Log_arg，由手写的整数/浮点/字符串格式化函数直接写进日志缓冲区，
+*不经过vsnprintf，运行时不再逐字符解析格式串，也不会因为%d配了long而出错
+*占位符：{} 按类型默认输出，{:x} 整数十六进制，{:.N} 或 {:.Nf} 浮点保留N位小数（N不超过9），
+*{{ 和 }} 输出花括号本身
+**************************************************************/
+
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+//一个格式串最多的片段数（字面量和占位符合计）
+const int LOG_FORMAT_MAX_OPS = 32;
+
+//单个数值格式化后的最大长度
+const int LOG_FORMAT_NUM_SIZE = 48;
+
+enum LOG_FORMAT_OP
+{
+    LOG_OP_LITERAL,   // 字面量 text[begin, begin + len)
+    LOG_OP_ARG,       // {}
+    LOG_OP_HEX,       // {:x}
+    LOG_OP_FIXED      // {:.Nf}，precision为N
+};
+
+struct Log_format_op
+{
+    int kind;
+    int precision;
+    int begin;
+    int len;
+};
+
+/*
+struct: Log_format
+@ function: log_parse()的结果，只在编译期构造，按顺序执行ops即得到正文；
+            valid为false时由宏里的static_assert报错
+*/
+struct Log_format
+{
+    const char *text = nullptr;
+    int ops = 0;
+    int args = 0;
+    bool valid = false;
+    Log_format_op op[LOG_FORMAT_MAX_OPS] = {};
+};
+
+constexpr bool log_add_op(Log_format &f, int kind, int precision, int begin, int len)
+{
+    if (kind == LOG_OP_LITERAL && len == 0)
+        return true;
+    if (f.ops >= LOG_FORMAT_MAX_OPS)
+        return false;
+    f.op[f.ops].kind = kind;
+    f.op[f.ops].precision = precision;
+    f.op[f.ops].begin = begin;
+    f.op[f.ops].len = len;
+    ++f.ops;
+    if (kind != LOG_OP_LITERAL)
+        ++f.args;
+    return true;
+}
+
+/*
+@ function: 把格式串解析成片段，只在编译期调用（见LOG_WRITE_FMT）
+@ param: text (const char *) 字符串字面量
+@ return: (Log_format) 格式有误或片段过多时valid为false
+*/
+constexpr Log_format log_parse(const char *text)
+{
+    Log_format f{};
+    f.text = text;
+    int i = 0;
+    int lit = 0;
+    while (text[i] != '\0')
+    {
+        char c = text[i];
+        if ((c == '{' && text[i + 1] == '{') || (c == '}' && text[i + 1] == '}'))
+        {
+            //字面量带上第一个花括号，跳过第二个
+            if (!log_add_op(f, LOG_OP_LITERAL, 0, lit, i + 1 - lit))
+                return f;
+            i += 2;
+            lit = i;
+            continue;
+        }
+        if (c == '}')
+            return f;
+        if (c != '{')
+        {
+            ++i;
+            continue;
+        }
+        if (!log_add_op(f, LOG_OP_LITERAL, 0, lit, i - lit))
+            return f;
+        ++i;
+        int kind = LOG_OP_ARG;
+        int precision = 0;
+        if (text[i] == ':')
+        {
+            ++i;
+            if (text[i] == 'x')
+            {
+                kind = LOG_OP_HEX;
+                ++i;
+            }
+            else if (text[i] == '.')
+            {
+                kind = LOG_OP_FIXED;
+                ++i;
+                if (text[i] < '0' || text[i] > '9' || (text[i + 1] >= '0' && text[i + 1] <= '9'))
+                    return f;
+                precision = text[i] - '0';
+                ++i;
+                if (text[i] == 'f')
+                    ++i;
+            }
+        }
+        if (text[i] != '}')
+            return f;
+        ++i;
+        if (!log_add_op(f, kind, precision, 0, 0))
+            return f;
+        lit = i;
+    }
+    if (!log_add_op(f, LOG_OP_LITERAL, 0, lit, i - lit))
+        return f;
+    f.valid = true;
+    return f;
+}
+
+//只用于在decltype中数参数个数，不需要定义
+template <int N>
+struct Log_arg_count
+{
+    static const int size = N;
+};
+
+template <class... Args>
+Log_arg_count<sizeof...(Args)> log_arg_count(const Args &...);
+
+enum LOG_ARG_TYPE
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_CHAR,
+    LOG_ARG_BOOL,
+    LOG_ARG_PTR
+};
+
+/*
+class: Log_arg
+@ function: 类型擦除后的一个参数，由构造函数的重载决定类型；
+            字符串只保存指针和长度，调用方的参数在格式化完成前一直有效
+*/
+class Log_arg
+{
+public:
+    Log_arg() : m_type(LOG_ARG_INT) { m_value.i = 0; }
+    Log_arg(int v) : m_type(LOG_ARG_INT) { m_value.i = v; }
+    Log_arg(long v) : m_type(LOG_ARG_INT) { m_value.i = v; }
+    Log_arg(long long v) : m_type(LOG_ARG_INT) { m_value.i = v; }
+    Log_arg(unsigned v) : m_type(LOG_ARG_UINT) { m_value.u = v; }
+    Log_arg(unsigned long v) : m_type(LOG_ARG_UINT) { m_value.u = v; }
+    Log_arg(unsigned long long v) : m_type(LOG_ARG_UINT) { m_value.u = v; }
+    Log_arg(double v) : m_type(LOG_ARG_DOUBLE) { m_value.d = v; }
+    Log_arg(long double v) : m_type(LOG_ARG_DOUBLE) { m_value.d = (double)v; }
+    Log_arg(char v) : m_type(LOG_ARG_CHAR) { m_value.c = v; }
+    Log_arg(bool v) : m_type(LOG_ARG_BOOL) { m_value.b = v; }
+    Log_arg(const char *v) : m_type(LOG_ARG_STR)
+    {
+        if (v == NULL)
+            v = "(null)";
+        m_value.s.p = v;
+        m_value.s.n = strlen(v);
+    }
+    Log_arg(const std::string &v) : m_type(LOG_ARG_STR)
+    {
+        m_value.s.p = v.data();
+        m_value.s.n = v.size();
+    }
+    template <class T>
+    Log_arg(const T *v) : m_type(LOG_ARG_PTR) { m_value.p = (const void *)v; }
+
+    int m_type;
+    union
+    {
+        long long i;
+        unsigned long long u;
+        double d;
+        char c;
+        bool b;
+        const void *p;
+        struct
+        {
+            const char *p;
+            size_t n;
+        } s;
+    } m_value;
+};
+
+static const char LOG_DIGITS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/*
+@ function: 十进制无符号整数，每次除以100取两位查表
+@ param: out (char *) 至少20字节
+@ return: (int) 写入的字节数
+*/
+inline int log_fmt_uint(char *out, unsigned long long v)
+{
+    char tmp[20];
+    int i = 20;
+    while (v >= 100)
+    {
+        int d = (int)(v % 100) * 2;
+        v /= 100;
+        tmp[--i] = LOG_DIGITS[d + 1];
+        tmp[--i] = LOG_DIGITS[d];
+    }
+    if (v >= 10)
+    {
+        tmp[--i] = LOG_DIGITS[v * 2 + 1];
+        tmp[--i] = LOG_DIGITS[v * 2];
+    }
+    else
+        tmp[--i] = (char)('0' + v);
+    memcpy(out, tmp + i, 20 - i);
+    return 20 - i;
+}
+
+inline int log_fmt_int(char *out, long long v)
+{
+    if (v >= 0)
+        return log_fmt_uint(out, (unsigned long long)v);
+    out[0] = '-';
+    return 1 + log_fmt_uint(out + 1, 0ULL - (unsigned long long)v);
+}
+
+inline int log_fmt_hex(char *out, unsigned long long v)
+{
+    char tmp[16];
+    int i = 16;
+    do
+    {
+        tmp[--i] = "0123456789abcdef"[v & 0xf];
+        v >>= 4;
+    } while (v != 0);
+    memcpy(out, tmp + i, 16 - i);
+    return 16 - i;
+}
+
+//定宽补零，width位以内
+inline void log_fmt_pad(char *out, unsigned v, int width)
+{
+    for (int i = width - 1; i >= 0; --i)
+    {
+        out[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+}
+
+/*
+@ function: 定点小数，与%.Nf一致；整数部分用整数格式化，小数部分放大10^N后四舍五入；
+            绝对值不小于1e15时小数部分放大后会丢精度，交给snprintf按%.17g输出；
+            放大时有舍入误差，非常接近中点的值末位可能与printf不同
+@ param: out (char *) 至少LOG_FORMAT_NUM_SIZE字节
+@ param: precision (int) 0到9
+@ return: (int) 写入的字节数
+*/
+inline int log_fmt_double(char *out, double v, int precision)
+{
+    static const unsigned long long scale[] = {1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+                                               1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL};
+    if (v != v)
+    {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+    if (v >= 1e15 || v <= -1e15)
+        return snprintf(out, LOG_FORMAT_NUM_SIZE, "%.*g", 17, v);
+    int n = 0;
+    if (v < 0 || (v == 0 && 1 / v < 0))
+    {
+        out[n++] = '-';
+        v = -v;
+    }
+    unsigned long long ip = (unsigned long long)v;
+    double scaled = (v - (double)ip) * (double)scale[precision];
+    unsigned long long fp = (unsigned long long)scaled;
+    //恰好在中点上时与glibc一样向偶数舍入
+    double rest = scaled - (double)fp;
+    if (rest > 0.5 || (rest == 0.5 && ((precision > 0 ? fp : ip) & 1)))
+        ++fp;
+    if (fp >= scale[precision])
+    {
+        ++ip;
+        fp -= scale[precision];
+    }
+    n += log_fmt_uint(out + n, ip);
+    if (precision > 0)
+    {
+        out[n++] = '.';
+        for (int i = n + precision - 1; i >= n; --i)
+        {
+            out[i] = (char)('0' + fp % 10);
+            fp /= 10;
+        }
+        n += precision;
+    }
+    return n;
+}
+
+/*
+@ function: 时间戳前缀，与"%d-%02d-%02d %02d:%02d:%02d.%06ld"一致
+@ param: out (char *) 至少LOG_FORMAT_NUM_SIZE字节
+@ return: (int) 写入的字节数
+*/
+inline int log_fmt_time(char *out, const struct tm &tm, long usec)
+{
+    int n = log_fmt_int(out, tm.tm_year + 1900);
+    out[n] = '-';
+    log_fmt_pad(out + n + 1, tm.tm_mon + 1, 2);
+    out[n + 3] = '-';
+    log_fmt_pad(out + n + 4, tm.tm_mday, 2);
+    out[n + 6] = ' ';
+    log_fmt_pad(out + n + 7, tm.tm_hour, 2);
+    out[n + 9] = ':';
+    log_fmt_pad(out + n + 10, tm.tm_min, 2);
+    out[n + 12] = ':';
+    log_fmt_pad(out + n + 13, tm.tm_sec, 2);
+    out[n + 15] = '.';
+    log_fmt_pad(out + n + 16, (unsigned)usec, 6);
+    return n + 22;
+}
+
+/*
+@ function: 按解析好的格式串把参数写进buf，超出时截断
+@ param: buf (char *)
+@ param: size (int) buf的大小，结果以'\0'结尾
+@ param: format (const Log_format &)
+@ param: args (const Log_arg *) / nargs (int) 个数与format.args一致（宏里已检查）
+@ return: (int) 写入的字节数，不含'\0'
+*/
+inline int log_format_to(char *buf, int size, const Log_format &format, const Log_arg *args, int nargs)
+{
+    if (size <= 0)
+        return 0;
+    char num[LOG_FORMAT_NUM_SIZE];
+    int pos = 0;
+    int room = size - 1;
+    int next = 0;
+    for (int i = 0; i < format.ops && pos < room; ++i)
+    {
+        const Log_format_op &op = format.op[i];
+        const char *src = num;
+        int len = 0;
+        if (op.kind == LOG_OP_LITERAL)
+        {
+            src = format.text + op.begin;
+            len = op.len;
+        }
+        else if (next < nargs)
+        {
+            const Log_arg &arg = args[next++];
+            switch (arg.m_type)
+            {
+            case LOG_ARG_INT:
+                if (op.kind == LOG_OP_HEX)
+                    len = log_fmt_hex(num, (unsigned long long)arg.m_value.i);
+                else
+                    len = log_fmt_int(num, arg.m_value.i);
+                break;
+            case LOG_ARG_UINT:
+                if (op.kind == LOG_OP_HEX)
+                    len = log_fmt_hex(num, arg.m_value.u);
+                else
+                    len = log_fmt_uint(num, arg.m_value.u);
+                break;
+            case LOG_ARG_DOUBLE:
+                len = log_fmt_double(num, arg.m_value.d, op.kind == LOG_OP_FIXED ? op.precision : 6);
+                break;
+            case LOG_ARG_STR:
+                src = arg.m_value.s.p;
+                len = (int)arg.m_value.s.n;
+                break;
+            case LOG_ARG_CHAR:
+                num[0] = arg.m_value.c;
+                len = 1;
+                break;
+            case LOG_ARG_BOOL:
+                src = arg.m_value.b ? "true" : "false";
+                len = arg.m_value.b ? 4 : 5;
+                break;
+            case LOG_ARG_PTR:
+                //与glibc的%p一致
+                if (arg.m_value.p == NULL)
+                {
+                    src = "(nil)";
+                    len = 5;
+                    break;
+                }
+                num[0] = '0';
+                num[1] = 'x';
+                len = 2 + log_fmt_hex(num + 2, (unsigned long long)(size_t)arg.m_value.p);
+                break;
+            }
+        }
+        if (len > room - pos)
+            len = room - pos;
+        memcpy(buf + pos, src, len);
+        pos += len;
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+#endif
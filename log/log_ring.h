@@ -0,0 +1,163 @@
+/*************************************************************
+*异步日志的崩溃保护环形缓冲区
+*文件映射（MAP_SHARED）的环形缓冲区，异步日志入队的同时把记录复制进来，
+*写线程fflush之后推进提交位置；进程崩溃时映射的内容仍在页缓存中，
+*下次init时把提交位置之后的部分补写进日志文件
+*只保护进程崩溃，不保护掉电和内核崩溃
+**************************************************************/
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//数据区大小，超出时该条记录不经过环形缓冲区，由调用方同步写入
+const size_t LOG_RING_SIZE = 1024 * 1024;
+
+//文件头占一页，数据区按页对齐
+const size_t LOG_RING_HEADER = 4096;
+
+const uint64_t LOG_RING_MAGIC = 0x474e49524c4f4731ULL;
+
+/*
+class: Log_ring
+@ function: 写入位置和提交位置都是单调递增的字节数，取模得到数据区中的偏移；
+            两者之间就是已入队但还没有确定写进日志文件的记录。
+            所有操作都在Log::m_mutex内进行，不另外加锁
+public:
+@ func: Open()
+@ param path: (const char *) 映射文件，不存在或格式不对时重新创建
+@ return: (bool)
+
+@ func: Recover()
+@ param fp: (FILE *) 把未提交的部分追加到fp并fflush，然后全部标记为已提交
+@ return: (size_t) 补写的字节数
+
+@ func: Append()
+@ param data / len: 复制进环形缓冲区
+@ return: (bool) 剩余空间不足时返回false，不做任何修改
+
+@ func: Unappend()
+@ param len: (size_t) 撤销最近一次Append，入队失败时使用
+
+@ func: Commit()
+@ param len: (size_t) 又有len字节已经写进日志文件
+
+@ func: IsOpen()
+@ return: (bool)
+*/
+class Log_ring
+{
+public:
+    Log_ring() : m_header(NULL), m_data(NULL), m_fd(-1) {}
+
+    ~Log_ring() { Close(); }
+
+    bool Open(const char *path)
+    {
+        Close();
+        m_fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (m_fd < 0)
+            return false;
+        struct stat st;
+        bool fresh = fstat(m_fd, &st) != 0 || (size_t)st.st_size != LOG_RING_HEADER + LOG_RING_SIZE;
+        if (fresh && ftruncate(m_fd, LOG_RING_HEADER + LOG_RING_SIZE) != 0)
+        {
+            Close();
+            return false;
+        }
+        void *map = mmap(NULL, LOG_RING_HEADER + LOG_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (map == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+        m_header = (Header *)map;
+        m_data = (char *)map + LOG_RING_HEADER;
+        if (fresh || m_header->magic != LOG_RING_MAGIC || m_header->commit_pos > m_header->write_pos ||
+            m_header->write_pos - m_header->commit_pos > LOG_RING_SIZE)
+        {
+            m_header->write_pos = 0;
+            m_header->commit_pos = 0;
+            m_header->magic = LOG_RING_MAGIC;
+        }
+        return true;
+    }
+
+    size_t Recover(FILE *fp)
+    {
+        if (!m_header)
+            return 0;
+        size_t pending = m_header->write_pos - m_header->commit_pos;
+        size_t offset = m_header->commit_pos % LOG_RING_SIZE;
+        size_t first = pending < LOG_RING_SIZE - offset ? pending : LOG_RING_SIZE - offset;
+        if (pending > 0 && fp)
+        {
+            fwrite(m_data + offset, 1, first, fp);
+            fwrite(m_data, 1, pending - first, fp);
+            fflush(fp);
+        }
+        m_header->commit_pos = m_header->write_pos;
+        return pending;
+    }
+
+    bool Append(const char *data, size_t len)
+    {
+        if (!m_header || m_header->write_pos - m_header->commit_pos + len > LOG_RING_SIZE)
+            return false;
+        size_t offset = m_header->write_pos % LOG_RING_SIZE;
+        size_t first = len < LOG_RING_SIZE - offset ? len : LOG_RING_SIZE - offset;
+        memcpy(m_data + offset, data, first);
+        memcpy(m_data, data + first, len - first);
+        //先写数据再推进位置，崩溃在复制途中时这条记录不算入队
+        __atomic_store_n(&m_header->write_pos, m_header->write_pos + len, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    void Unappend(size_t len)
+    {
+        if (m_header)
+            m_header->write_pos -= len;
+    }
+
+    void Commit(size_t len)
+    {
+        if (m_header)
+            m_header->commit_pos += len;
+    }
+
+    bool IsOpen() const { return m_header != NULL; }
+
+    void Close()
+    {
+        if (m_header)
+            munmap(m_header, LOG_RING_HEADER + LOG_RING_SIZE);
+        if (m_fd >= 0)
+            close(m_fd);
+        m_header = NULL;
+        m_data = NULL;
+        m_fd = -1;
+    }
+
+private:
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t write_pos;
+        uint64_t commit_pos;
+    };
+
+    Header *m_header;
+    char *m_data;
+    int m_fd;
+
+    Log_ring(const Log_ring &);
+    Log_ring &operator=(const Log_ring &);
+};
+
+#endif
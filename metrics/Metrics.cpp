@@ -0,0 +1,335 @@
+#include "Metrics.h"
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../log/log.h"
+
+//下一个线程分到的分片
+static int g_next_shard = 0;
+
+/*
+@ function: 分配分片编号
+@ return: (int)
+*/
+int MetricsNextShard(){
+    return __atomic_fetch_add(&g_next_shard, 1, __ATOMIC_RELAXED) % METRICS_SHARDS;
+}
+
+static long long now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**********Metrics_counter********** */
+Metrics_counter::Metrics_counter(){
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+/*
+@ function: 汇总所有分片
+@ return: (long)
+*/
+long Metrics_counter::Value() const{
+    long value = 0;
+    for(int i = 0; i < METRICS_SHARDS; ++i){
+        value += __atomic_load_n(&m_slots[i].m_value, __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+/**********Metrics_histogram********** */
+Metrics_histogram::Metrics_histogram(){
+    memset(m_shards, 0, sizeof(m_shards));
+}
+
+/*
+@ function: 桶的中点，用于报告分位数
+@ param: index (int)
+@ return: (long)
+*/
+long Metrics_histogram::MiddleOf(int index){
+    if(index < (1 << METRICS_SUB_BITS)){
+        return index;
+    }
+    int shift = (index >> METRICS_SUB_BITS) - 1;
+    long lower = (long)((1 << METRICS_SUB_BITS) + (index & ((1 << METRICS_SUB_BITS) - 1))) << shift;
+    return lower + ((1L << shift) >> 1);
+}
+
+long Metrics_histogram::Count() const{
+    long count = 0;
+    for(int i = 0; i < METRICS_SHARDS; ++i){
+        for(int j = 0; j < METRICS_BUCKETS; ++j){
+            count += __atomic_load_n(&m_shards[i].m_buckets[j], __ATOMIC_RELAXED);
+        }
+    }
+    return count;
+}
+
+long Metrics_histogram::Sum() const{
+    long sum = 0;
+    for(int i = 0; i < METRICS_SHARDS; ++i){
+        sum += __atomic_load_n(&m_shards[i].m_sum, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+/*
+@ function: 合并所有分片后求分位数
+@ param: q (double) 0~1
+@ return: (long)
+*/
+long Metrics_histogram::Percentile(double q) const{
+    long buckets[METRICS_BUCKETS] = {0};
+    long count = 0;
+    for(int i = 0; i < METRICS_SHARDS; ++i){
+        for(int j = 0; j < METRICS_BUCKETS; ++j){
+            long n = __atomic_load_n(&m_shards[i].m_buckets[j], __ATOMIC_RELAXED);
+            buckets[j] += n;
+            count += n;
+        }
+    }
+    if(count == 0){
+        return 0;
+    }
+
+    long rank = (long)(q * (count - 1)) + 1;
+    long seen = 0;
+    for(int j = 0; j < METRICS_BUCKETS; ++j){
+        seen += buckets[j];
+        if(seen >= rank){
+            return MiddleOf(j);
+        }
+    }
+    return MiddleOf(METRICS_BUCKETS - 1);
+}
+
+/**********Metrics_registry********** */
+Metrics_registry::Metrics_registry(){
+    m_last_dump_ms = now_ms();
+    m_interval = 0;
+    m_listenfd = -1;
+    m_stop = false;
+    m_started = false;
+}
+
+/*
+@ function: 单例随进程退出析构，指标对象不释放，
+            其他静态对象析构时可能仍在记录
+*/
+Metrics_registry::~Metrics_registry(){
+    Stop();
+}
+
+/*
+@ function: 按名字查找指标，不存在时创建
+@ param: metrics 同类指标表
+@ param: name (const char *)
+@ return: 指标指针
+*/
+template <class M>
+M *Metrics_registry::Find(std::vector<std::pair<std::string, M *> > &metrics, const char *name){
+    m_lock.lock();
+    for(size_t i = 0; i < metrics.size(); ++i){
+        if(metrics[i].first == name){
+            M *metric = metrics[i].second;
+            m_lock.unlock();
+            return metric;
+        }
+    }
+    M *metric = new M;
+    metrics.push_back(std::make_pair(std::string(name), metric));
+    m_lock.unlock();
+    return metric;
+}
+
+Metrics_counter *Metrics_registry::Counter(const char *name){
+    return Find(m_counters, name);
+}
+
+Metrics_gauge *Metrics_registry::Gauge(const char *name){
+    return Find(m_gauges, name);
+}
+
+Metrics_histogram *Metrics_registry::Histogram(const char *name){
+    return Find(m_histograms, name);
+}
+
+/*
+@ function: 生成文本快照
+@ param: out (std::string &)
+@ return: 无
+格式：
+counter <name> <value>
+gauge <name> <value>
+histogram <name> count=<n> sum=<n> p50=<n> p99=<n> p999=<n>
+*/
+void Metrics_registry::Snapshot(std::string &out){
+    char line[256];
+    out.clear();
+    m_lock.lock();
+    for(size_t i = 0; i < m_counters.size(); ++i){
+        snprintf(line, sizeof(line), "counter %s %ld\n", m_counters[i].first.c_str(), m_counters[i].second->Value());
+        out += line;
+    }
+    for(size_t i = 0; i < m_gauges.size(); ++i){
+        snprintf(line, sizeof(line), "gauge %s %ld\n", m_gauges[i].first.c_str(), m_gauges[i].second->Value());
+        out += line;
+    }
+    for(size_t i = 0; i < m_histograms.size(); ++i){
+        Metrics_histogram *hist = m_histograms[i].second;
+        snprintf(line, sizeof(line), "histogram %s count=%ld sum=%ld p50=%ld p99=%ld p999=%ld\n",
+                 m_histograms[i].first.c_str(), hist->Count(), hist->Sum(),
+                 hist->Percentile(0.50), hist->Percentile(0.99), hist->Percentile(0.999));
+        out += line;
+    }
+    m_lock.unlock();
+}
+
+/*
+@ function: 把快照写入Log
+@ return: 无
+计数器额外输出距上次写入的每秒增量，例如log.bytes的每秒字节数
+*/
+void Metrics_registry::DumpToLog(){
+    std::string snapshot;
+    Snapshot(snapshot);
+
+    long long now = now_ms();
+    double seconds = (now - m_last_dump_ms) / 1000.0;
+    m_last_dump_ms = now;
+
+    //写Log时不能持有m_lock：Log内部第一次记录指标时也要注册
+    char line[256];
+    std::string rates;
+    m_lock.lock();
+    m_last_values.resize(m_counters.size(), 0);
+    for(size_t i = 0; i < m_counters.size(); ++i){
+        long value = m_counters[i].second->Value();
+        double rate = seconds > 0 ? (value - m_last_values[i]) / seconds : 0.0;
+        m_last_values[i] = value;
+        snprintf(line, sizeof(line), "rate %s %.1f/s\n", m_counters[i].first.c_str(), rate);
+        rates += line;
+    }
+    m_lock.unlock();
+    snapshot += rates;
+
+    size_t start = 0;
+    while(start < snapshot.size()){
+        size_t end = snapshot.find('\n', start);
+        LOG_INFO("metrics %s", snapshot.substr(start, end - start).c_str());
+        start = end + 1;
+    }
+}
+
+/*
+@ function: 启动后台线程
+@ param: interval (int) 写Log间隔(秒)
+@ param: socket_path (const char *)
+@ return: (bool)
+*/
+bool Metrics_registry::Start(int interval, const char *socket_path){
+    if(m_started){
+        return true;
+    }
+    m_interval = interval;
+    m_stop = false;
+
+    if(socket_path){
+        m_listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(m_listenfd < 0){
+            return false;
+        }
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+        unlink(socket_path);
+        if(bind(m_listenfd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(m_listenfd, 5) < 0){
+            close(m_listenfd);
+            m_listenfd = -1;
+            return false;
+        }
+        m_socket_path = socket_path;
+    }
+
+    if(pthread_create(&m_thread, NULL, Worker, this) != 0){
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+/*
+@ function: 停止后台线程
+@ return: 无
+*/
+void Metrics_registry::Stop(){
+    if(!m_started){
+        return;
+    }
+    m_stop = true;
+    pthread_join(m_thread, NULL);
+    m_started = false;
+    if(m_listenfd >= 0){
+        close(m_listenfd);
+        m_listenfd = -1;
+        unlink(m_socket_path.c_str());
+    }
+}
+
+void *Metrics_registry::Worker(void *arg){
+    ((Metrics_registry *)arg)->Run();
+    return arg;
+}
+
+/*
+@ function: 后台线程主体，等待socket连接或写Log的时间到
+@ return: 无
+poll最多等待1秒，保证Stop()能及时返回
+*/
+void Metrics_registry::Run(){
+    long long next_dump = now_ms() + m_interval * 1000LL;
+    while(!m_stop){
+        long long wait = m_interval > 0 ? next_dump - now_ms() : 1000;
+        if(wait > 1000){
+            wait = 1000;
+        }
+        if(wait < 0){
+            wait = 0;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = m_listenfd;
+        pfd.events = POLLIN;
+        int number = poll(&pfd, m_listenfd >= 0 ? 1 : 0, (int)wait);
+
+        if(number > 0 && (pfd.revents & POLLIN)){
+            int connfd = accept4(m_listenfd, NULL, NULL, SOCK_CLOEXEC);
+            if(connfd >= 0){
+                std::string snapshot;
+                Snapshot(snapshot);
+                size_t sent = 0;
+                while(sent < snapshot.size()){
+                    ssize_t bytes = send(connfd, snapshot.data() + sent, snapshot.size() - sent, MSG_NOSIGNAL);
+                    if(bytes <= 0 && errno != EINTR){
+                        break;
+                    }
+                    sent += bytes > 0 ? bytes : 0;
+                }
+                close(connfd);
+            }
+        }
+
+        if(m_interval > 0 && now_ms() >= next_dump){
+            DumpToLog();
+            next_dump = now_ms() + m_interval * 1000LL;
+        }
+    }
+}
@@ -0,0 +1,255 @@
+#ifndef METRICS_H
+#define METRICS_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "../lock/locker.h"
+
+//计数器和直方图的分片数，每个线程固定写一个分片，读时汇总
+const int METRICS_SHARDS = 16;
+
+//直方图每个2的幂区间再分为4个桶，相对误差约25%，覆盖全部非负long
+const int METRICS_SUB_BITS = 2;
+const int METRICS_BUCKETS = (64 - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS;
+
+/*
+@ func: MetricsNextShard()
+@ function: 按轮询分配下一个分片编号
+@ return: (int) 0~METRICS_SHARDS-1
+
+@ func: MetricsShard()
+@ function: 当前线程使用的分片编号，线程第一次记录时分配，之后只读线程局部变量
+@ return: (int) 0~METRICS_SHARDS-1
+*/
+int MetricsNextShard();
+
+inline int MetricsShard()
+{
+    static thread_local int shard = -1;
+    if(__builtin_expect(shard < 0, 0)){
+        shard = MetricsNextShard();
+    }
+    return shard;
+}
+
+/*
+class: Metrics_counter
+分片计数器
+@ function: 只增不减的计数，每个分片独占一个缓存行，记录时只对本线程的分片做一次relaxed原子加，
+            读时把所有分片相加
+public:
+@ func: Add()
+@ param n: (long) 增量
+@ return: 无
+
+@ func: Value()
+@ return: (long) 所有分片之和
+*/
+class Metrics_counter{
+public:
+    Metrics_counter();
+
+    void Add(long n)
+    {
+        __atomic_fetch_add(&m_slots[MetricsShard()].m_value, n, __ATOMIC_RELAXED);
+    }
+
+    long Value() const;
+
+private:
+    struct Slot
+    {
+        long m_value;
+        char m_pad[64 - sizeof(long)];
+    };
+
+    Slot m_slots[METRICS_SHARDS];
+};
+
+/*
+class: Metrics_gauge
+瞬时值
+@ function: 队列深度、容器大小等可增可减的量，Set()直接覆盖，Add()用于多个实例共同维护一个总量
+*/
+class Metrics_gauge{
+public:
+    Metrics_gauge() : m_value(0) {}
+
+    void Set(long value) { __atomic_store_n(&m_value, value, __ATOMIC_RELAXED); }
+
+    void Add(long n) { __atomic_fetch_add(&m_value, n, __ATOMIC_RELAXED); }
+
+    long Value() const { return __atomic_load_n(&m_value, __ATOMIC_RELAXED); }
+
+private:
+    long m_value;
+};
+
+/*
+class: Metrics_histogram
+分片的对数-线性直方图
+@ function: 记录为一次桶号计算和一次relaxed原子加，读时合并所有分片
+public:
+@ func: Record()
+@ param value: (long) 样本，负数按0记录
+@ return: 无
+
+@ func: Percentile()
+@ param q: (double) 0~1
+@ return: (long) 分位数所在桶的中点
+
+@ func: Count() / Sum()
+@ return: (long) 样本数 / 样本和
+*/
+class Metrics_histogram{
+public:
+    Metrics_histogram();
+
+    void Record(long value)
+    {
+        Shard &shard = m_shards[MetricsShard()];
+        __atomic_fetch_add(&shard.m_buckets[IndexOf(value)], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard.m_sum, value > 0 ? value : 0, __ATOMIC_RELAXED);
+    }
+
+    long Percentile(double q) const;
+
+    long Count() const;
+
+    long Sum() const;
+
+private:
+    static int IndexOf(long value)
+    {
+        if(value < (1L << METRICS_SUB_BITS)){
+            return value > 0 ? (int)value : 0;
+        }
+        int exponent = 63 - __builtin_clzl((unsigned long)value);
+        return ((exponent - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+             + (int)((value >> (exponent - METRICS_SUB_BITS)) & ((1L << METRICS_SUB_BITS) - 1));
+    }
+
+    static long MiddleOf(int index);
+
+    struct Shard
+    {
+        long m_buckets[METRICS_BUCKETS];
+        long m_sum;
+    };
+
+    Shard m_shards[METRICS_SHARDS];
+};
+
+/*
+class: Metrics_registry
+指标注册表（单例）
+@ function: 按名字创建并持有指标，返回的指针在进程内一直有效，调用方缓存指针后记录不再加锁；
+            Snapshot()生成文本快照，可以周期性写入Log，也可以通过Unix socket按需读取
+public:
+@ func: GetInstance() 静态函数
+@ return: (Metrics_registry *)
+
+@ func: Counter() / Gauge() / Histogram()
+@ param name: (const char *) 指标名，同名返回同一个对象
+@ return: 指标指针
+
+@ func: Snapshot()
+@ param out: (std::string &) 传出参数，每个指标一行
+@ return: 无
+
+@ func: DumpToLog()
+@ function: 把快照逐行写入Log，计数器附带与上次写入相比的每秒增量
+@ return: 无
+
+@ func: Start()
+@ param interval: (int) 写入Log的间隔(秒)，<=0表示不写Log
+@ param socket_path: (const char *) Unix socket路径，NULL表示不监听；
+                     每个连接收到一份快照后关闭，例如 nc -U <path>
+@ return: (bool) 成功返回true
+
+@ func: Stop()
+@ function: 停止后台线程并删除socket文件
+@ return: 无
+*/
+class Metrics_registry{
+public:
+    static Metrics_registry *GetInstance()
+    {
+        static Metrics_registry instance;
+        return &instance;
+    }
+
+    Metrics_counter *Counter(const char *name);
+
+    Metrics_gauge *Gauge(const char *name);
+
+    Metrics_histogram *Histogram(const char *name);
+
+    void Snapshot(std::string &out);
+
+    void DumpToLog();
+
+    bool Start(int interval, const char *socket_path);
+
+    void Stop();
+
+private:
+    Metrics_registry();
+
+    ~Metrics_registry();
+
+    static void *Worker(void *arg);
+
+    void Run();
+
+    template <class M>
+    M *Find(std::vector<std::pair<std::string, M *> > &metrics, const char *name);
+
+    locker m_lock;
+
+    std::vector<std::pair<std::string, Metrics_counter *> > m_counters;
+
+    std::vector<std::pair<std::string, Metrics_gauge *> > m_gauges;
+
+    std::vector<std::pair<std::string, Metrics_histogram *> > m_histograms;
+
+    //上次DumpToLog()时的计数器值，用于计算每秒增量
+    std::vector<long> m_last_values;
+
+    long long m_last_dump_ms;
+
+    int m_interval;
+
+    int m_listenfd;
+
+    std::string m_socket_path;
+
+    volatile bool m_stop;
+
+    bool m_started;
+
+    pthread_t m_thread;
+};
+
+/*
+记录用的宏
+@ function: 第一次执行时按名字取得指标并缓存在函数内的静态变量中，之后只剩一次原子操作；
+            定义METRICS_DISABLE时全部展开为空
+*/
+#ifdef METRICS_DISABLE
+#define METRICS_COUNT(name, n) do {} while (0)
+#define METRICS_GAUGE_SET(name, value) do {} while (0)
+#define METRICS_GAUGE_ADD(name, n) do {} while (0)
+#define METRICS_RECORD(name, value) do {} while (0)
+#else
+#define METRICS_COUNT(name, n) do { static Metrics_counter *metrics_ = Metrics_registry::GetInstance()->Counter(name); metrics_->Add(n); } while (0)
+#define METRICS_GAUGE_SET(name, value) do { static Metrics_gauge *metrics_ = Metrics_registry::GetInstance()->Gauge(name); metrics_->Set(value); } while (0)
+#define METRICS_GAUGE_ADD(name, n) do { static Metrics_gauge *metrics_ = Metrics_registry::GetInstance()->Gauge(name); metrics_->Add(n); } while (0)
+#define METRICS_RECORD(name, value) do { static Metrics_histogram *metrics_ = Metrics_registry::GetInstance()->Histogram(name); metrics_->Record(value); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+#include "Event_Loop.h"
+
+//单次epoll_wait最多返回的事件数
+static const int MAX_EVENT_NUMBER = 10000;
+
+/**********Event_loop********** */
+/*
+@ function: 基础构造函数
+@ return: 无
+*/
+Event_loop::Event_loop(){
+    m_epollfd = -1;
+    m_user_data = NULL;
+    m_group = NULL;
+    m_index = 0;
+    m_listenfd = -1;
+    m_wakeupfd = -1;
+    m_TIMESLOT = 5;
+    m_TRIGMode = 0;
+    m_stop = false;
+    m_started = false;
+    m_on_conn = NULL;
+    m_on_io = NULL;
+    LOCK_NAME(m_pending_lock, "event_loop.pending");
+}
+
+/*
+@ function: 基础析构函数，停止线程并关闭本循环持有的fd
+@ return: 无
+*/
+Event_loop::~Event_loop(){
+    Stop();
+    if(m_wakeupfd >= 0){
+        close(m_wakeupfd);
+    }
+    if(m_epollfd >= 0){
+        close(m_epollfd);
+    }
+}
+
+/*
+@ function: 初始化事件循环，创建epoll和eventfd
+@ param: index (int) 事件循环编号
+@ param: listenfd (int) 监听fd，-1表示不负责accept
+@ param: timeslot (int) 定时器检查间隔(秒)
+@ param: TRIGMode (int) 连接fd触发模式
+@ return: (bool) 成功返回true
+*/
+bool Event_loop::Init(int index, int listenfd, int timeslot, int TRIGMode){
+    m_index = index;
+    m_listenfd = listenfd;
+    m_TIMESLOT = timeslot;
+    m_TRIGMode = TRIGMode;
+    m_utils.Init(timeslot);
+    m_timer_list.set_batch_callback(cb_func, cb_func_batch);
+    m_timer_list.set_default_slack(timeslot);
+    m_timer_list.add_class(3 * timeslot);
+
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if(m_epollfd < 0){
+        return false;
+    }
+
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_wakeupfd < 0){
+        return false;
+    }
+
+    epoll_event event;
+    event.data.fd = m_wakeupfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakeupfd, &event);
+
+    //监听fd使用LT模式，HandleAccept内循环accept直到EAGAIN
+    if(m_listenfd >= 0){
+        event.data.fd = m_listenfd;
+        event.events = EPOLLIN;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_listenfd, &event);
+    }
+    return true;
+}
+
+/*
+@ function: 设置新连接回调和读写事件回调
+@ param: on_conn (Conn_handler)
+@ param: on_io (Io_handler)
+@ return: 无
+*/
+void Event_loop::SetHandlers(Conn_handler on_conn, Io_handler on_io){
+    m_on_conn = on_conn;
+    m_on_io = on_io;
+}
+
+/*
+@ function: 创建事件循环线程
+@ return: (bool) 成功返回true
+*/
+bool Event_loop::Start(){
+    if(m_started){
+        return true;
+    }
+    m_stop = false;
+    if(pthread_create(&m_thread, NULL, Worker, this) != 0){
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+/*
+@ function: 通知事件循环退出，等待线程结束
+@ return: 无
+*/
+void Event_loop::Stop(){
+    if(!m_started){
+        return;
+    }
+    m_stop = true;
+    uint64_t one = 1;
+    write(m_wakeupfd, &one, sizeof(one));
+    pthread_join(m_thread, NULL);
+    m_started = false;
+}
+
+/*
+@ function: 把其他线程accept到的连接转交给本循环
+@ param: connfd (int)
+@ param: address (const sockaddr_in &)
+@ return: (bool) 成功返回true
+*/
+bool Event_loop::QueueConn(int connfd, const sockaddr_in &address){
+    m_pending_lock.lock();
+    bool was_empty = m_pending.empty();
+    m_pending.push_back(std::make_pair(connfd, address));
+    m_pending_lock.unlock();
+
+    //队列原本非空说明已经有一次唤醒在路上，不必重复写eventfd
+    if(was_empty){
+        uint64_t one = 1;
+        if(write(m_wakeupfd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN){
+            return false;
+        }
+    }
+    return true;
+}
+
+void *Event_loop::Worker(void *arg){
+    Event_loop *loop = (Event_loop *)arg;
+    loop->Run();
+    return loop;
+}
+
+/*
+@ function: 事件循环主体
+@ return: 无
+不使用SIGALRM（alarm是进程级的，无法区分事件循环），而是用epoll_wait的超时驱动本循环的tick()
+*/
+void Event_loop::Run(){
+    //cb_func通过Utils::CurrentEpollfd()找到本循环的epoll
+    Utils::u_loop_epollfd = m_epollfd;
+
+    epoll_event *events = new epoll_event[MAX_EVENT_NUMBER];
+    bool more = false;
+
+    while(!m_stop){
+        //没有定时器时无限期等待，m_stop由Stop()通过eventfd唤醒
+        time_t now = time(NULL);
+        time_t wake = more ? now : m_timer_list.next_expiry();
+        int timeout = -1;
+        if(wake != 0){
+            //按毫秒等到整秒之后，不受time(NULL)粗粒度的影响
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            long long ms = (long long)(wake - ts.tv_sec) * 1000 - ts.tv_nsec / 1000000 + TIMER_WAKE_MARGIN_NS / 1000000;
+            timeout = ms > 0 ? (int)ms : 0;
+        }
+
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, timeout);
+        if(number < 0 && errno != EINTR){
+            LOG_ERROR("loop %d epoll failure", m_index);
+            break;
+        }
+
+        for(int i = 0; i < number; ++i){
+            int sockfd = events[i].data.fd;
+            if(sockfd == m_listenfd){
+                HandleAccept();
+            }else if(sockfd == m_wakeupfd){
+                HandleWakeup();
+            }else if(m_on_io){
+                m_on_io(this, sockfd, events[i].events);
+            }
+        }
+
+        //预算用完还有到期定时器时，下一轮epoll_wait不阻塞，先处理就绪的I/O再继续tick；
+        //唤醒时间按各定时器的合并窗口计算，窗口内到期的定时器在同一次tick()中处理
+        now = time(NULL);
+        more = false;
+        if(wake != 0 && now >= wake){
+            more = m_timer_list.tick();
+        }
+    }
+
+    delete[] events;
+    Utils::u_loop_epollfd = 0;
+}
+
+/*
+@ function: 在监听fd上accept所有等待的连接
+@ return: 无
+reuse_port模式下连接直接注册到本循环，转交模式下按轮询分给各个循环
+*/
+void Event_loop::HandleAccept(){
+    while(true){
+        struct sockaddr_in client_address;
+        int connfd = m_utils.Accept(m_listenfd, &client_address);
+        if(connfd < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                LOG_ERROR("loop %d accept error:errno is:%d", m_index, errno);
+            }
+            return;
+        }
+
+        Event_loop *target = m_group ? m_group->Next() : this;
+        if(target == this){
+            RegisterConn(connfd, client_address);
+        }else if(!target->QueueConn(connfd, client_address)){
+            Utils::ForgetFd(connfd);
+            close(connfd);
+        }
+    }
+}
+
+/*
+@ function: 处理eventfd唤醒，注册所有转交过来的连接
+@ return: 无
+*/
+void Event_loop::HandleWakeup(){
+    uint64_t count;
+    read(m_wakeupfd, &count, sizeof(count));
+
+    std::vector<std::pair<int, sockaddr_in> > pending;
+    m_pending_lock.lock();
+    pending.swap(m_pending);
+    m_pending_lock.unlock();
+
+    for(size_t i = 0; i < pending.size(); ++i){
+        RegisterConn(pending[i].first, pending[i].second);
+    }
+}
+
+/*
+@ function: 把连接注册到本循环的epoll
+@ param: connfd (int)
+@ param: address (const sockaddr_in &)
+@ return: 无
+连接只由本循环线程处理，不需要EPOLLONESHOT
+*/
+void Event_loop::RegisterConn(int connfd, const sockaddr_in &address){
+    m_utils.Addfd(m_epollfd, connfd, false, m_TRIGMode);
+    if(m_on_conn){
+        m_on_conn(this, connfd, address);
+    }
+}
+
+
+/**********Event_loop_group********** */
+/*
+@ function: 基础构造函数
+@ return: 无
+*/
+Event_loop_group::Event_loop_group(){
+    m_loop_number = 0;
+    m_loops = NULL;
+    m_next = 0;
+    m_port = 0;
+}
+
+/*
+@ function: 基础析构函数，停止所有循环并关闭监听fd
+@ return: 无
+*/
+Event_loop_group::~Event_loop_group(){
+    Stop();
+    delete[] m_loops;
+    for(size_t i = 0; i < m_listenfds.size(); ++i){
+        close(m_listenfds[i]);
+    }
+}
+
+/*
+@ function: 创建监听fd
+@ param: port (int)
+@ param: reuse_port (bool)
+@ return: (int) 监听fd，失败返回-1
+*/
+int Event_loop_group::OpenListenFd(int port, bool reuse_port){
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenfd < 0){
+        return -1;
+    }
+
+    int flag = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    if(reuse_port && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) < 0){
+        close(listenfd);
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    //高连接速率下backlog太小会让SYN被丢弃、客户端等待重传，取系统允许的最大值（受net.core.somaxconn限制）
+    if(bind(listenfd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenfd, SOMAXCONN) < 0){
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+/*
+@ function: 初始化事件循环组
+@ return: (bool) 成功返回true
+*/
+bool Event_loop_group::Init(int loop_number, int port, int timeslot, int TRIGMode, bool reuse_port,
+                            Conn_handler on_conn, Io_handler on_io){
+    if(loop_number <= 0){
+        loop_number = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(loop_number <= 0){
+            loop_number = 1;
+        }
+    }
+    m_loop_number = loop_number;
+    m_loops = new Event_loop[m_loop_number];
+
+    for(int i = 0; i < m_loop_number; ++i){
+        int listenfd = -1;
+        //reuse_port模式每个循环一个监听fd，转交模式只有0号循环监听
+        if(reuse_port || i == 0){
+            listenfd = OpenListenFd(port, reuse_port);
+            if(listenfd < 0){
+                return false;
+            }
+            m_listenfds.push_back(listenfd);
+            //端口为0时由内核分配，之后的循环监听同一个端口
+            if(port == 0){
+                struct sockaddr_in address;
+                socklen_t length = sizeof(address);
+                if(getsockname(listenfd, (struct sockaddr *)&address, &length) < 0){
+                    return false;
+                }
+                port = ntohs(address.sin_port);
+            }
+        }
+
+        if(!m_loops[i].Init(i, listenfd, timeslot, TRIGMode)){
+            return false;
+        }
+        m_loops[i].SetHandlers(on_conn, on_io);
+        m_loops[i].m_group = reuse_port ? NULL : this;
+    }
+    m_port = port;
+    return true;
+}
+
+/*
+@ function: 启动所有事件循环
+@ return: (bool) 成功返回true
+*/
+bool Event_loop_group::Start(){
+    for(int i = 0; i < m_loop_number; ++i){
+        if(!m_loops[i].Start()){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+@ function: 停止所有事件循环
+@ return: 无
+*/
+void Event_loop_group::Stop(){
+    for(int i = 0; i < m_loop_number; ++i){
+        m_loops[i].Stop();
+    }
+}
+
+/*
+@ function: 轮询选择下一个事件循环
+@ return: (Event_loop *)
+只在0号循环的accept线程内调用，不需要加锁
+*/
+Event_loop *Event_loop_group::Next(){
+    Event_loop *loop = &m_loops[m_next % m_loop_number];
+    ++m_next;
+    return loop;
+}
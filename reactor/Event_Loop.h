@@ -0,0 +1,219 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+//用于跨线程唤醒事件循环
+#include <netinet/in.h>
+#include <pthread.h>
+#include "../timer/List_Timer.h"
+#include "../lock/lock_profile.h"
+
+/*
+类的前向声明
+*/
+class Event_loop;
+class Event_loop_group;
+
+/*
+回调函数类型定义
+@ type Conn_handler: 新连接已经注册到某个事件循环后调用，用于初始化连接数据和定时器
+@ type Io_handler: 事件循环上的连接fd就绪时调用，在事件循环自己的线程内执行
+*/
+typedef void (*Conn_handler)(Event_loop *loop, int connfd, const sockaddr_in &address);
+typedef void (*Io_handler)(Event_loop *loop, int sockfd, uint32_t events);
+
+/*
+class: Event_loop
+单个事件循环（one loop per thread）
+@ function: 每个事件循环拥有独立的epoll、定时器链表和用于唤醒的eventfd，
+            连接在整个生命周期内只属于一个事件循环，定时器和epoll都不需要跨线程操作
+public:
+函数：
+@ func: Init()
+@ param index: (int) 事件循环编号
+@ param listenfd: (int) 本循环负责accept的监听fd，-1表示只接收其他线程转交的连接
+@ param timeslot: (int) 定时器检查间隔(秒)
+@ param TRIGMode: (int) 连接fd的触发模式，1为ET
+@ return: (bool) 成功返回true
+
+@ func: Start()
+@ function: 创建事件循环线程
+@ return: (bool) 成功返回true
+
+@ func: Stop()
+@ function: 通知事件循环退出并等待线程结束
+@ return: 无
+
+@ func: QueueConn()
+@ param connfd: (int) 已accept的连接fd
+@ param address: (const sockaddr_in &) 客户端地址
+@ function: 其他线程把连接转交给本循环，通过eventfd唤醒本循环完成注册
+@ return: (bool) 成功返回true
+
+@ func: SetHandlers()
+@ param on_conn: (Conn_handler) 新连接回调
+@ param on_io: (Io_handler) 读写事件回调
+@ return: 无
+
+字段：
+@ param m_epollfd: (int) 本循环的epoll文件描述符
+@ param m_timer_list: (Fifo_timer_list) 本循环的定时器容器，只在本循环线程内访问
+@ param m_utils: (Utils) 本循环使用的工具类
+@ param m_user_data: (void *) 上层挂载的私有数据
+
+private:
+@ func: Worker() 静态函数
+@ function: 线程入口，调用Run()
+
+@ func: Run()
+@ function: 事件循环主体，epoll_wait超时用于驱动定时器
+
+@ func: HandleAccept()
+@ function: 在监听fd上accept直到EAGAIN
+
+@ func: HandleWakeup()
+@ function: 读取eventfd并注册所有转交过来的连接
+
+@ func: RegisterConn()
+@ function: 把连接fd注册到本循环的epoll并调用新连接回调
+*/
+class Event_loop{
+public:
+    Event_loop();
+
+    ~Event_loop();
+
+    bool Init(int index, int listenfd, int timeslot, int TRIGMode);
+
+    bool Start();
+
+    void Stop();
+
+    bool QueueConn(int connfd, const sockaddr_in &address);
+
+    void SetHandlers(Conn_handler on_conn, Io_handler on_io);
+
+    int Index() const { return m_index; }
+
+    int m_epollfd;
+
+    Fifo_timer_list m_timer_list;
+
+    Utils m_utils;
+
+    void *m_user_data;
+
+    Event_loop_group *m_group;
+
+private:
+    static void *Worker(void *arg);
+
+    void Run();
+
+    void HandleAccept();
+
+    void HandleWakeup();
+
+    void RegisterConn(int connfd, const sockaddr_in &address);
+
+    int m_index;
+
+    int m_listenfd;
+
+    int m_wakeupfd;
+
+    int m_TIMESLOT;
+
+    int m_TRIGMode;
+
+    volatile bool m_stop;
+
+    bool m_started;
+
+    pthread_t m_thread;
+
+    Conn_handler m_on_conn;
+
+    Io_handler m_on_io;
+
+    //其他线程转交过来、尚未注册的连接
+    Profiled_locker m_pending_lock;
+
+    std::vector<std::pair<int, sockaddr_in> > m_pending;
+};
+
+/*
+class: Event_loop_group
+多reactor事件循环组
+@ function: 创建N个事件循环（一般每个核一个）
+            reuse_port为true时每个循环各自创建SO_REUSEPORT监听fd，由内核分发连接；
+            否则由0号循环accept，按轮询方式把连接转交给各个循环
+public:
+@ func: Init()
+@ param loop_number: (int) 事件循环个数，<=0时取CPU核数
+@ param port: (int) 监听端口，0表示由内核分配（reuse_port模式下各循环监听同一个分配到的端口）
+@ param timeslot: (int) 定时器检查间隔(秒)
+@ param TRIGMode: (int) 连接fd触发模式
+@ param reuse_port: (bool) 是否使用SO_REUSEPORT
+@ param on_conn: (Conn_handler) 新连接回调
+@ param on_io: (Io_handler) 读写事件回调
+@ return: (bool) 成功返回true
+
+@ func: Start() / Stop()
+@ function: 启动/停止所有事件循环
+
+@ func: Port()
+@ function: 实际监听的端口
+@ return: (int)
+
+@ func: Next()
+@ function: 轮询选出下一个事件循环，用于连接转交
+@ return: (Event_loop *)
+
+@ func: OpenListenFd() 静态函数
+@ param port: (int) 监听端口
+@ param reuse_port: (bool) 是否开启SO_REUSEPORT
+@ function: 创建非阻塞监听fd，backlog取SOMAXCONN
+@ return: (int) 监听fd，失败返回-1
+*/
+class Event_loop_group{
+public:
+    Event_loop_group();
+
+    ~Event_loop_group();
+
+    bool Init(int loop_number, int port, int timeslot, int TRIGMode, bool reuse_port,
+              Conn_handler on_conn, Io_handler on_io);
+
+    bool Start();
+
+    void Stop();
+
+    Event_loop *Next();
+
+    Event_loop *Loop(int index) { return &m_loops[index]; }
+
+    int Size() const { return m_loop_number; }
+
+    int Port() const { return m_port; }
+
+    static int OpenListenFd(int port, bool reuse_port);
+
+private:
+    int m_loop_number;
+
+    Event_loop *m_loops;
+
+    std::vector<int> m_listenfds;
+
+    unsigned int m_next;
+
+    int m_port;
+};
+
+#endif
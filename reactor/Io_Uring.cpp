@@ -0,0 +1,433 @@
+#include "Io_Uring.h"
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "../log/log.h"
+
+//user_data编码：高32位为操作类型，低32位为fd
+static inline uint64_t pack_user_data(int op, int fd){
+    return ((uint64_t)(uint32_t)op << 32) | (uint32_t)fd;
+}
+
+//provided buffer ring使用的缓冲区组号
+static const unsigned short URING_BGID = 0;
+
+/**********Io_uring********** */
+/*
+@ function: 基础构造函数
+@ return: 无
+*/
+Io_uring::Io_uring(){
+#if URING_SUPPORTED
+    m_ringfd = -1;
+    m_sq_ptr = MAP_FAILED;
+    m_sq_size = 0;
+    m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    m_sqes_size = 0;
+    m_sqe_tail = 0;
+    m_cq_ptr = MAP_FAILED;
+    m_cq_size = 0;
+    m_buf_ring = (struct io_uring_buf *)MAP_FAILED;
+    m_buf_tail = NULL;
+    m_buf_ring_size = 0;
+    m_bufs = NULL;
+    m_buf_count = 0;
+    m_buf_size = 0;
+    m_timeouts = NULL;
+#endif
+    m_entries = 0;
+    m_to_submit = 0;
+}
+
+/*
+@ function: 基础析构函数
+@ return: 无
+*/
+Io_uring::~Io_uring(){
+#if URING_SUPPORTED
+    Release();
+#endif
+}
+
+#if URING_SUPPORTED
+/*
+@ function: 释放ring、mmap区域和缓冲区
+@ return: 无
+*/
+void Io_uring::Release(){
+    if(m_buf_ring != MAP_FAILED){
+        munmap(m_buf_ring, m_buf_ring_size);
+        m_buf_ring = (struct io_uring_buf *)MAP_FAILED;
+    }
+    if(m_sqes != MAP_FAILED){
+        munmap(m_sqes, m_sqes_size);
+        m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    }
+    if(m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr){
+        munmap(m_cq_ptr, m_cq_size);
+    }
+    m_cq_ptr = MAP_FAILED;
+    if(m_sq_ptr != MAP_FAILED){
+        munmap(m_sq_ptr, m_sq_size);
+        m_sq_ptr = MAP_FAILED;
+    }
+    if(m_ringfd >= 0){
+        close(m_ringfd);
+        m_ringfd = -1;
+    }
+    delete[] m_bufs;
+    m_bufs = NULL;
+    delete[] m_timeouts;
+    m_timeouts = NULL;
+}
+#endif
+
+/*
+@ function: 选择I/O后端
+@ param: prefer_uring (bool)
+@ return: (IO_BACKEND) 内核不支持io_uring或所需特性时返回EPOLL_BACKEND
+通过实际创建一个小ring并注册buffer ring来探测（multishot accept与buffer ring同为5.19引入）
+*/
+IO_BACKEND Io_uring::ChooseBackend(bool prefer_uring){
+    if(!prefer_uring){
+        return EPOLL_BACKEND;
+    }
+#if URING_SUPPORTED
+    Io_uring probe;
+    if(probe.Init(8, 8, 64)){
+        return URING_BACKEND;
+    }
+    LOG_WARN("%s", "io_uring unavailable, fall back to epoll");
+#endif
+    return EPOLL_BACKEND;
+}
+
+/*
+@ function: 创建io_uring并映射提交/完成队列，注册provided buffer ring
+@ param: entries (unsigned)
+@ param: buf_count (unsigned) 必须是2的幂
+@ param: buf_size (unsigned)
+@ return: (bool)
+*/
+bool Io_uring::Init(unsigned entries, unsigned buf_count, unsigned buf_size){
+#if URING_SUPPORTED
+    if(buf_count == 0 || (buf_count & (buf_count - 1)) != 0 || buf_count > 32768){
+        return false;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ringfd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if(m_ringfd < 0){
+        return false;
+    }
+    m_entries = params.sq_entries;
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        if(m_cq_size > m_sq_size){
+            m_sq_size = m_cq_size;
+        }
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ringfd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED){
+        Release();
+        return false;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        m_cq_ptr = m_sq_ptr;
+    }else{
+        m_cq_ptr = mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ringfd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED){
+            Release();
+            return false;
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED){
+        Release();
+        return false;
+    }
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+    m_sqe_tail = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    m_timeouts = new struct __kernel_timespec[m_entries];
+
+    //provided buffer ring：环本身需要页对齐，用匿名mmap分配
+    //不通过io_uring_buf_ring::bufs访问，C++下该柔性数组成员的偏移与内核布局不一致
+    m_buf_count = buf_count;
+    m_buf_size = buf_size;
+    m_buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+    m_buf_ring = (struct io_uring_buf *)mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(m_buf_ring == MAP_FAILED){
+        Release();
+        return false;
+    }
+    m_buf_tail = (unsigned short *)((char *)m_buf_ring + offsetof(struct io_uring_buf_ring, tail));
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)m_buf_ring;
+    reg.ring_entries = buf_count;
+    reg.bgid = URING_BGID;
+    if(syscall(__NR_io_uring_register, m_ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+        Release();
+        return false;
+    }
+
+    m_bufs = new char[(size_t)buf_count * buf_size];
+    for(unsigned i = 0; i < buf_count; ++i){
+        struct io_uring_buf *buf = &m_buf_ring[i];
+        buf->addr = (uint64_t)(uintptr_t)(m_bufs + (size_t)i * buf_size);
+        buf->len = buf_size;
+        buf->bid = (unsigned short)i;
+    }
+    __atomic_store_n(m_buf_tail, (unsigned short)buf_count, __ATOMIC_RELEASE);
+    return true;
+#else
+    (void)entries;
+    (void)buf_count;
+    (void)buf_size;
+    return false;
+#endif
+}
+
+#if URING_SUPPORTED
+/*
+@ function: 取一个空闲的SQE，并清零
+@ return: (io_uring_sqe *) 提交队列满时返回NULL
+*/
+struct io_uring_sqe *Io_uring::GetSqe(){
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if(m_sqe_tail - head >= m_entries){
+        return NULL;
+    }
+    unsigned index = m_sqe_tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    ++m_sqe_tail;
+    ++m_to_submit;
+    return sqe;
+}
+#endif
+
+/*
+@ function: 准备multishot accept
+@ param: listenfd (int)
+@ return: (bool)
+*/
+bool Io_uring::PrepAccept(int listenfd){
+#if URING_SUPPORTED
+    struct io_uring_sqe *sqe = GetSqe();
+    if(!sqe){
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = pack_user_data(URING_ACCEPT, listenfd);
+    return true;
+#else
+    (void)listenfd;
+    return false;
+#endif
+}
+
+/*
+@ function: 准备recv，缓冲区由内核从provided buffer ring中选择
+@ param: fd (int)
+@ param: timeout_ms (int) >0时链接超时
+@ return: (bool)
+*/
+bool Io_uring::PrepRecv(int fd, int timeout_ms){
+#if URING_SUPPORTED
+    //recv和linked timeout必须在同一批提交中相邻，先确认有两个空位
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    unsigned need = timeout_ms > 0 ? 2 : 1;
+    if(m_sqe_tail - head + need > m_entries){
+        return false;
+    }
+
+    struct io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = m_buf_size;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = pack_user_data(URING_RECV, fd);
+
+    if(timeout_ms > 0){
+        sqe->flags |= IOSQE_IO_LINK;
+        struct io_uring_sqe *tsqe = GetSqe();
+        struct __kernel_timespec *ts = &m_timeouts[(m_sqe_tail - 1) & *m_sq_mask];
+        ts->tv_sec = timeout_ms / 1000;
+        ts->tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+        tsqe->fd = -1;
+        tsqe->addr = (uint64_t)(uintptr_t)ts;
+        tsqe->len = 1;
+        tsqe->user_data = pack_user_data(URING_TIMEOUT, fd);
+    }
+    return true;
+#else
+    (void)fd;
+    (void)timeout_ms;
+    return false;
+#endif
+}
+
+/*
+@ function: 准备send
+@ param: fd (int)
+@ param: buf (const void *)
+@ param: len (size_t)
+@ return: (bool)
+*/
+bool Io_uring::PrepSend(int fd, const void *buf, size_t len){
+#if URING_SUPPORTED
+    struct io_uring_sqe *sqe = GetSqe();
+    if(!sqe){
+        return false;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = pack_user_data(URING_SEND, fd);
+    return true;
+#else
+    (void)fd;
+    (void)buf;
+    (void)len;
+    return false;
+#endif
+}
+
+/*
+@ function: 准备close
+@ param: fd (int)
+@ return: (bool)
+*/
+bool Io_uring::PrepClose(int fd){
+#if URING_SUPPORTED
+    struct io_uring_sqe *sqe = GetSqe();
+    if(!sqe){
+        return false;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = pack_user_data(URING_CLOSE, fd);
+    return true;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+/*
+@ function: 批量提交所有已准备的SQE
+@ param: wait_nr (unsigned) 至少等待的完成事件数
+@ return: (int) 提交数，失败返回-errno
+*/
+int Io_uring::Submit(unsigned wait_nr){
+#if URING_SUPPORTED
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    if(m_to_submit == 0 && wait_nr == 0){
+        return 0;
+    }
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = (int)syscall(__NR_io_uring_enter, m_ringfd, m_to_submit, wait_nr, flags, NULL, 0);
+    if(ret < 0){
+        return -errno;
+    }
+    m_to_submit -= (unsigned)ret;
+    return ret;
+#else
+    (void)wait_nr;
+    return -ENOSYS;
+#endif
+}
+
+/*
+@ function: 收割完成事件
+@ param: events (Uring_event *)
+@ param: max (int)
+@ return: (int) 收割的事件数
+*/
+int Io_uring::Reap(Uring_event *events, int max){
+#if URING_SUPPORTED
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    int count = 0;
+
+    while(head != tail && count < max){
+        struct io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+        Uring_event &ev = events[count++];
+        ev.op = (int)(cqe->user_data >> 32);
+        ev.fd = (int)(uint32_t)cqe->user_data;
+        ev.res = cqe->res;
+        ev.more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        ev.bid = -1;
+        ev.buf = NULL;
+        if(cqe->flags & IORING_CQE_F_BUFFER){
+            ev.bid = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            ev.buf = m_bufs + (size_t)ev.bid * m_buf_size;
+        }
+        ++head;
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    return count;
+#else
+    (void)events;
+    (void)max;
+    return 0;
+#endif
+}
+
+/*
+@ function: 归还recv缓冲区
+@ param: bid (int)
+@ return: 无
+*/
+void Io_uring::RecycleBuffer(int bid){
+#if URING_SUPPORTED
+    if(bid < 0 || (unsigned)bid >= m_buf_count){
+        return;
+    }
+    unsigned short tail = *m_buf_tail;
+    struct io_uring_buf *buf = &m_buf_ring[tail & (m_buf_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(m_bufs + (size_t)bid * m_buf_size);
+    buf->len = m_buf_size;
+    buf->bid = (unsigned short)bid;
+    __atomic_store_n(m_buf_tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+#else
+    (void)bid;
+#endif
+}
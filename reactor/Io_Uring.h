@@ -0,0 +1,193 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//需要5.19以上内核头文件（multishot accept和provided buffer ring），否则只编译epoll回退路径
+#if defined(IORING_ACCEPT_MULTISHOT)
+#define URING_SUPPORTED 1
+#else
+#define URING_SUPPORTED 0
+#endif
+
+/*
+enum: IO_BACKEND
+I/O后端类型
+@ EPOLL_BACKEND: 就绪通知模型，Utils::Addfd + epoll_wait + read/write
+@ URING_BACKEND: 完成通知模型，io_uring提交accept/recv/send并收割完成事件
+*/
+enum IO_BACKEND
+{
+    EPOLL_BACKEND = 0,
+    URING_BACKEND
+};
+
+/*
+enum: URING_OP
+完成事件对应的操作类型，编码在user_data的高32位
+*/
+enum URING_OP
+{
+    URING_ACCEPT = 1,
+    URING_RECV,
+    URING_SEND,
+    URING_TIMEOUT,
+    URING_CLOSE
+};
+
+/*
+struct: Uring_event
+一次完成事件
+@ param op: (int) 操作类型URING_OP
+@ param fd: (int) 操作所属的fd，accept完成时为监听fd
+@ param res: (int) 结果，accept为新连接fd，recv/send为字节数，<0为-errno
+@ param more: (bool) multishot操作是否仍然有效，false时需要重新提交
+@ param bid: (int) recv使用的缓冲区编号，未使用缓冲区时为-1
+@ param buf: (char *) recv数据所在的缓冲区，处理完后需调用RecycleBuffer(bid)
+*/
+struct Uring_event
+{
+    int op;
+    int fd;
+    int res;
+    bool more;
+    int bid;
+    char *buf;
+};
+
+/*
+class: Io_uring
+io_uring完成模型后端（直接使用系统调用，不依赖liburing）
+@ function: multishot accept、provided buffer ring接收、linked timeout超时、批量提交
+public:
+函数：
+@ func: ChooseBackend() 静态函数
+@ param prefer_uring: (bool) 是否优先使用io_uring
+@ function: 探测内核能力，不支持时回退到epoll
+@ return: (IO_BACKEND)
+
+@ func: Init()
+@ param entries: (unsigned) 提交队列长度
+@ param buf_count: (unsigned) 接收缓冲区个数，必须是2的幂
+@ param buf_size: (unsigned) 每个接收缓冲区大小
+@ return: (bool) 成功返回true，失败时调用方应回退到epoll
+
+@ func: PrepAccept()
+@ param listenfd: (int) 监听fd
+@ function: 准备一个multishot accept，一次提交持续产生新连接
+@ return: (bool) 提交队列满时返回false
+
+@ func: PrepRecv()
+@ param fd: (int) 连接fd
+@ param timeout_ms: (int) >0时链接一个LINK_TIMEOUT，超时后recv以-ECANCELED完成，可以代替连接定时器
+@ function: 准备一个从provided buffer ring取缓冲区的recv
+@ return: (bool)
+
+@ func: PrepSend()
+@ param fd: (int) 连接fd
+@ param buf: (const void *) 数据，完成前必须保持有效
+@ param len: (size_t) 长度
+@ return: (bool)
+
+@ func: PrepClose()
+@ param fd: (int) 连接fd
+@ return: (bool)
+
+@ func: Submit()
+@ param wait_nr: (unsigned) 至少等待的完成事件数
+@ function: 把积累的所有SQE一次io_uring_enter提交
+@ return: (int) 提交的SQE数，失败返回-errno
+
+@ func: Reap()
+@ param events: (Uring_event *) 输出数组
+@ param max: (int) 最多收割的事件数
+@ function: 从完成队列收割事件，不产生系统调用
+@ return: (int) 收割的事件数
+
+@ func: RecycleBuffer()
+@ param bid: (int) 缓冲区编号
+@ function: 把recv用完的缓冲区还给内核
+@ return: 无
+*/
+class Io_uring{
+public:
+    Io_uring();
+
+    ~Io_uring();
+
+    static IO_BACKEND ChooseBackend(bool prefer_uring);
+
+    bool Init(unsigned entries = 1024, unsigned buf_count = 1024, unsigned buf_size = 2048);
+
+    bool PrepAccept(int listenfd);
+
+    bool PrepRecv(int fd, int timeout_ms = 0);
+
+    bool PrepSend(int fd, const void *buf, size_t len);
+
+    bool PrepClose(int fd);
+
+    int Submit(unsigned wait_nr = 0);
+
+    int Reap(Uring_event *events, int max);
+
+    void RecycleBuffer(int bid);
+
+    unsigned Pending() const { return m_to_submit; }
+
+private:
+#if URING_SUPPORTED
+    struct io_uring_sqe *GetSqe();
+
+    void Release();
+
+    int m_ringfd;
+
+    //提交队列
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+    unsigned m_sqe_tail;
+
+    //完成队列
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    //provided buffer ring，按io_uring_buf数组访问，tail与0号元素的resv字段重叠
+    struct io_uring_buf *m_buf_ring;
+    unsigned short *m_buf_tail;
+    size_t m_buf_ring_size;
+    char *m_bufs;
+    unsigned m_buf_count;
+    unsigned m_buf_size;
+
+    //linked timeout的超时时间，按SQE下标存放，提交时由内核读取
+    struct __kernel_timespec *m_timeouts;
+#endif
+    unsigned m_entries;
+
+    unsigned m_to_submit;
+};
+
+#endif
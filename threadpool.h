@@ -6,7 +6,13 @@
 #include <cstdio>
 #include <exception>
 #include <pthread.h>
-#include "../lock/locker.h"
+#include <time.h>
+#include "../lock/lock_profile.h"
+#include "../metrics/Metrics.h"
+#include "../trace/Trace.h"
+#include "../arena/Arena.h"
+#include "../conn/Conn_Table.h"
+#include "../coro/Coro_Task.h"
 #include "../CGImysql/sql_connection_pool.h"
 
 template <typename T>
@@ -26,24 +32,103 @@ public:
                int thread_number = 8,
                int max_request = 10000);
 
-    // 析构函数，用于释放线程资源
+    // 析构函数，未调用 shutdown 时按 shutdown(0) 停止并回收线程
     ~threadpool();
     /*
        添加任务到请求队列
        参数：
        - request：任务对象指针
        - state：任务状态（读或写）
+       - deadline：连接定时器的到期时刻（Util_timer::Time_out），0 表示没有期限；
+                   出队时已过期的请求不再处理
+       - handle：连接表中的句柄，0 表示不检查；设置了 set_conn_table 时，出队时句柄已失效
+                 （连接已关闭，request 可能已经属于复用了同一槽位的新连接）的请求直接丢弃，不访问 request
        返回值：成功返回 true，失败返回 false
    */
-    bool append(T *request, int state);
+    bool append(T *request, int state, time_t deadline = 0, Conn_handle handle = 0);
 
     /*
         添加任务到请求队列（无状态设置）
         参数：
         - request：任务对象指针
+        - deadline / handle：同 append
         返回值：成功返回 true，失败返回 false
     */
-    bool append_p(T *request);
+    bool append_p(T *request, time_t deadline = 0, Conn_handle handle = 0);
+
+    /*
+        设置基于排队时延的准入控制（CoDel）
+        参数：
+        - target_ms：排队时延目标，一个观察窗口内出队请求的最小排队时延超过它即判定为过载，0 表示关闭
+        - interval_ms：观察窗口长度
+        过载期间，若队首请求已排队超过 2 * target_ms，新请求直接拒绝，不再进入队列；
+        队列排空到队首等待时间低于该值后恢复接收。默认关闭，窗口 100ms；
+        开启时应同时 set_shed_handler，否则被拒绝的请求只能由调用方根据返回值自行关闭连接
+    */
+    void set_admission(int target_ms, int interval_ms);
+
+    /*
+        设置请求被拒绝时的回调
+        参数：
+        - handler：在调用 append / append_p 的线程中、释放队列锁之后调用，
+                   队列已满和准入控制拒绝都会调用，append 仍然返回 false。
+                   一般用 Utils::ShowError 回一个简短的繁忙响应并关闭连接，
+                   调用方收到 false 后不应再关闭同一个连接
+    */
+    void set_shed_handler(void (*handler)(T *request));
+
+    /*
+        设置是否按截止时间优先（EDF）调度
+        参数：
+        - edf：true 时带期限的请求按 deadline 升序插入队列，先到期的先处理；
+               不会越过没有期限的请求，避免它们被饿死。默认 false，即 FIFO
+        连接定时器的期限一般随入队时间单调递增，插入时从队尾向前查找，通常一步即可；
+        准入控制用队首的等待时间估计排队时延，EDF 下队首不一定最早入队，估计会偏小
+    */
+    void set_edf(bool edf);
+
+    /*
+        设置用于检查请求句柄的连接表
+        参数：
+        - table：所属线程打开、关闭连接的连接表，NULL 表示不检查
+        出队时只比较一次代数，失效的请求计入指标 threadpool.skipped_stale
+    */
+    void set_conn_table(const Conn_table *table);
+
+    /*
+        设置异步处理函数（协程）
+        参数：
+        - handler：替代"connectionRAII 取连接 + process()"，在工作线程上调用。一般是启动一个 Coro_task 协程：
+                   等待连接池租约、数据库或后端 socket 时挂起协程，工作线程返回去处理其他请求，
+                   就绪后由 executor() 把协程交回线程池恢复。NULL 表示按原来的同步方式处理
+    */
+    void set_async_handler(void (*handler)(T *request));
+
+    /*
+        把挂起后就绪的协程（或任意续体）交给工作线程执行
+        参数：
+        - fn / arg：在某个工作线程上调用 fn(arg)
+        续体属于已经被接收的请求，放在单独的队列中，先于新请求执行，不经过准入控制，
+        也不计入排队时延；shutdown 排空队列时同样等待它们
+        返回值：线程池已经停止时返回 false
+    */
+    bool post(void (*fn)(void *), void *arg);
+
+    // 以 post 为 Coro_executor 的执行器，交给 Coro_conn_pool / Coro_io
+    Coro_executor executor();
+
+    /*
+        停止线程池
+        参数：
+        - drain_ms：等待队列中剩余请求被处理的最长时间，0 表示不等待
+        立即停止接收新请求（append 返回 false，并调用拒绝回调），队列排空或到达期限后
+        丢弃仍未处理的请求，唤醒并回收所有工作线程。等待由条件变量唤醒，队列排空即返回；
+        正在处理中的请求会处理完，因此返回时间可能晚于 drain_ms。
+        已经 post 进来的续体不丢弃，工作线程退出前都会执行：协程可能持有连接池租约，丢弃会让连接永远不能归还；
+        之后 post 返回 false，等待对象改为在调用线程上直接恢复协程
+        返回值：被丢弃的请求数
+    */
+    int shutdown(int drain_ms);
 
 private:
     /*
@@ -60,14 +145,69 @@ private:
     void run();
 
 private:
+    // 请求队列中的一项
+    struct work_item
+    {
+        T *request;          // 任务对象指针
+        uint64_t enqueue_ts; // 入队时刻，用于追踪排队时间，请求未被采样时为0
+        uint64_t enqueue_ns; // 入队时刻（CLOCK_MONOTONIC纳秒），用于计算排队时延
+        time_t deadline;     // 连接的到期时刻，0 表示没有期限
+        Conn_handle handle;  // 连接句柄，0 表示不检查
+        void (*fn)(void *);  // post 交来的续体，request 为空时执行
+        void *arg;
+    };
+
+    // Coro_executor::post 的适配函数，context 为线程池对象
+    static bool post_to(void *context, void (*fn)(void *), void *arg);
+
+    // 当前时刻（CLOCK_MONOTONIC纳秒）
+    static uint64_t now_ns();
+
+    /*
+        判断新请求能否入队，调用时必须持有 m_queuelocker
+        返回值：0 可以入队，1 队列已满或线程池已停止，2 准入控制拒绝
+    */
+    int admit(uint64_t now);
+
+    /*
+        出队时用请求的排队时延更新过载状态，调用时必须持有 m_queuelocker
+        每个窗口结束时，窗口内的最小排队时延超过目标即为过载：
+        只要有一个请求几乎没有排队，就说明队列能排空，只是突发而不是持续积压
+    */
+    void update_delay(uint64_t now, uint64_t delay);
+
+    // 把请求加入队列，调用时必须持有 m_queuelocker
+    void enqueue(const work_item &item);
+
+    /*
+        出队后判断请求是否已经没有处理的必要：句柄已失效，连接已被标记关闭（timer_flag），或定时器期限已过，
+        连接会被定时器关闭，处理结果不会再发出去。跳过时按原来处理失败的方式通知主线程；
+        句柄失效时 request 可能已经属于新连接，不做任何通知
+        返回值：true 表示已跳过
+    */
+    bool skip_expired(const work_item &item);
+
     int m_thread_number;         // 线程池中的线程数
     int m_max_requests;          // 请求队列允许的最大请求数
     pthread_t *m_threads;        // 描述线程池的线程数组，其大小为 m_thread_number
-    std::list<T *> m_workqueue;  // 请求队列，存储待处理任务的指针
-    locker m_queuelocker;        // 保护请求队列的互斥锁，保证线程安全
-    sem m_queuestat;             // 信号量，标志是否有任务需要处理
+    std::list<work_item> m_workqueue; // 请求队列，存储待处理任务的指针、入队时刻及期限
+    std::list<work_item> m_resumeq;   // post 交来的续体，优先于请求队列执行
+    Profiled_locker m_queuelocker; // 保护请求队列的互斥锁，保证线程安全
+    Profiled_sem m_queuestat;    // 信号量，标志是否有任务需要处理
     connection_pool *m_connPool; // 数据库连接池对象，用于数据库操作
     int m_actor_model;           // 模型切换标志，决定任务处理方式
+    uint64_t m_codel_target;     // 排队时延目标（纳秒），0 表示关闭准入控制
+    uint64_t m_codel_interval;   // 观察窗口长度（纳秒）
+    uint64_t m_codel_window_end; // 当前窗口的结束时刻
+    uint64_t m_codel_min_delay;  // 当前窗口内出队请求的最小排队时延
+    bool m_overloaded;           // 上一个窗口判定为过载
+    void (*m_shed_handler)(T *); // 请求被拒绝时的回调
+    bool m_edf;                  // 是否按截止时间优先调度
+    const Conn_table *m_conns;   // 检查请求句柄的连接表，NULL 表示不检查
+    void (*m_async_handler)(T *); // 异步处理函数，NULL 表示同步处理
+    bool m_stopping;             // 已调用 shutdown，不再接收新请求
+    bool m_stop;                 // 工作线程在队列为空时退出，也表示 shutdown 已执行过
+    Profiled_cond m_drained;     // 队列被取空时通知 shutdown
 };
 
 /*
@@ -78,34 +218,45 @@ template <typename T>
 threadpool<T>::threadpool(
     int actor_model,
     connection_pool *connPool,
-    int thread_number = 8,
-    int max_request = 10000) : m_actor_model(actor_model),
-                               m_connPool(connPool),
-                               m_thread_number(thread_number),
-                               m_max_requests(max_request),
-                               m_threads(NULL)
+    int thread_number,
+    int max_request) : m_thread_number(thread_number),
+                       m_max_requests(max_request),
+                       m_threads(NULL),
+                       m_connPool(connPool),
+                       m_actor_model(actor_model),
+                       m_codel_target(0),
+                       m_codel_interval(100000000),
+                       m_codel_window_end(0),
+                       m_codel_min_delay(0),
+                       m_overloaded(false),
+                       m_shed_handler(NULL),
+                       m_edf(false),
+                       m_conns(NULL),
+                       m_async_handler(NULL),
+                       m_stopping(false),
+                       m_stop(false)
 {
     // 检查线程数和最大请求数是否合法
-    if (thread_number <= 0 || max_request <= 10000)
+    if (thread_number <= 0 || max_request <= 0)
         throw std::exception();
 
+    LOCK_NAME(m_queuelocker, "threadpool.queue");
+    LOCK_NAME(m_queuestat, "threadpool.queuestat");
+    LOCK_NAME(m_drained, "threadpool.drained");
+
     // 分配线程数组的内存
     m_threads = new pthread_t[m_thread_number];
     if (!m_threads)
         throw std::exception();
 
-    // 创建线程并启动
+    // 创建线程并启动，线程不分离，由 shutdown 回收
     for (int i = 0; i < m_thread_number; ++i)
     {
-        if (pthread_create(m_threads[i], NULL, worker, this) != 0)
-        {
-            delete[] m_threads;
-            throw std::exception();
-        }
-
-        // 分离线程，确保线程资源在结束后自动释放
-        if (pthread_detach(m_threads[i]))
+        if (pthread_create(m_threads + i, NULL, worker, this) != 0)
         {
+            // 回收已经创建的线程
+            m_thread_number = i;
+            shutdown(0);
             delete[] m_threads;
             throw std::exception();
         }
@@ -119,6 +270,7 @@ threadpool<T>::threadpool(
 template <typename T>
 threadpool<T>::~threadpool()
 {
+    shutdown(0);
     delete[] m_threads;
 }
 
@@ -126,20 +278,31 @@ threadpool<T>::~threadpool()
     添加任务到请求队列，并设置任务状态
 */
 template <typename T>
-bool threadpool<T>::append(T *request, int state)
+bool threadpool<T>::append(T *request, int state, time_t deadline, Conn_handle handle)
 {
-    // 加锁，保护队列操作
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests) // 检查队列是否已满
+    // 加锁，保护队列操作，等锁时间计入当前请求的追踪
+    TRACE_LOCK(m_queuelocker, "threadpool.lock_wait");
+    uint64_t now = now_ns();
+    int refused = admit(now);
+    if (refused) // 队列已满或准入控制拒绝
     {
         m_queuelocker.unlock();
-        return false; // 如果队列已满，返回失败
+        if (refused == 1)
+            METRICS_COUNT("threadpool.rejected", 1);
+        else
+            METRICS_COUNT("threadpool.shed", 1);
+        if (m_shed_handler)
+            m_shed_handler(request);
+        return false;
     }
 
     // 设置任务状态并把请求加入队列
-    m_actor_model = state;
-    m_workqueue.push_back(request);
+    request->m_state = state;
+    work_item item = {request, TRACE_BEGIN(), now, deadline, handle, NULL, NULL};
+    enqueue(item);
+    METRICS_GAUGE_SET("threadpool.queue_depth", (long)m_workqueue.size());
     m_queuelocker.unlock();
+    METRICS_COUNT("threadpool.enqueued", 1);
 
     // 信号量通知线程有新任务
     m_queuestat.post();
@@ -151,18 +314,29 @@ bool threadpool<T>::append(T *request, int state)
     添加任务到请求队列（无状态设置）
 */
 template <typename T>
-bool threadpool<T>::append_p(T *request)
+bool threadpool<T>::append_p(T *request, time_t deadline, Conn_handle handle)
 { // 加锁，保护队列操作
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests) // 检查队列是否已满
+    TRACE_LOCK(m_queuelocker, "threadpool.lock_wait");
+    uint64_t now = now_ns();
+    int refused = admit(now);
+    if (refused) // 队列已满或准入控制拒绝
     {
         m_queuelocker.unlock();
-        return false; // 如果队列已满，返回失败
+        if (refused == 1)
+            METRICS_COUNT("threadpool.rejected", 1);
+        else
+            METRICS_COUNT("threadpool.shed", 1);
+        if (m_shed_handler)
+            m_shed_handler(request);
+        return false;
     }
 
     // 请求加入队列
-    m_workqueue.push_back(request);
+    work_item item = {request, TRACE_BEGIN(), now, deadline, handle, NULL, NULL};
+    enqueue(item);
+    METRICS_GAUGE_SET("threadpool.queue_depth", (long)m_workqueue.size());
     m_queuelocker.unlock();
+    METRICS_COUNT("threadpool.enqueued", 1);
 
     // 信号量通知线程有新任务
     m_queuestat.post();
@@ -170,6 +344,221 @@ bool threadpool<T>::append_p(T *request)
     return true;
 }
 
+template <typename T>
+void threadpool<T>::set_admission(int target_ms, int interval_ms)
+{
+    m_queuelocker.lock();
+    m_codel_target = target_ms > 0 ? (uint64_t)target_ms * 1000000 : 0;
+    m_codel_interval = (uint64_t)(interval_ms > 0 ? interval_ms : 100) * 1000000;
+    m_codel_window_end = 0;
+    m_overloaded = false;
+    m_queuelocker.unlock();
+}
+
+template <typename T>
+void threadpool<T>::set_shed_handler(void (*handler)(T *request))
+{
+    m_shed_handler = handler;
+}
+
+template <typename T>
+void threadpool<T>::set_edf(bool edf)
+{
+    m_queuelocker.lock();
+    m_edf = edf;
+    m_queuelocker.unlock();
+}
+
+template <typename T>
+void threadpool<T>::set_conn_table(const Conn_table *table)
+{
+    m_conns = table;
+}
+
+template <typename T>
+void threadpool<T>::set_async_handler(void (*handler)(T *request))
+{
+    m_async_handler = handler;
+}
+
+template <typename T>
+bool threadpool<T>::post(void (*fn)(void *), void *arg)
+{
+    m_queuelocker.lock();
+    // shutdown 排空期间仍然接收，续体属于已经接收的请求
+    if (m_stop)
+    {
+        m_queuelocker.unlock();
+        return false;
+    }
+    work_item item = {NULL, 0, 0, 0, 0, fn, arg};
+    m_resumeq.push_back(item);
+    m_queuelocker.unlock();
+    METRICS_COUNT("threadpool.resumed", 1);
+    m_queuestat.post();
+    return true;
+}
+
+template <typename T>
+bool threadpool<T>::post_to(void *context, void (*fn)(void *), void *arg)
+{
+    return ((threadpool *)context)->post(fn, arg);
+}
+
+template <typename T>
+Coro_executor threadpool<T>::executor()
+{
+    Coro_executor executor = {this, post_to};
+    return executor;
+}
+
+template <typename T>
+void threadpool<T>::enqueue(const work_item &item)
+{
+    if (!m_edf || !item.deadline)
+    {
+        m_workqueue.push_back(item);
+        return;
+    }
+    typename std::list<work_item>::iterator it = m_workqueue.end();
+    while (it != m_workqueue.begin())
+    {
+        typename std::list<work_item>::iterator prev = it;
+        --prev;
+        if (!prev->deadline || prev->deadline <= item.deadline)
+            break;
+        it = prev;
+    }
+    m_workqueue.insert(it, item);
+}
+
+template <typename T>
+bool threadpool<T>::skip_expired(const work_item &item)
+{
+    T *request = item.request;
+    if (m_conns && item.handle && !m_conns->Valid(item.handle))
+    {
+        METRICS_COUNT("threadpool.skipped_stale", 1);
+        return true;
+    }
+    if (request->timer_flag)
+        METRICS_COUNT("threadpool.skipped_closed", 1);
+    else if (item.deadline && time(NULL) >= item.deadline)
+        METRICS_COUNT("threadpool.skipped_expired", 1);
+    else
+        return false;
+
+    // 模型 1 中主线程在等待 improv，按处理失败通知它关闭连接
+    if (1 == m_actor_model)
+    {
+        request->improv = 1;
+        request->timer_flag = 1;
+    }
+    return true;
+}
+
+template <typename T>
+uint64_t threadpool<T>::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+template <typename T>
+int threadpool<T>::admit(uint64_t now)
+{
+    if (m_stopping || m_workqueue.size() >= m_max_requests)
+        return 1;
+    // 工作线程全部卡住时没有出队，窗口无法结束；队首已等待的时间是其排队时延的下界，当作一次样本
+    if (!m_workqueue.empty() && now >= m_codel_window_end)
+        update_delay(now, now - m_workqueue.front().enqueue_ns);
+    // 过载时队首的等待时间就是新请求至少要等的时间，超过两倍目标时入队只会让它超时
+    if (m_overloaded && !m_workqueue.empty() &&
+        now - m_workqueue.front().enqueue_ns > 2 * m_codel_target)
+        return 2;
+    return 0;
+}
+
+template <typename T>
+void threadpool<T>::update_delay(uint64_t now, uint64_t delay)
+{
+    if (!m_codel_target)
+        return;
+    if (now >= m_codel_window_end)
+    {
+        // 窗口结束后又空闲了一整个窗口，旧的样本已经过时，不据此判定过载
+        bool overloaded = m_codel_window_end != 0 && now < m_codel_window_end + m_codel_interval &&
+                          m_codel_min_delay > m_codel_target;
+        if (overloaded != m_overloaded)
+            METRICS_GAUGE_SET("threadpool.overloaded", overloaded ? 1 : 0);
+        m_overloaded = overloaded;
+        m_codel_window_end = now + m_codel_interval;
+        m_codel_min_delay = delay;
+    }
+    else if (delay < m_codel_min_delay)
+    {
+        m_codel_min_delay = delay;
+    }
+}
+
+template <typename T>
+int threadpool<T>::shutdown(int drain_ms)
+{
+    m_queuelocker.lock();
+    if (m_stop)
+    {
+        m_queuelocker.unlock();
+        return 0;
+    }
+    m_stopping = true;
+
+    // 等待工作线程取空队列，timewait 使用 CLOCK_REALTIME 的绝对时间
+    if (drain_ms > 0)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += drain_ms / 1000;
+        deadline.tv_nsec += (long)(drain_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!m_workqueue.empty() || !m_resumeq.empty())
+        {
+            if (!m_drained.timewait(m_queuelocker.get(), deadline))
+                break;
+        }
+    }
+
+    // 到期仍未处理的请求直接丢弃，模型 1 中按处理失败通知主线程；
+    // 续体留在队列中，工作线程先执行完它们再退出（run 中续体先于退出判断），每个续体入队时都 post 过信号量
+    int dropped = (int)m_workqueue.size();
+    while (!m_workqueue.empty())
+    {
+        T *request = m_workqueue.front().request;
+        m_workqueue.pop_front();
+        if (request && 1 == m_actor_model)
+        {
+            request->improv = 1;
+            request->timer_flag = 1;
+        }
+    }
+    m_stop = true;
+    METRICS_GAUGE_SET("threadpool.queue_depth", 0L);
+    m_queuelocker.unlock();
+    if (dropped)
+        METRICS_COUNT("threadpool.dropped", dropped);
+
+    // 每个线程至少有一次唤醒，取到空队列后退出
+    for (int i = 0; i < m_thread_number; ++i)
+        m_queuestat.post();
+    for (int i = 0; i < m_thread_number; ++i)
+        pthread_join(m_threads[i], NULL);
+    return dropped;
+}
+
 /*
     工作线程的静态函数
     调用线程池对象的 run 方法
@@ -187,42 +576,98 @@ void *threadpool<T>::worker(void *arg)
 template <typename T>
 void threadpool<T>::run()
 {
+    // 每个工作线程一个请求级分配器，请求期间的临时数据从这里分配，处理完一个请求后整体收回
+    Arena arena;
+    Arena::SetCurrent(&arena);
+
     // 循环处理的线程工作
     while (true)
     {
         // 等待信号量唤醒
         m_queuestat.wait();
         // 加锁，保护队列操作
-        m_queuelocker.unlock();
-        // 如果队列为空，释放锁并继续循环
+        m_queuelocker.lock();
+        // 就绪的续体先于新请求执行，已经持有数据库连接的请求尽快结束
+        if (!m_resumeq.empty())
+        {
+            work_item resumed = m_resumeq.front();
+            m_resumeq.pop_front();
+            if (m_stopping && m_workqueue.empty() && m_resumeq.empty())
+                m_drained.broadcast();
+            m_queuelocker.unlock();
+            resumed.fn(resumed.arg);
+            TRACE_REQUEST(0);
+            arena.Reset();
+            continue;
+        }
+        // 如果队列为空，释放锁并继续循环；线程池停止时退出
         if (m_workqueue.empty())
         {
+            bool stop = m_stop;
             m_queuelocker.unlock();
+            if (stop)
+                break;
             continue;
         }
 
         // 从队列中取出任务
-        T *request = m_workqueue.front();
+        work_item item = m_workqueue.front();
         m_workqueue.pop_front();
+        uint64_t now = now_ns();
+        uint64_t delay = now - item.enqueue_ns;
+        update_delay(now, delay);
+        METRICS_GAUGE_SET("threadpool.queue_depth", (long)m_workqueue.size());
+        if (m_stopping && m_workqueue.empty() && m_resumeq.empty())
+            m_drained.broadcast();
         m_queuelocker.unlock();
+        METRICS_RECORD("threadpool.queue_delay_ns", (long)delay);
 
         // 如果任务为空，跳过处理
+        T *request = item.request;
         if (!request)
             continue;
 
+        // 连接已经超时或已被标记关闭，不再占用工作线程和数据库连接
+        if (skip_expired(item))
+            continue;
+
+        // 之后的span都归属于该请求，排队时间从入队线程开始，导出为异步区间
+        TRACE_REQUEST(request);
+        TRACE_ASYNC("threadpool.queue_wait", item.enqueue_ts);
+
+        // 记录单个任务的处理耗时（纳秒）
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+
         // 根据模型标志决定任务处理方式
         if (1 == m_actor_model) // 模型 1：根据任务状态选择操作
         {
             // 读任务
             if (0 == request->m_state)
             {
-                if (request->read_once()) // 读取成功
+                bool read_ok;
+                {
+                    TRACE_SCOPE("http.read_once");
+                    read_ok = request->read_once();
+                }
+                if (read_ok) // 读取成功
                 {
                     request->improv = 1;
-                    // 获取数据库连接
-                    connectionRAII mysqln(&request->mysql, m_connPool);
-                    // 处理任务
-                    request->process();
+                    if (m_async_handler)
+                    {
+                        // 协程自己租用连接，挂起时工作线程去处理其他请求
+                        m_async_handler(request);
+                    }
+                    else
+                    {
+                        // 获取数据库连接，等待空闲连接的时间单独记录
+                        uint64_t lease_begin = TRACE_BEGIN();
+                        connectionRAII mysqln(&request->mysql, m_connPool);
+                        TRACE_SPAN("db.lease", lease_begin);
+                        // 处理任务
+                        TRACE_SCOPE("http.process");
+                        request->process();
+                    }
                 }
                 else // 读取失败
                 {
@@ -233,7 +678,12 @@ void threadpool<T>::run()
             // 写任务
             else
             {
-                if (request->write()) // 写入成功
+                bool write_ok;
+                {
+                    TRACE_SCOPE("http.write");
+                    write_ok = request->write();
+                }
+                if (write_ok) // 写入成功
                 {
                     request->improv = 1;
                 }
@@ -244,12 +694,26 @@ void threadpool<T>::run()
                 }
             }
         }
+        else if (m_async_handler) // 模型 2，异步处理
+        {
+            m_async_handler(request);
+        }
         else // 模型 2：直接处理任务
         {
+            uint64_t lease_begin = TRACE_BEGIN();
             connectionRAII mysqlcon(&request->mysql, m_connPool); // 获取数据库连接
+            TRACE_SPAN("db.lease", lease_begin);
+            TRACE_SCOPE("http.process");
             request->process();                                   // 处理任务
         }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        METRICS_RECORD("threadpool.process_ns",
+                       (end.tv_sec - begin.tv_sec) * 1000000000L + (end.tv_nsec - begin.tv_nsec));
+        TRACE_REQUEST(0);
+        arena.Reset();
     }
+    Arena::SetCurrent(NULL);
 }
 
 #endif
@@ -8,6 +8,15 @@
 Sorted_timer_list::Sorted_timer_list(){
     head = NULL;
     tail = NULL;
+    m_budget = DEFAULT_TICK_BUDGET;
+    m_single_cb = NULL;
+    m_batch_cb = NULL;
+    m_default_slack = 0;
+    m_armed = 0;
+    m_wakeup_cb = NULL;
+    m_wakeup_arg = NULL;
+    m_expire_cb = NULL;
+    m_expire_arg = NULL;
 }
 
 /*
@@ -16,11 +25,14 @@ Sorted_timer_list::Sorted_timer_list(){
 */
 Sorted_timer_list::~Sorted_timer_list(){
     Util_timer *temp = head;
+    long count = 0;
     while(temp){
         head = temp->next;
         delete temp;
         temp = head;
+        ++count;
     }
+    METRICS_GAUGE_ADD("timer.size", -count);
 }
 /**********Sorted_timer_list********** */
 /*
@@ -29,12 +41,46 @@ Sorted_timer_list::~Sorted_timer_list(){
 @ return: 无
 */
 void Sorted_timer_list::add_timer(Util_timer *timer){
+    if(!timer){
+        return;
+    }
+    //入队时排序键与过期时间一致
+    timer->Queued_time = timer->Time_out;
+    if(timer->Slack < 0){
+        timer->Slack = m_default_slack;
+    }
     //调用私有插入函数实现插入算法
     insert_timer(timer, head);
+    notify_wakeup(timer);
+    //所有链表（每个事件循环、每个分片各一个）共用一个总数
+    METRICS_GAUGE_ADD("timer.size", 1);
+}
+
+//定时器最晚的处理时间，0保留给"没有定时器"
+static inline time_t deadline_of(const Util_timer *timer){
+    time_t deadline = timer->Time_out + timer->Slack;
+    return deadline > 0 ? deadline : 1;
 }
 
 /*
-@ function: 插入定时器
+@ function: 新定时器要求比已设置的唤醒时间更早处理时，通知驱动方提前唤醒
+@ param: timer (Util_timer *)
+@ return: 无
+晚于已设置唤醒时间的定时器不需要通知，会在那次唤醒之后由next_expiry()重新计算
+*/
+void Sorted_timer_list::notify_wakeup(Util_timer *timer){
+    time_t deadline = deadline_of(timer);
+    if(m_armed != 0 && m_armed <= deadline){
+        return;
+    }
+    m_armed = deadline;
+    if(m_wakeup_cb){
+        m_wakeup_cb(m_wakeup_arg, deadline);
+    }
+}
+
+/*
+@ function: 插入定时器，按Queued_time保持升序
 @ param: timer (Util_timer* )
 @ param: list_head (Util_timer* )
 @ return: 无
@@ -51,7 +97,7 @@ void Sorted_timer_list::insert_timer(Util_timer *timer, Util_timer *list_head){
     }
     
     //如果新建的节点的超时时间小于头节点那么就头插进头节点
-    if(timer->Time_out < list_head->Time_out){
+    if(timer->Queued_time < list_head->Queued_time){
         timer -> next = list_head;
         timer -> prev = NULL;
         list_head -> prev = timer;
@@ -60,7 +106,7 @@ void Sorted_timer_list::insert_timer(Util_timer *timer, Util_timer *list_head){
     }
     
     //如果新建的节点的超时时间大于等于尾节点那么就尾插进尾节点
-    if(timer->Time_out >= tail->Time_out){
+    if(timer->Queued_time >= tail->Queued_time){
         timer -> prev = tail;
         timer -> next = NULL;
         tail -> next = timer;
@@ -69,9 +115,10 @@ void Sorted_timer_list::insert_timer(Util_timer *timer, Util_timer *list_head){
     }
 
     //中间插入，根据timer的超时时间与头节点还是尾节点的超时时间的距离选择合适的方向进行遍历
-    if((timer -> Time_out - list_head ->Time_out) < (tail -> Time_out - timer -> Time_out)){
+    if((timer -> Queued_time - list_head -> Queued_time) < (tail -> Queued_time - timer -> Queued_time)){
+        //相同过期时间的节点插在后面，保证找到的temp一定不是头节点
         Util_timer *temp = head;
-        while(temp && temp -> Time_out < timer -> Time_out){
+        while(temp && temp -> Queued_time <= timer -> Queued_time){
             temp = temp -> next;
         }
         timer -> next = temp;
@@ -80,125 +127,683 @@ void Sorted_timer_list::insert_timer(Util_timer *timer, Util_timer *list_head){
         temp -> prev = timer;
     }else{
         Util_timer *temp = tail;
-        while(temp && temp -> Time_out > timer -> Time_out){
+        while(temp && temp -> Queued_time > timer -> Queued_time){
             temp = temp -> prev;
         }
         timer -> prev = temp;
         timer -> next = temp -> next;
+        temp -> next -> prev = timer;
         temp -> next = timer;
-        temp ->next ->prev = timer;
     }
 }
 
+/*
+@ function: 把定时器从链表中摘下
+@ param: timer (Util_timer *)
+@ return: 无
+*/
+void Sorted_timer_list::remove_timer(Util_timer *timer){
+    if(timer -> prev){
+        timer -> prev -> next = timer -> next;
+    }else{
+        head = timer -> next;
+    }
+
+    if(timer -> next){
+        timer -> next -> prev = timer -> prev;
+    }else{
+        tail = timer -> prev;
+    }
+    timer -> next = timer -> prev = NULL;
+}
+
 /*
 @ function: 定时器调整函数
 @ param: timer (Util_timer *)
 @ return: 无
+连接每次有活动都会调用，绝大多数情况只是把Time_out往后推，此时不移动节点，
+等Queued_time到期时由tick()重新入队
 */
 void Sorted_timer_list::adjust_timer(Util_timer *timer){
     if(!timer){
         return;
     }
 
-    Util_timer *next_timer = timer -> next;
+    //过期时间延后，链表顺序仍然由旧的Queued_time保证，O(1)返回
+    if(timer -> Time_out >= timer -> Queued_time){
+        return;
+    }
 
-    //检查timer的Time_out更改后容器是否还满足对超时时间升序
-    if (!next_timer || (timer->Time_out < next_timer->Time_out))
-    {
+    //过期时间提前，必须摘下后按新的时间重新插入
+    remove_timer(timer);
+    timer -> Queued_time = timer -> Time_out;
+    insert_timer(timer, head);
+    notify_wakeup(timer);
+}
+
+/*
+@ function: 定时器删除函数
+@ param: timer (Util_timer *)
+@ return: 无
+*/
+void Sorted_timer_list::del_timer(Util_timer *timer){
+    if(!timer){
         return;
     }
 
-    //将timer从容器中单独提取出来
-    if (timer == head)
+    remove_timer(timer);
+    delete timer;
+    METRICS_GAUGE_ADD("timer.size", -1);
+}
+
+/*
+@ function: 设置批量到期回调
+@ param: single (void (*)(client_data *))
+@ param: batch (Batch_cb)
+@ return: 无
+*/
+void Sorted_timer_list::set_batch_callback(void (*single)(client_data *), Batch_cb batch){
+    m_single_cb = single;
+    m_batch_cb = batch;
+}
+
+/*
+@ function: 设置每次tick()的处理上限
+@ param: budget (int) <=0表示不限制
+@ return: 无
+*/
+void Sorted_timer_list::set_tick_budget(int budget){
+    m_budget = budget;
+}
+
+/*
+@ function: 设置默认的合并窗口
+@ param: slack (time_t) 秒
+@ return: 无
+*/
+void Sorted_timer_list::set_default_slack(time_t slack){
+    m_default_slack = slack > 0 ? slack : 0;
+}
+
+/*
+@ function: 设置唤醒回调
+@ param: cb (Wakeup_cb)
+@ param: arg (void *)
+@ return: 无
+*/
+void Sorted_timer_list::set_wakeup_callback(Wakeup_cb cb, void *arg){
+    m_wakeup_cb = cb;
+    m_wakeup_arg = arg;
+}
+
+/*
+@ function: 设置到期释放通知
+@ param: cb (Expire_cb)
+@ param: arg (void *)
+@ return: 无
+*/
+void Sorted_timer_list::set_expire_callback(Expire_cb cb, void *arg){
+    m_expire_cb = cb;
+    m_expire_arg = arg;
+}
+
+/*
+@ function: 计算下一次唤醒时间
+@ return: (time_t) 链表为空时返回0
+按Queued_time升序扫描，Time_out不早于Queued_time，所以Queued_time已经不早于当前最小值的节点之后
+都不会更早，可以停止；Time_out已经延后的表头节点按Time_out计算，不会为它们单独唤醒一次
+*/
+time_t Sorted_timer_list::next_expiry(){
+    time_t best = 0;
+    int scanned = 0;
+    for(Util_timer *temp = head; temp; temp = temp->next){
+        if(best && temp->Queued_time >= best){
+            break;
+        }
+        //扫描过长时，以该节点的Queued_time作为保守的唤醒时间
+        if(++scanned > NEXT_EXPIRY_SCAN){
+            best = temp->Queued_time > 0 ? temp->Queued_time : 1;
+            break;
+        }
+        time_t deadline = deadline_of(temp);
+        if(!best || deadline < best){
+            best = deadline;
+        }
+    }
+    m_armed = best;
+    return best;
+}
+
+/*
+@ function: 定时器检查函数
+@ param: 无
+@ return: (bool) 是否还有留到下一次处理的到期定时器
+*/
+bool Sorted_timer_list::tick(){
+    METRICS_COUNT("timer.ticks", 1);
+    //本次唤醒已经用掉，驱动方调用next_expiry()之前添加的定时器都要通知
+    m_armed = 0;
+    if (!head)
     {
-        head = head -> next;
-        head -> prev = NULL;
+        return false;
+    }
+    
+    time_t current_time = time(NULL);
+    Util_timer *temp = head;
+    m_expired.clear();
+    m_batch.clear();
+
+    //遍历链表找到没有超时的第一个节点，先把到期节点全部摘下
+    while (temp)
+    {
+        //升序链表，表头是Queued_time的最小值
+        if(current_time < temp->Queued_time){
+            break;
+        }
+
+        //本次预算用完，剩下的到期节点留在表头，下次继续
+        if(m_budget > 0 && (int)m_expired.size() >= m_budget){
+            break;
+        }
+
+        remove_timer(temp);
+
+        //期间有活动把Time_out延后了，按新的时间重新入队，一般直接尾插
+        if(current_time < temp->Time_out){
+            temp -> Queued_time = temp -> Time_out;
+            insert_timer(temp, head);
+            temp = head;
+            continue;
+        }
+
+        m_expired.push_back(temp);
+        temp = head;
+    }
+
+    //回调函数与批量回调匹配的连接一次处理，其余逐个调用
+    for(size_t i = 0; i < m_expired.size(); ++i){
+        Util_timer *timer = m_expired[i];
+        if(m_batch_cb && timer->cb_func == m_single_cb){
+            m_batch.push_back(timer->user_data);
+        }else{
+            timer->cb_func(timer->user_data);
+        }
+    }
+    if(!m_batch.empty()){
+        m_batch_cb(&m_batch[0], (int)m_batch.size());
+    }
+
+    for(size_t i = 0; i < m_expired.size(); ++i){
+        if(m_expire_cb){
+            m_expire_cb(m_expire_arg, m_expired[i]);
+        }
+        delete m_expired[i];
+    }
+    METRICS_GAUGE_ADD("timer.size", -(long)m_expired.size());
+    METRICS_COUNT("timer.expired", (long)m_expired.size());
+    METRICS_RECORD("timer.expired_per_tick", (long)m_expired.size());
+
+    return head && head->Queued_time <= current_time;
+}
+
+
+/**********Fifo_timer_list********** */
+/*
+@ function: 基础构造函数
+@ return: 无
+*/
+Fifo_timer_list::Fifo_timer_list(){
+    m_class_number = 0;
+    m_idle_cb = NULL;
+    m_idle_after = 0;
+    m_budget = DEFAULT_TICK_BUDGET;
+    m_single_cb = NULL;
+    m_batch_cb = NULL;
+    m_default_slack = 0;
+    m_armed = 0;
+    m_wakeup_cb = NULL;
+    m_wakeup_arg = NULL;
+}
+
+/*
+@ function: 基础析构函数，后备链表由自己的析构函数释放
+@ return: 无
+*/
+Fifo_timer_list::~Fifo_timer_list(){
+    long count = 0;
+    for(int i = 0; i < m_class_number; ++i){
+        Util_timer *temp = m_classes[i].head;
+        while(temp){
+            Util_timer *next = temp->next;
+            delete temp;
+            temp = next;
+            ++count;
+        }
+    }
+    METRICS_GAUGE_ADD("timer.size", -count);
+}
+
+/*
+@ function: 注册一种固定时长
+@ param: timeout (time_t) 秒
+@ return: (int) 类别编号，种类已满时返回-1
+*/
+int Fifo_timer_list::add_class(time_t timeout){
+    for(int i = 0; i < m_class_number; ++i){
+        if(m_classes[i].timeout == timeout){
+            return i;
+        }
+    }
+    if(m_class_number >= MAX_FIFO_CLASSES){
+        return -1;
+    }
+    m_classes[m_class_number].timeout = timeout;
+    m_classes[m_class_number].head = NULL;
+    m_classes[m_class_number].tail = NULL;
+    m_classes[m_class_number].idle = NULL;
+    return m_class_number++;
+}
+
+/*
+@ function: 按剩余时长匹配类别
+@ param: timeout (time_t) 过期时间
+@ return: (int)
+*/
+int Fifo_timer_list::find_class(time_t timeout){
+    if(m_class_number == 0){
+        return -1;
+    }
+    time_t duration = timeout - time(NULL);
+    for(int i = 0; i < m_class_number; ++i){
+        if(m_classes[i].timeout == duration || m_classes[i].timeout == duration + 1){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+@ function: 从所在的FIFO链表摘下
+@ param: timer (Util_timer *)
+@ return: 无
+*/
+void Fifo_timer_list::unlink_timer(Util_timer *timer){
+    Fifo_class &c = m_classes[timer->Fifo_class];
+    if(c.idle == timer){
+        c.idle = timer->next;
+    }
+    if(timer->prev){
+        timer->prev->next = timer->next;
     }else{
-        timer->prev->next = timer -> next;
-        if(timer -> next){
-            timer->next->prev = timer -> prev;
+        c.head = timer->next;
+    }
+    if(timer->next){
+        timer->next->prev = timer->prev;
+    }else{
+        c.tail = timer->prev;
+    }
+    timer->prev = timer->next = NULL;
+    timer->Fifo_class = -1;
+}
+
+/*
+@ function: 加到FIFO链表表尾
+@ param: timer (Util_timer *)
+@ param: fifo_class (int)
+@ return: 无
+*/
+void Fifo_timer_list::append_timer(Util_timer *timer, int fifo_class){
+    Fifo_class &c = m_classes[fifo_class];
+    timer->Fifo_class = fifo_class;
+    timer->Queued_time = timer->Time_out;
+    timer->next = NULL;
+    timer->prev = c.tail;
+    if(c.tail){
+        c.tail->next = timer;
+    }else{
+        c.head = timer;
+    }
+    c.tail = timer;
+    //之前的定时器都已经报告过空闲，从这个开始检查
+    if(!c.idle){
+        c.idle = timer;
+        if(m_idle_cb){
+            notify_wakeup(idle_deadline(c, timer));
         }
     }
-    timer->next = timer->prev = NULL;
+}
 
-    //重新插入
-    insert_timer(timer, next_timer ? next_timer : head);
+/*
+@ function: 加到FIFO链表表头
+@ param: timer (Util_timer *)
+@ param: fifo_class (int)
+@ return: 无
+*/
+void Fifo_timer_list::prepend_timer(Util_timer *timer, int fifo_class){
+    Fifo_class &c = m_classes[fifo_class];
+    timer->Fifo_class = fifo_class;
+    timer->Queued_time = timer->Time_out;
+    timer->prev = NULL;
+    timer->next = c.head;
+    if(c.head){
+        c.head->prev = timer;
+    }else{
+        c.tail = timer;
+    }
+    c.head = timer;
+    //空闲游标可能已经越过表头，退回到这个定时器重新检查；
+    //之间已经报告过的定时器会再报告一次，Input_buffer::Release可以重复调用
+    if(m_idle_cb){
+        c.idle = timer;
+        notify_wakeup(idle_deadline(c, timer));
+    }
 }
 
 /*
-@ function: 定时器删除函数
+@ function: 把已经摘下的定时器按Time_out插入后备链表
 @ param: timer (Util_timer *)
 @ return: 无
 */
-void Sorted_timer_list::del_timer(Util_timer *timer){
+void Fifo_timer_list::fallback_timer(Util_timer *timer){
+    timer->Fifo_class = -1;
+    timer->Queued_time = timer->Time_out;
+    m_fallback.insert_timer(timer, m_fallback.head);
+}
+
+/*
+@ function: 添加定时器，按剩余时长选择类别
+@ param: timer (Util_timer *)
+@ return: 无
+*/
+void Fifo_timer_list::add_timer(Util_timer *timer){
     if(!timer){
         return;
     }
+    add_timer(timer, find_class(timer->Time_out));
+}
 
-    //如果只有一个节点
-    if(timer == head && timer == tail){
-        delete timer;
-        head = tail = NULL;
+/*
+@ function: 添加定时器到指定类别
+@ param: timer (Util_timer *)
+@ param: fifo_class (int)
+@ return: 无
+跨秒取时间的调用方可能比表尾早1秒，此时放进后备链表，保证每个FIFO链表有序
+*/
+void Fifo_timer_list::add_timer(Util_timer *timer, int fifo_class){
+    if(!timer){
+        return;
+    }
+    if(timer->Slack < 0){
+        timer->Slack = m_default_slack;
+    }
+    if(fifo_class < 0 || fifo_class >= m_class_number ||
+       (m_classes[fifo_class].tail && timer->Time_out < m_classes[fifo_class].tail->Time_out)){
+        timer->Fifo_class = -1;
+        m_fallback.add_timer(timer);
+        return;
+    }
+    append_timer(timer, fifo_class);
+    notify_wakeup(deadline_of(timer));
+    METRICS_GAUGE_ADD("timer.size", 1);
+}
+
+/*
+@ function: 定时器调整函数
+@ param: timer (Util_timer *)
+@ return: 无
+连接每次有活动都会调用，新的过期时间是"当前时间+同样的时长"，总是移到表尾
+*/
+void Fifo_timer_list::adjust_timer(Util_timer *timer){
+    if(!timer){
         return;
     }
 
-    //如果timer是头节点
-    if(head == timer){
-        head = head -> next;
-        head -> prev = NULL;
-        delete timer;
+    if(timer->Fifo_class < 0){
+        //后备链表中的定时器能匹配类别且不早于表尾时移进FIFO链表，否则留在后备链表
+        int fifo_class = find_class(timer->Time_out);
+        if(fifo_class < 0 ||
+           (m_classes[fifo_class].tail && timer->Time_out < m_classes[fifo_class].tail->Time_out)){
+            m_fallback.adjust_timer(timer);
+            return;
+        }
+        m_fallback.remove_timer(timer);
+        append_timer(timer, fifo_class);
+        notify_wakeup(deadline_of(timer));
         return;
     }
 
-    //如果timer是尾节点
-    if(timer == tail){
-        tail = tail-> prev;
-        tail -> next = NULL;
-        delete timer;
+    //与除自己以外的表尾、表头比较
+    int fifo_class = timer->Fifo_class;
+    Fifo_class &c = m_classes[fifo_class];
+    Util_timer *last = c.tail == timer ? timer->prev : c.tail;
+    Util_timer *first = c.head == timer ? timer->next : c.head;
+    if(!last || timer->Time_out >= last->Time_out){
+        if(c.tail != timer){
+            unlink_timer(timer);
+            append_timer(timer, fifo_class);
+        }else{
+            timer->Queued_time = timer->Time_out;
+        }
+        if(c.head == timer){
+            notify_wakeup(deadline_of(timer));
+        }
+        return;
+    }
+    if(timer->Time_out <= first->Time_out){
+        if(c.head != timer){
+            unlink_timer(timer);
+            prepend_timer(timer, fifo_class);
+        }else{
+            timer->Queued_time = timer->Time_out;
+        }
+        notify_wakeup(deadline_of(timer));
         return;
     }
 
-    //中间位置的删除与普通的链表删除节点一致
-    timer -> prev -> next = timer -> next;
-    timer -> next -> prev = timer -> prev;
+    //时长变了：换到对应的FIFO链表，匹配不到或顺序不对时放进后备链表
+    unlink_timer(timer);
+    int target = find_class(timer->Time_out);
+    if(target >= 0 && (!m_classes[target].tail || timer->Time_out >= m_classes[target].tail->Time_out)){
+        append_timer(timer, target);
+    }else{
+        fallback_timer(timer);
+    }
+    notify_wakeup(deadline_of(timer));
+}
+
+/*
+@ function: 定时器删除函数
+@ param: timer (Util_timer *)
+@ return: 无
+*/
+void Fifo_timer_list::del_timer(Util_timer *timer){
+    if(!timer){
+        return;
+    }
+    if(timer->Fifo_class < 0){
+        m_fallback.del_timer(timer);
+        return;
+    }
+    unlink_timer(timer);
     delete timer;
+    METRICS_GAUGE_ADD("timer.size", -1);
 }
 
 /*
-@ function: 定时器检查函数
-@ param: 无
+@ function: 设置批量到期回调
+@ param: single (void (*)(client_data *))
+@ param: batch (Batch_cb)
 @ return: 无
 */
-void Sorted_timer_list::tick(){
-    if (!head)
-    {
+void Fifo_timer_list::set_batch_callback(void (*single)(client_data *), Batch_cb batch){
+    m_single_cb = single;
+    m_batch_cb = batch;
+    m_fallback.set_batch_callback(single, batch);
+}
+
+/*
+@ function: 设置每次tick()的处理上限，FIFO链表和后备链表各自计算
+@ param: budget (int) <=0表示不限制
+@ return: 无
+*/
+void Fifo_timer_list::set_tick_budget(int budget){
+    m_budget = budget;
+    m_fallback.set_tick_budget(budget);
+}
+
+/*
+@ function: 设置默认的合并窗口
+@ param: slack (time_t) 秒
+@ return: 无
+*/
+void Fifo_timer_list::set_default_slack(time_t slack){
+    m_default_slack = slack > 0 ? slack : 0;
+    m_fallback.set_default_slack(slack);
+}
+
+/*
+@ function: 设置唤醒回调，后备链表的通知也经过本对象
+@ param: cb (Wakeup_cb)
+@ param: arg (void *)
+@ return: 无
+*/
+void Fifo_timer_list::set_wakeup_callback(Wakeup_cb cb, void *arg){
+    m_wakeup_cb = cb;
+    m_wakeup_arg = arg;
+    m_fallback.set_wakeup_callback(cb ? Fallback_wakeup : NULL, this);
+}
+
+/*
+@ function: 设置空闲回调
+@ param: cb (void (*)(client_data *))
+@ param: idle_after (time_t) 秒
+@ return: 无
+*/
+void Fifo_timer_list::set_idle_callback(void (*cb)(client_data *), time_t idle_after){
+    m_idle_cb = cb;
+    m_idle_after = idle_after > 0 ? idle_after : 0;
+}
+
+void Fifo_timer_list::Fallback_wakeup(void *arg, time_t wake){
+    ((Fifo_timer_list *)arg)->notify_wakeup(wake);
+}
+
+/*
+@ function: 比已设置的唤醒时间更早时通知驱动方
+@ param: deadline (time_t)
+@ return: 无
+*/
+void Fifo_timer_list::notify_wakeup(time_t deadline){
+    if(m_armed != 0 && m_armed <= deadline){
         return;
     }
-    
-    time_t current_time = time(NULL);
-    Util_timer *temp = head;
+    m_armed = deadline;
+    if(m_wakeup_cb){
+        m_wakeup_cb(m_wakeup_arg, deadline);
+    }
+}
 
-    //遍历链表找到没有超时的第一个节点
-    while (temp)
-    {
-        //升序链表，表头是Time_out的最小值
-        if(current_time < temp->Time_out){
-            break;
+/*
+@ function: 计算下一次唤醒时间
+@ return: (time_t) 没有定时器时返回0
+同一链表的Slack一般相同，表头就是该链表最早的处理时间
+*/
+time_t Fifo_timer_list::next_expiry(){
+    time_t best = m_fallback.next_expiry();
+    for(int i = 0; i < m_class_number; ++i){
+        if(m_classes[i].head){
+            time_t deadline = deadline_of(m_classes[i].head);
+            if(!best || deadline < best){
+                best = deadline;
+            }
+        }
+        if(m_idle_cb && m_classes[i].idle){
+            time_t deadline = idle_deadline(m_classes[i], m_classes[i].idle);
+            deadline = deadline > 0 ? deadline : 1;
+            if(!best || deadline < best){
+                best = deadline;
+            }
         }
+    }
+    m_armed = best;
+    return best;
+}
 
-        //执行回调函数
-        temp -> cb_func(temp -> user_data);
+/*
+@ function: 定时器检查函数，每个FIFO链表只需要从表头弹出
+@ param: 无
+@ return: (bool) 是否还有留到下一次处理的到期定时器
+timer.ticks由后备链表的tick()统计
+*/
+bool Fifo_timer_list::tick(){
+    bool more = m_fallback.tick();
+    m_armed = 0;
 
-        head = temp -> next;
+    time_t current_time = time(NULL);
+    m_expired.clear();
+    m_batch.clear();
+    for(int i = 0; i < m_class_number; ++i){
+        Fifo_class &c = m_classes[i];
+        while(c.head && c.head->Time_out <= current_time){
+            if(m_budget > 0 && (int)m_expired.size() >= m_budget){
+                more = true;
+                break;
+            }
+            Util_timer *temp = c.head;
+            unlink_timer(temp);
+            m_expired.push_back(temp);
+        }
+    }
+    if(m_expired.empty()){
+        tick_idle(current_time);
+        return more;
+    }
 
-        if(head){
-            head -> prev = NULL;
+    for(size_t i = 0; i < m_expired.size(); ++i){
+        Util_timer *timer = m_expired[i];
+        if(m_batch_cb && timer->cb_func == m_single_cb){
+            m_batch.push_back(timer->user_data);
+        }else{
+            timer->cb_func(timer->user_data);
         }
+    }
+    if(!m_batch.empty()){
+        m_batch_cb(&m_batch[0], (int)m_batch.size());
+    }
 
-        delete temp;
-        temp = head;
+    for(size_t i = 0; i < m_expired.size(); ++i){
+        delete m_expired[i];
+    }
+    METRICS_GAUGE_ADD("timer.size", -(long)m_expired.size());
+    METRICS_COUNT("timer.expired", (long)m_expired.size());
+    METRICS_RECORD("timer.expired_per_tick", (long)m_expired.size());
+    tick_idle(current_time);
+    return more;
+}
+
+/*
+@ function: 从各链表的游标开始，把空闲超过阈值的连接交给空闲回调
+@ param: current_time (time_t)
+@ return: 无
+到期的定时器已经在此之前弹出，不会先报告空闲再关闭
+*/
+void Fifo_timer_list::tick_idle(time_t current_time){
+    if(!m_idle_cb){
+        return;
+    }
+    long parked = 0;
+    for(int i = 0; i < m_class_number; ++i){
+        Fifo_class &c = m_classes[i];
+        while(c.idle && c.idle->Time_out - c.timeout + m_idle_after <= current_time){
+            Util_timer *timer = c.idle;
+            c.idle = timer->next;
+            m_idle_cb(timer->user_data);
+            ++parked;
+        }
+    }
+    if(parked > 0){
+        METRICS_COUNT("timer.idle", parked);
     }
-        
 }
 
 
@@ -207,10 +812,35 @@ void Sorted_timer_list::tick(){
 @ function: 初始化定时间隔
 @ param: timeslot (int) 定时器的定时间隔
 @ return: 无
-在服务器启动时调用，设置定时间隔
+在服务器启动时调用，设置定时间隔。原来每m_TIMESLOT秒检查一次，定时器最多推迟m_TIMESLOT秒处理，
+默认合并窗口取同样的值，超时的最坏延迟不变，唤醒次数只取决于定时器本身
 */
 void Utils::Init(int timeslot){
     m_TIMESLOT = timeslot;
+    m_timer_list.set_batch_callback(cb_func, cb_func_batch);
+    m_timer_list.set_default_slack(timeslot);
+    //连接的空闲超时是3*timeslot，这类定时器走FIFO链表
+    m_timer_list.add_class(3 * timeslot);
+}
+
+//系统调用计数，多个线程都会调用Utils，使用原子加
+#define COUNT_SYSCALL(field, n) __atomic_fetch_add(&Utils::u_syscalls.field, (n), __ATOMIC_RELAXED)
+
+//fd号在缓存范围内才使用缓存
+static inline bool fd_cached(int fd){
+    return fd >= 0 && fd < UTILS_MAX_FD;
+}
+
+//根据监听事件、ONESHOT和触发模式组合出epoll事件掩码
+static inline uint32_t build_events(int ev, bool one_shot, int TRIGMode){
+    uint32_t events = ev | EPOLLRDHUP;
+    if (TRIGMode == 1){
+        events |= EPOLLET;
+    }
+    if(one_shot){
+        events |= EPOLLONESHOT;
+    }
+    return events;
 }
 
 /*
@@ -224,26 +854,118 @@ int Utils::SetNonBlocking(int fd){
     //添加非阻塞模式文件标识符O_NONBLOCK到open标志位
     int new_option = old_option | O_NONBLOCK;
     fcntl(fd, F_SETFL, new_option);
+    COUNT_SYSCALL(fcntl, 2);
     return old_option;
 }
 
-int Utils::Addfd(int epollfd, int fd, bool one_shot, int TRIGMode){
+/*
+@ function: 注册fd到epoll，只监听读事件
+@ param: epollfd (int)
+@ param: fd (int)
+@ param: one_shot (bool)
+@ param: TRIGMode (int)
+@ return: 无
+fd刚由Accept()得到时已经是非阻塞的，不再调用SetNonBlocking；标志用过即清除，
+关闭路径漏了ForgetFd、fd号又被其他方式复用时，仍然会调用fcntl，不会把阻塞的socket注册成ET
+*/
+void Utils::Addfd(int epollfd, int fd, bool one_shot, int TRIGMode){
     epoll_event event;
     event.data.fd = fd;
+    event.events = build_events(EPOLLIN, one_shot, TRIGMode);
 
-    if (TRIGMode == 1){
-        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    COUNT_SYSCALL(epoll_ctl, 1);
+
+    if(!fd_cached(fd)){
+        SetNonBlocking(fd);
+        return;
     }
-    else{
-        event.events = EPOLLIN | EPOLLRDHUP;
+
+    Fd_state &state = u_fd_state[fd];
+    state.events = event.events;
+    state.registered = true;
+    if(state.nonblocking){
+        state.nonblocking = false;
+        COUNT_SYSCALL(fcntl_saved, 2);
+    }else{
+        SetNonBlocking(fd);
     }
+}
 
-    if(one_shot){
-        event.events |= EPOLLONESHOT;
+/*
+@ function: 接受一个连接，连接fd直接带上非阻塞标志
+@ param: listenfd (int)
+@ param: address (sockaddr_in *) 传出参数
+@ return: (int) 连接fd，失败返回-1
+*/
+int Utils::Accept(int listenfd, sockaddr_in *address){
+    socklen_t addrlength = sizeof(*address);
+    int connfd = accept4(listenfd, (struct sockaddr *)address, &addrlength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    COUNT_SYSCALL(accept, 1);
+    if(connfd >= 0 && fd_cached(connfd)){
+        Fd_state &state = u_fd_state[connfd];
+        state.events = 0;
+        state.registered = false;
+        state.nonblocking = true;
+    }
+    return connfd;
+}
+
+/*
+@ function: 修改fd监听的事件
+@ param: epollfd (int)
+@ param: fd (int)
+@ param: ev (int) EPOLLIN或EPOLLOUT
+@ param: one_shot (bool)
+@ param: TRIGMode (int)
+@ return: 无
+只有一个线程操作fd时（多reactor模式）不需要ONESHOT，掩码不变就省掉epoll_ctl；
+ONESHOT由工作线程重新启用，此时主线程可能正在Accept/ForgetFd同一个（被复用的）fd号，
+缓存不是原子的，只在!one_shot这条单线程路径上读写，ONESHOT总是调用epoll_ctl
+*/
+void Utils::Modfd(int epollfd, int fd, int ev, bool one_shot, int TRIGMode){
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = build_events(ev, one_shot, TRIGMode);
+
+    if(!one_shot && fd_cached(fd)){
+        Fd_state &state = u_fd_state[fd];
+        if(state.registered && state.events == event.events){
+            COUNT_SYSCALL(epoll_ctl_saved, 1);
+            return;
+        }
+        state.events = event.events;
+        state.registered = true;
+    }
+
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+    COUNT_SYSCALL(epoll_ctl, 1);
+}
+
+/*
+@ function: 从epoll删除fd并关闭
+@ param: epollfd (int)
+@ param: fd (int)
+@ return: 无
+*/
+void Utils::Removefd(int epollfd, int fd){
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
+    COUNT_SYSCALL(epoll_ctl, 1);
+    ForgetFd(fd);
+    close(fd);
+}
+
+/*
+@ function: 清除fd状态缓存
+@ param: fd (int)
+@ return: 无
+*/
+void Utils::ForgetFd(int fd){
+    if(fd_cached(fd)){
+        u_fd_state[fd].events = 0;
+        u_fd_state[fd].registered = false;
+        u_fd_state[fd].nonblocking = false;
     }
-    
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    SetNonBlocking(fd);
 }
 
 //信号处理函数
@@ -267,25 +989,63 @@ void Utils::AddSig(int sig, void(handler)(int), bool restart){
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-//定时处理任务，每次SIGALRM信号触发后调用tick函数处理到期的定时器，并且充值定时器alarm
+//定时处理任务，每次SIGALRM信号触发后调用tick函数处理到期的定时器，并且按下一个到期时间重置alarm
+//第一次SIGALRM之后才由链表接管alarm，用epoll超时驱动m_timer_list的调用方（多reactor、load_gen）不会收到SIGALRM
 void Utils::TimerHandler(){
-    m_timer_list.tick();
-    alarm(m_TIMESLOT);
+    m_timer_list.set_wakeup_callback(ArmAlarm, NULL);
+    if(m_timer_list.tick()){
+        alarm(1);
+        return;
+    }
+    ArmAlarm(NULL, m_timer_list.next_expiry());
+}
+
+//alarm是进程级的，只有主线程的m_timer_list使用
+void Utils::ArmAlarm(void *, time_t wake){
+    if(wake == 0){
+        alarm(0);
+        return;
+    }
+    time_t now = time(NULL);
+    alarm(wake > now ? (unsigned int)(wake - now) : 1);
 }
 
 //向客户端发送错误信息并且关闭链接
 void Utils::ShowError(int connfd, const char *info){
     send(connfd, info, strlen(info), 0);
+    ForgetFd(connfd);
     close(connfd);
 }
 
 int *Utils::u_pipefd = NULL;
 int Utils::u_epollfd = 0;
+Fd_state Utils::u_fd_state[UTILS_MAX_FD];
+Syscall_stats Utils::u_syscalls;
+thread_local int Utils::u_loop_epollfd = 0;
+
+//多reactor模式下每个事件循环线程有自己的epoll，单reactor模式下退回全局的u_epollfd
+int Utils::CurrentEpollfd(){
+    return u_loop_epollfd > 0 ? u_loop_epollfd : u_epollfd;
+}
 
 void cb_func(client_data *user_data){
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, NULL);
+    epoll_ctl(Utils::CurrentEpollfd(), EPOLL_CTL_DEL, user_data->sockfd, NULL);
+    COUNT_SYSCALL(epoll_ctl, 1);
     assert(user_data);
+    Utils::ForgetFd(user_data->sockfd);
     close(user_data->sockfd);
-    http_conn::m_user_count--;
+    __atomic_fetch_sub(&http_conn::m_user_count, 1, __ATOMIC_RELAXED);
+}
+
+void cb_func_batch(client_data **users, int count){
+    int epollfd = Utils::CurrentEpollfd();
+    for(int i = 0; i < count; ++i){
+        int sockfd = users[i]->sockfd;
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, sockfd, NULL);
+        Utils::ForgetFd(sockfd);
+        close(sockfd);
+    }
+    COUNT_SYSCALL(epoll_ctl, count);
+    __atomic_fetch_sub(&http_conn::m_user_count, count, __ATOMIC_RELAXED);
 }
 
@@ -28,7 +28,9 @@
 #include <sys/uio.h>
 #include <time.h>
 //用于时间管理
+#include <vector>
 #include "../log/log.h"
+#include "../metrics/Metrics.h"
 
 /*
 类的前向声明
@@ -36,6 +38,7 @@
 class Util_timer;
 class Utils;
 class Sorted_timer_list;
+class Fifo_timer_list;
 
 /*
 struct: client_data
@@ -57,9 +60,19 @@ class: Util_timer
 定时器节点类实现
 @ function: 实现一个定时器节点
 public:
-@ param Time_out: 过期时间
+@ param Time_out: 过期时间，连接有活动时只需要更新这个字段
 @ type time_t
 
+@ param Queued_time: 定时器在链表中排序所用的过期时间，Time_out延后时不立即更新，由tick()惰性处理
+@ type time_t
+
+@ param Slack: 允许推迟的秒数，过期时间在[Time_out, Time_out+Slack]内的定时器合并到同一次唤醒处理；
+               -1表示使用链表的默认值，add_timer时确定
+@ type time_t
+
+@ param Fifo_class: 所在的固定时长FIFO链表编号，-1表示在有序链表中（只由Fifo_timer_list使用）
+@ type int
+
 @ param cb_func: 回调函数
 @ type void (*)(client_data *)
 
@@ -78,14 +91,42 @@ public:
 class Util_timer
 {
 public:
-    Util_timer() : prev(NULL), next(NULL) {}
+    Util_timer() : Queued_time(0), Slack(-1), Fifo_class(-1), prev(NULL), next(NULL) {}
     time_t Time_out;
+    time_t Queued_time;
+    time_t Slack;
+    int Fifo_class;
     void (* cb_func)(client_data *);
     client_data *user_data;
     Util_timer *prev;
     Util_timer *next;
 };
 
+/*
+@ type Batch_cb: 批量到期回调，一次处理tick()收集到的所有到期连接
+*/
+typedef void (*Batch_cb)(client_data **users, int count);
+
+/*
+@ type Wakeup_cb: 唤醒时间提前时的通知，wake为新的唤醒时间，由驱动tick()的一方重新设置alarm或唤醒等待的线程
+*/
+typedef void (*Wakeup_cb)(void *arg, time_t wake);
+
+/*
+@ type Expire_cb: 到期定时器被tick()释放之前的通知，供持有定时器指针的一方（如Timer_service的句柄表）同步删除
+*/
+typedef void (*Expire_cb)(void *arg, Util_timer *timer);
+
+//每次tick()默认最多处理的到期定时器数，超出部分留到下一次
+const int DEFAULT_TICK_BUDGET = 1024;
+
+//next_expiry()最多检查的表头节点数，超出时按下一个节点的Queued_time保守地提前唤醒
+const int NEXT_EXPIRY_SCAN = 64;
+
+//按绝对时间等待到next_expiry()时多等的纳秒数：time(NULL)读的是粗粒度时钟，
+//整秒刚到时可能还停在上一秒，醒来后tick()会认为没有到期而空转
+const long TIMER_WAKE_MARGIN_NS = 20 * 1000 * 1000;
+
 /*
 class: Sorted_timer_list
 升序链表容器实现
@@ -108,7 +149,8 @@ public:
 @func: adjust_timer()
 @ param timer: (util_timer *)
 @ return: 无
-@ function: 调整定时器链表容器内的顺序
+@ function: 调整定时器链表容器内的顺序。Time_out延后时为O(1)，不移动节点，
+            只有Time_out提前时才重新插入
 
 @ func: del_timer()
 @ param timer: (util_timer *)
@@ -117,8 +159,37 @@ public:
 
 @ func: tick()
 @ param: 无
+@ return: (bool) 还有到期定时器因预算用完留到下一次时返回true，调用方应尽快再次tick()
+@ function: 定时器到期后，调用回调函数；Queued_time到期但Time_out已经延后的定时器重新入队。
+            到期定时器先收集成一批，cb_func与批量回调对应的单个回调相同的定时器一次交给批量回调，
+            每次最多处理m_budget个
+
+@ func: set_batch_callback()
+@ param single: (void (*)(client_data *)) cb_func为该函数的定时器走批量回调
+@ param batch: (Batch_cb) 批量回调，为NULL时逐个调用cb_func
+@ return: 无
+
+@ func: set_tick_budget()
+@ param budget: (int) 每次tick()最多处理的到期定时器数，<=0表示不限制
+@ return: 无
+
+@ func: set_default_slack()
+@ param slack: (time_t) Slack为-1的定时器使用的默认值(秒)，默认0即不合并
+@ return: 无
+
+@ func: next_expiry()
+@ return: (time_t) 下一次应当调用tick()的时间，即各定时器Time_out+Slack的最小值；链表为空时返回0，表示可以无限期休眠
+@ function: 返回值同时记为当前已设置的唤醒时间，之后添加或提前的定时器只有早于它才通知唤醒回调
+
+@ func: set_wakeup_callback()
+@ param cb: (Wakeup_cb) 新定时器要求比已设置的唤醒时间更早唤醒时调用，为NULL时不通知
+@ param arg: (void *) 原样传给cb
+@ return: 无
+
+@ func: set_expire_callback()
+@ param cb: (Expire_cb) tick()在回调之后、释放每个到期定时器之前调用，为NULL时不通知
+@ param arg: (void *) 原样传给cb
 @ return: 无
-@ function: 定时器到期后，调用回调函数
 
 private: 
 
@@ -127,7 +198,12 @@ private:
 @ param timer: (util_timer *)
 @ param list_head: (util_timer *)
 @ return: 无
-@ function: add_timer()的私有重写函数，负责添加定时器节点到链表内
+@ function: add_timer()的私有重写函数，负责按Queued_time添加定时器节点到链表内
+
+@ func: remove_timer()
+@ param timer: (util_timer *)
+@ return: 无
+@ function: 把定时器节点从链表中摘下，不释放
 
 字段：
 @ param head: (util_timer *)
@@ -135,8 +211,22 @@ private:
 
 @ param tail: (util_timer *)
 @ function: 链表尾节点
+
+@ param m_budget: (int) 每次tick()的处理上限
+
+@ param m_single_cb / m_batch_cb: 批量回调及其对应的单个回调
+
+@ param m_expired / m_batch: (vector) tick()复用的临时数组，避免每次分配
+
+@ param m_default_slack: (time_t) 默认允许推迟的秒数
+
+@ param m_armed: (time_t) 最近一次next_expiry()或唤醒回调设置的唤醒时间，0表示无限期休眠
+
+@ param m_wakeup_cb / m_wakeup_arg: 唤醒回调及其参数
 */
 class Sorted_timer_list{
+    //作为Fifo_timer_list的后备链表时，定时器在两者之间移动不经过add_timer/del_timer
+    friend class Fifo_timer_list;
 public:
     Sorted_timer_list();
 
@@ -148,14 +238,248 @@ public:
 
     void del_timer(Util_timer *timer);
 
-    void tick();
+    bool tick();
+
+    void set_batch_callback(void (*single)(client_data *), Batch_cb batch);
+
+    void set_tick_budget(int budget);
+
+    void set_default_slack(time_t slack);
+
+    time_t next_expiry();
+
+    void set_wakeup_callback(Wakeup_cb cb, void *arg);
+
+    void set_expire_callback(Expire_cb cb, void *arg);
 
 private:
     void insert_timer(Util_timer *timer, Util_timer *list_head);
 
+    void remove_timer(Util_timer *timer);
+
+    void notify_wakeup(Util_timer *timer);
+
     Util_timer *head;
 
     Util_timer *tail;
+
+    int m_budget;
+
+    void (*m_single_cb)(client_data *);
+
+    Batch_cb m_batch_cb;
+
+    std::vector<Util_timer *> m_expired;
+
+    std::vector<client_data *> m_batch;
+
+    time_t m_default_slack;
+
+    time_t m_armed;
+
+    Wakeup_cb m_wakeup_cb;
+
+    void *m_wakeup_arg;
+
+    Expire_cb m_expire_cb;
+
+    void *m_expire_arg;
+};
+
+//Fifo_timer_list最多的固定时长种类数
+const int MAX_FIFO_CLASSES = 8;
+
+/*
+struct: Fifo_class
+一种固定时长的定时器链表
+@ param timeout: (time_t) 时长(秒)
+@ param head / tail: (Util_timer *) 按加入顺序排列，时长相同时也就是按Time_out升序
+@ param idle: (Util_timer *) 第一个还没有报告空闲的定时器，之前的都已经交给空闲回调；
+              刷新的定时器移到表尾，总在它之后
+*/
+struct Fifo_class
+{
+    time_t timeout;
+    Util_timer *head;
+    Util_timer *tail;
+    Util_timer *idle;
+};
+
+/*
+class: Fifo_timer_list
+按固定时长分类的定时器容器
+@ function: 服务器的定时器几乎都是"当前时间+固定时长"（空闲连接、读请求头、写阻塞），同一时长新加入的
+            一定是最晚到期的，FIFO链表天然有序。每种时长一个侵入式FIFO，加入、刷新（移到表尾）、
+            到期弹出都是O(1)，tick()只检查各链表的表头；其余时长的定时器放在后备的Sorted_timer_list中。
+            接口与Sorted_timer_list相同，可以直接替换
+public:
+函数：
+@ func: add_class()
+@ param timeout: (time_t) 时长(秒)
+@ return: (int) 类别编号，已经注册过时返回原编号，种类已满时返回-1
+
+@ func: add_timer()
+@ param timer: (Util_timer *) 按Time_out-time(NULL)匹配已注册的时长（调用方取时间之后可能跨秒，相差1秒也算匹配），
+                              匹配不到的放进后备链表
+@ return: 无
+
+@ func: add_timer()
+@ param timer: (Util_timer *)
+@ param fifo_class: (int) 直接指定类别；比表尾更早到期或fifo_class<0时放进后备链表
+@ return: 无
+
+@ func: adjust_timer()
+@ param timer: (Util_timer *)
+@ function: 不早于表尾时移到表尾，不晚于表头（如立即过期）时移到表头，都是O(1)；
+            否则按新的时长重新分类。后备链表中的定时器能匹配到类别时移出后备链表
+@ return: 无
+
+@ func: set_idle_callback()
+@ param cb: (void (*)(client_data *)) 连接在FIFO链表中超过idle_after秒没有刷新时，在tick()中调用一次，
+                                      用于归还读写缓冲区；回调中不能删除或调整定时器，为NULL时关闭
+@ param idle_after: (time_t) 空闲阈值(秒)，应小于注册的时长
+@ return: 无
+@ function: FIFO链表按最近一次活动排序，每个链表维护一个游标，每次tick()只从游标处向后检查，均摊O(1)；
+            后备链表中的定时器不报告空闲
+
+@ func: del_timer() / tick() / set_batch_callback() / set_tick_budget() /
+        set_default_slack() / next_expiry() / set_wakeup_callback()
+@ function: 与Sorted_timer_list相同，同时作用于后备链表
+
+private:
+@ func: find_class()
+@ param timeout: (time_t) 过期时间
+@ return: (int) 匹配的类别编号，没有时返回-1
+
+@ func: unlink_timer() / append_timer() / prepend_timer()
+@ function: FIFO链表的O(1)操作，不释放节点，不更新计数
+
+@ func: fallback_timer()
+@ function: 把已经摘下的定时器放进后备链表
+
+@ func: notify_wakeup()
+@ param deadline: (time_t) 比已设置的唤醒时间更早时通知唤醒回调
+
+@ func: Fallback_wakeup() 静态函数
+@ function: 后备链表的唤醒回调，转交给notify_wakeup()
+
+字段：
+@ param m_classes / m_class_number: 已注册的固定时长链表
+@ param m_fallback: (Sorted_timer_list) 后备链表
+@ param m_idle_cb / m_idle_after: 空闲回调及阈值
+其余字段与Sorted_timer_list相同
+*/
+class Fifo_timer_list{
+public:
+    Fifo_timer_list();
+
+    ~Fifo_timer_list();
+
+    int add_class(time_t timeout);
+
+    void add_timer(Util_timer *timer);
+
+    void add_timer(Util_timer *timer, int fifo_class);
+
+    void adjust_timer(Util_timer *timer);
+
+    void del_timer(Util_timer *timer);
+
+    bool tick();
+
+    void set_batch_callback(void (*single)(client_data *), Batch_cb batch);
+
+    void set_tick_budget(int budget);
+
+    void set_default_slack(time_t slack);
+
+    time_t next_expiry();
+
+    void set_wakeup_callback(Wakeup_cb cb, void *arg);
+
+    void set_idle_callback(void (*cb)(client_data *), time_t idle_after);
+
+private:
+    int find_class(time_t timeout);
+
+    //定时器最晚被报告空闲的时间：最近一次活动（Time_out-时长）之后idle_after秒，
+    //合并窗口不超过idle_after，空闲连接最多占用缓冲区2*idle_after秒
+    time_t idle_deadline(const Fifo_class &c, const Util_timer *timer) const
+    {
+        return timer->Time_out - c.timeout + m_idle_after + (m_default_slack < m_idle_after ? m_default_slack : m_idle_after);
+    }
+
+    void tick_idle(time_t current_time);
+
+    void unlink_timer(Util_timer *timer);
+
+    void append_timer(Util_timer *timer, int fifo_class);
+
+    void prepend_timer(Util_timer *timer, int fifo_class);
+
+    void fallback_timer(Util_timer *timer);
+
+    void notify_wakeup(time_t deadline);
+
+    static void Fallback_wakeup(void *arg, time_t wake);
+
+    Fifo_class m_classes[MAX_FIFO_CLASSES];
+
+    int m_class_number;
+
+    Sorted_timer_list m_fallback;
+
+    void (*m_idle_cb)(client_data *);
+
+    time_t m_idle_after;
+
+    int m_budget;
+
+    void (*m_single_cb)(client_data *);
+
+    Batch_cb m_batch_cb;
+
+    std::vector<Util_timer *> m_expired;
+
+    std::vector<client_data *> m_batch;
+
+    time_t m_default_slack;
+
+    time_t m_armed;
+
+    Wakeup_cb m_wakeup_cb;
+
+    void *m_wakeup_arg;
+};
+
+//fd状态缓存覆盖的fd数，与服务器的MAX_FD保持一致
+const int UTILS_MAX_FD = 65536;
+
+/*
+struct: Fd_state
+fd状态缓存
+@ param events: (uint32_t) 最近一次注册到epoll的事件掩码
+@ param registered: (bool) 是否已经注册到epoll
+@ param nonblocking: (bool) 刚由Accept()返回、已经是非阻塞（accept4带SOCK_NONBLOCK），Addfd()用过一次即清除
+*/
+struct Fd_state
+{
+    uint32_t events;
+    bool registered;
+    bool nonblocking;
+};
+
+/*
+struct: Syscall_stats
+Utils发起及省去的系统调用计数，用于对比每个请求的系统调用次数
+*/
+struct Syscall_stats
+{
+    unsigned long accept;
+    unsigned long epoll_ctl;
+    unsigned long fcntl;
+    unsigned long epoll_ctl_saved;
+    unsigned long fcntl_saved;
 };
 
 /*
@@ -172,7 +496,7 @@ public:
 
 @ func: Init()
 @ param timeslot: (int)
-@ function: 初始化定时器
+@ function: 初始化定时器，timeslot同时作为m_timer_list的默认合并窗口，3*timeslot注册为固定时长
 @ return: 无
 
 @ func: SetNonBlocking()
@@ -185,7 +509,35 @@ public:
 @ param fd: (int) websocket文件描述符
 @ param one_shot: (bool) 是否开启EPOLLONESHOT
 @ param TRIGMode: (int) 触发模式
-@ function: 将文件描述符添加到epoll内，触发方式设置为ET模式，选择开启EPOLLONESHOT
+@ function: 将文件描述符添加到epoll内，触发方式设置为ET模式，选择开启EPOLLONESHOT；
+            只有紧接在Accept()之后注册时才省去fcntl
+@ return: 无
+
+@ func: Accept()
+@ param listenfd: (int) 监听文件描述符
+@ param address: (sockaddr_in *) 传出参数，客户端地址
+@ function: accept4直接得到非阻塞、close-on-exec的连接fd，省去之后的两次fcntl
+@ return: 连接fd，失败返回-1
+
+@ func: Modfd()
+@ param epollfd: (int) epoll文件描述符
+@ param fd: (int) websocket文件描述符
+@ param ev: (int) 需要监听的事件（EPOLLIN/EPOLLOUT）
+@ param one_shot: (bool) 是否开启EPOLLONESHOT
+@ param TRIGMode: (int) 触发模式
+@ function: 修改fd监听的事件。非ONESHOT且掩码与缓存相同时不再调用epoll_ctl，
+            ONESHOT触发后内核已解除监听，必须重新注册；ONESHOT由工作线程调用，不读写缓存
+@ return: 无
+
+@ func: Removefd()
+@ param epollfd: (int) epoll文件描述符
+@ param fd: (int) websocket文件描述符
+@ function: 从epoll删除fd、关闭fd并清除状态缓存
+@ return: 无
+
+@ func: ForgetFd() 静态函数
+@ param fd: (int)
+@ function: fd关闭后清除状态缓存，防止fd号复用时沿用旧状态
 @ return: 无
 
 @ func: Sig_handler() 静态函数
@@ -202,7 +554,14 @@ public:
 
 @ func: Timer_handler()
 @ param: 无
-@ function: 定时器处理任务，触发定时器链表的tick()函数，不断触发SIGALRM信号
+@ function: 定时器处理任务，触发定时器链表的tick()函数，再按next_expiry()设置下一次SIGALRM；
+            本次有未处理完的到期定时器时1秒后再触发，没有定时器时取消alarm，之后添加定时器时由ArmAlarm()重新设置
+@ return: 无
+
+@ func: ArmAlarm() 静态函数
+@ param arg: (void *) 未使用
+@ param wake: (time_t) 唤醒时间，0表示取消alarm
+@ function: 作为m_timer_list的唤醒回调，alarm精度为秒，至少1秒
 @ return: 无
 
 @ func: Show_error()
@@ -218,11 +577,24 @@ public:
 @ param u_pipefd: (static int *)
 @ function: 管道文件描述符
 
-@ param m_Timer_list: (Sorted_timer_list)
-@ function: 定时器链表容器
+@ param m_Timer_list: (Fifo_timer_list)
+@ function: 定时器链表容器，Init时注册3*timeslot（连接的空闲超时）这一种固定时长
 
 @ param u_epollfd: (static int)
 @ function: epoll文件描述符
+
+@ param u_fd_state: (static Fd_state[])
+@ function: 按fd号索引的状态缓存
+
+@ param u_syscalls: (static Syscall_stats)
+@ function: 系统调用计数
+
+@ param u_loop_epollfd: (static thread_local int)
+@ function: 多reactor模式下当前线程所属事件循环的epoll文件描述符，未设置时为0
+
+@ func: CurrentEpollfd() 静态函数
+@ function: 返回当前线程应使用的epoll文件描述符，优先使用事件循环自己的epoll
+@ return: (int) epoll文件描述符
 */
 class Utils{
 public:
@@ -235,19 +607,56 @@ public:
 
     void Addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
+    int Accept(int listenfd, sockaddr_in *address);
+
+    void Modfd(int epollfd, int fd, int ev, bool one_shot, int TRIGMode);
+
+    void Removefd(int epollfd, int fd);
+
+    static void ForgetFd(int fd);
+
     static void SigHandler(int sig);
 
     void AddSig(int sig, void(handler)(int), bool restart = true);
 
     void TimerHandler();
 
+    static void ArmAlarm(void *arg, time_t wake);
+
     void ShowError(int connfd, const char *info);
 
     int m_TIMESLOT;
 
     static int *u_pipefd;
 
-    Sorted_timer_list m_timer_list;
+    Fifo_timer_list m_timer_list;
 
     static int u_epollfd;
-}
\ No newline at end of file
+
+    static Fd_state u_fd_state[UTILS_MAX_FD];
+
+    static Syscall_stats u_syscalls;
+
+    static thread_local int u_loop_epollfd;
+
+    static int CurrentEpollfd();
+};
+
+/*
+@ func: cb_func()
+@ param user_data: (client_data *)
+@ function: 定时器到期回调，从当前线程的epoll中删除fd并关闭连接
+@ return: 无
+*/
+void cb_func(client_data *user_data);
+
+/*
+@ func: cb_func_batch()
+@ param users: (client_data **)
+@ param count: (int)
+@ function: 批量到期回调，一次遍历删除epoll事件并关闭所有socket，连接计数只做一次原子减
+@ return: 无
+*/
+void cb_func_batch(client_data **users, int count);
+
+#endif
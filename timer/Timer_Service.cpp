@@ -0,0 +1,334 @@
+#include "Timer_Service.h"
+
+/**********Timer_service********** */
+/*
+@ function: 基础构造函数
+@ return: 无
+*/
+Timer_service::Timer_service(){
+    m_shard_number = 0;
+    m_shards = NULL;
+    m_threads = NULL;
+    m_thread_number = 0;
+    m_TIMESLOT = 1;
+    m_args = NULL;
+}
+
+/*
+@ function: 基础析构函数，各分片链表析构时释放剩余定时器
+@ return: 无
+*/
+Timer_service::~Timer_service(){
+    Stop();
+    delete[] m_shards;
+}
+
+/*
+@ function: 初始化分片
+@ param: shard_number (int) <=0时取CPU核数
+@ return: (bool)
+*/
+bool Timer_service::Init(int shard_number){
+    if(shard_number <= 0){
+        shard_number = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(shard_number <= 0){
+            shard_number = 1;
+        }
+    }
+    m_shard_number = shard_number;
+    m_shards = new Timer_shard[m_shard_number];
+    for(int i = 0; i < m_shard_number; ++i){
+        m_shards[i].m_list.set_batch_callback(cb_func, cb_func_batch);
+        m_shards[i].m_list.set_expire_callback(Forget, &m_shards[i]);
+        m_shards[i].m_stop = false;
+        LOCK_NAME(m_shards[i].m_lock, "timer.shard");
+        LOCK_NAME(m_shards[i].m_wakeup, "timer.shard_wakeup");
+    }
+    return true;
+}
+
+/*
+@ function: 计算句柄所属分片
+@ param: handle (Conn_handle)
+@ return: (int) 分片编号
+槽位号是连续分配的，先做乘法哈希打散再取模；只用槽位号，同一槽位的新旧句柄在同一分片
+*/
+int Timer_service::ShardOf(Conn_handle handle) const{
+    unsigned int hash = (unsigned int)Conn_table::Index(handle) * 2654435761u;
+    return (int)((hash >> 16) % (unsigned int)m_shard_number);
+}
+
+Util_timer *Timer_service::Find(Timer_shard *shard, Conn_handle handle){
+    std::unordered_map<Conn_handle, Util_timer *>::iterator it = shard->m_timers.find(handle);
+    return it == shard->m_timers.end() ? NULL : it->second;
+}
+
+void Timer_service::Remove(Timer_shard *shard, Conn_handle handle, Util_timer *timer){
+    shard->m_timers.erase(handle);
+    shard->m_handles.erase(timer);
+    shard->m_list.del_timer(timer);
+}
+
+/*
+@ function: 到期定时器释放前从句柄表中删除
+@ param: arg (void *) Timer_shard
+@ param: timer (Util_timer *)
+@ return: 无
+在分片锁内由tick()调用
+*/
+void Timer_service::Forget(void *arg, Util_timer *timer){
+    Timer_shard *shard = (Timer_shard *)arg;
+    std::unordered_map<Util_timer *, Conn_handle>::iterator it = shard->m_handles.find(timer);
+    if(it != shard->m_handles.end()){
+        shard->m_timers.erase(it->second);
+        shard->m_handles.erase(it);
+    }
+}
+
+/*
+@ function: 添加定时器
+@ param: handle (Conn_handle)
+@ param: timer (Util_timer *)
+@ return: (bool)
+*/
+bool Timer_service::AddTimer(Conn_handle handle, Util_timer *timer){
+    if(!timer){
+        return false;
+    }
+    if(handle == 0){
+        delete timer;
+        return false;
+    }
+    Timer_shard *shard = &m_shards[ShardOf(handle)];
+    shard->m_lock.lock();
+    Util_timer *old = Find(shard, handle);
+    if(old){
+        Remove(shard, handle, old);
+    }
+    shard->m_timers[handle] = timer;
+    shard->m_handles[timer] = handle;
+    shard->m_list.add_timer(timer);
+    shard->m_lock.unlock();
+    return true;
+}
+
+/*
+@ function: 调整定时器过期时间
+@ param: handle (Conn_handle)
+@ param: timeout (time_t)
+@ return: (bool) 定时器已不存在时返回false
+*/
+bool Timer_service::AdjustTimer(Conn_handle handle, time_t timeout){
+    Timer_shard *shard = &m_shards[ShardOf(handle)];
+    shard->m_lock.lock();
+    Util_timer *timer = Find(shard, handle);
+    if(timer){
+        timer->Time_out = timeout;
+        shard->m_list.adjust_timer(timer);
+    }
+    shard->m_lock.unlock();
+    return timer != NULL;
+}
+
+/*
+@ function: 删除定时器
+@ param: handle (Conn_handle)
+@ return: (bool) 定时器已不存在时返回false
+*/
+bool Timer_service::DelTimer(Conn_handle handle){
+    Timer_shard *shard = &m_shards[ShardOf(handle)];
+    shard->m_lock.lock();
+    Util_timer *timer = Find(shard, handle);
+    if(timer){
+        Remove(shard, handle, timer);
+    }
+    shard->m_lock.unlock();
+    return timer != NULL;
+}
+
+/*
+@ function: 标记定时器立即过期
+@ param: handle (Conn_handle)
+@ return: (bool) 定时器已不存在时返回false
+过期时间提前会让adjust_timer把节点移到表头，所属线程下一次Tick()即执行回调
+*/
+bool Timer_service::ExpireTimer(Conn_handle handle){
+    Timer_shard *shard = &m_shards[ShardOf(handle)];
+    shard->m_lock.lock();
+    Util_timer *timer = Find(shard, handle);
+    if(timer){
+        timer->Time_out = 0;
+        shard->m_list.adjust_timer(timer);
+    }
+    shard->m_lock.unlock();
+    return timer != NULL;
+}
+
+/*
+@ function: 各分片中还活着的定时器数
+@ return: (size_t)
+*/
+size_t Timer_service::Count(){
+    size_t count = 0;
+    for(int i = 0; i < m_shard_number; ++i){
+        m_shards[i].m_lock.lock();
+        count += m_shards[i].m_timers.size();
+        m_shards[i].m_lock.unlock();
+    }
+    return count;
+}
+
+/*
+@ function: 处理一个分片的到期定时器
+@ param: shard (int)
+@ return: (bool) 是否还有留到下一次的到期定时器
+回调和释放都在锁内执行，释放前经Forget()从句柄表中删除，之后按句柄的操作查不到这个定时器
+*/
+bool Timer_service::Tick(int shard){
+    if(shard < 0 || shard >= m_shard_number){
+        return false;
+    }
+    m_shards[shard].m_lock.lock();
+    bool more = m_shards[shard].m_list.tick();
+    m_shards[shard].m_lock.unlock();
+    return more;
+}
+
+/*
+@ function: 依次处理所有分片
+@ return: (bool)
+*/
+bool Timer_service::TickAll(){
+    bool more = false;
+    for(int i = 0; i < m_shard_number; ++i){
+        more = Tick(i) || more;
+    }
+    return more;
+}
+
+/*
+@ function: 所有分片中最早的唤醒时间
+@ return: (time_t) 0表示没有定时器
+*/
+time_t Timer_service::NextExpiry(){
+    time_t wake = 0;
+    for(int i = 0; i < m_shard_number; ++i){
+        m_shards[i].m_lock.lock();
+        time_t shard_wake = m_shards[i].m_list.next_expiry();
+        m_shards[i].m_lock.unlock();
+        if(shard_wake != 0 && (wake == 0 || shard_wake < wake)){
+            wake = shard_wake;
+        }
+    }
+    return wake;
+}
+
+/*
+@ function: 为每个分片创建所属线程
+@ param: timeslot (int) 默认合并窗口(秒)
+@ return: (bool)
+*/
+bool Timer_service::Start(int timeslot){
+    if(m_threads){
+        return true;
+    }
+    m_TIMESLOT = timeslot > 0 ? timeslot : 1;
+    m_threads = new pthread_t[m_shard_number];
+    m_args = new Worker_arg[m_shard_number];
+    for(int i = 0; i < m_shard_number; ++i){
+        m_shards[i].m_lock.lock();
+        m_shards[i].m_stop = false;
+        m_shards[i].m_list.set_default_slack(m_TIMESLOT);
+        m_shards[i].m_list.set_wakeup_callback(Wakeup, &m_shards[i]);
+        m_shards[i].m_lock.unlock();
+        m_args[i].service = this;
+        m_args[i].shard = i;
+        if(pthread_create(&m_threads[i], NULL, Worker, &m_args[i]) != 0){
+            Stop();
+            return false;
+        }
+        ++m_thread_number;
+    }
+    return true;
+}
+
+/*
+@ function: 停止所有分片线程
+@ return: 无
+*/
+void Timer_service::Stop(){
+    if(!m_threads){
+        return;
+    }
+    for(int i = 0; i < m_shard_number; ++i){
+        m_shards[i].m_lock.lock();
+        m_shards[i].m_stop = true;
+        m_shards[i].m_list.set_wakeup_callback(NULL, NULL);
+        m_shards[i].m_wakeup.signal();
+        m_shards[i].m_lock.unlock();
+    }
+
+    for(int i = 0; i < m_thread_number; ++i){
+        pthread_join(m_threads[i], NULL);
+    }
+    delete[] m_threads;
+    delete[] m_args;
+    m_threads = NULL;
+    m_args = NULL;
+    m_thread_number = 0;
+}
+
+void *Timer_service::Worker(void *arg){
+    Worker_arg *worker_arg = (Worker_arg *)arg;
+    worker_arg->service->Run(worker_arg->shard);
+    return worker_arg;
+}
+
+/*
+@ function: 更早的定时器加入分片，唤醒分片线程重新计算等待时间
+@ param: arg (void *) Timer_shard
+@ param: wake (time_t)
+@ return: 无
+在分片锁内由add_timer/adjust_timer调用
+*/
+void Timer_service::Wakeup(void *arg, time_t){
+    ((Timer_shard *)arg)->m_wakeup.signal();
+}
+
+/*
+@ function: 分片线程主体，在本分片的下一个唤醒时间处理到期定时器
+@ param: shard (int)
+@ return: 无
+计算唤醒时间和开始等待在同一次加锁内，期间加入的定时器一定能通过m_wakeup唤醒本线程；
+合并窗口内到期的定时器在同一次Tick()中处理，分片为空时不会被唤醒
+*/
+void Timer_service::Run(int shard){
+    Timer_shard &self = m_shards[shard];
+    bool more = false;
+    self.m_lock.lock();
+    while(!self.m_stop){
+        //有留到下一次的到期定时器时不等待，释放锁让工作线程有机会操作分片后立即继续
+        if(more){
+            self.m_lock.unlock();
+            self.m_lock.lock();
+        }else{
+            time_t wake = self.m_list.next_expiry();
+            if(wake == 0){
+                self.m_wakeup.wait(self.m_lock.get());
+            }else if(wake > time(NULL)){
+                //next_expiry()是time(NULL)的秒数，与CLOCK_REALTIME一致
+                struct timespec t;
+                t.tv_sec = wake;
+                t.tv_nsec = TIMER_WAKE_MARGIN_NS;
+                self.m_wakeup.timewait(self.m_lock.get(), t);
+            }
+            //被更早的定时器唤醒时重新计算等待时间
+            wake = self.m_list.next_expiry();
+            if(self.m_stop || wake == 0 || time(NULL) < wake){
+                continue;
+            }
+        }
+        more = self.m_list.tick();
+    }
+    self.m_lock.unlock();
+}
@@ -0,0 +1,172 @@
+#ifndef TIMER_SERVICE_H
+#define TIMER_SERVICE_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <unordered_map>
+#include "List_Timer.h"
+#include "../lock/lock_profile.h"
+#include "../conn/Conn_Table.h"
+
+/*
+struct: Timer_shard
+定时器分片
+@ param m_lock: (Profiled_locker) 保护本分片链表和句柄表的互斥锁
+@ param m_list: (Sorted_timer_list) 本分片的升序链表
+@ param m_timers: (unordered_map) 句柄 → 定时器，只有表中的定时器还活着
+@ param m_handles: (unordered_map) 定时器 → 句柄，tick()释放到期定时器时经Expire_cb同步删除两张表
+@ param m_wakeup: (Profiled_cond) 分片线程在m_lock上等待到下一个唤醒时间，更早的定时器加入或Stop()时唤醒
+@ param m_stop: (bool) 由Stop()在m_lock内设置
+@ param m_pad: 填充到独立的缓存行，避免相邻分片的锁互相干扰
+*/
+struct Timer_shard
+{
+    Profiled_locker m_lock;
+    Sorted_timer_list m_list;
+    std::unordered_map<Conn_handle, Util_timer *> m_timers;
+    std::unordered_map<Util_timer *, Conn_handle> m_handles;
+    Profiled_cond m_wakeup;
+    bool m_stop;
+    char m_pad[64];
+};
+
+/*
+class: Timer_service
+线程安全的分片定时器服务
+@ function: 按连接句柄（Conn_handle）的槽位哈希把定时器分到N个分片，每个分片一把锁。
+            工作线程可以直接调整、删除定时器，不再需要通过timer_flag让主线程代为处理；
+            加入之后调用方只持有句柄，不再持有定时器指针：定时器到期后由Tick()释放，
+            之后的Adjust/Del/ExpireTimer在分片锁内查不到这个句柄，直接返回false，不会访问已释放的定时器；
+            连接关闭后槽位的代数加一，持有旧句柄的操作也查不到，不会作用到复用了同一槽位的新连接上。
+            到期回调只在分片的所属线程调用Tick()时执行：可以由Start()为每个分片创建一个所属线程，
+            也可以由主线程调用TickAll()。回调中的cb_func使用全局的Utils::u_epollfd，适用于单reactor+线程池模型，
+            多reactor模式下每个事件循环使用自己的m_timer_list
+public:
+函数：
+@ func: Init()
+@ param shard_number: (int) 分片数，<=0时取CPU核数
+@ return: (bool) 成功返回true
+
+@ func: ShardOf()
+@ param handle: (Conn_handle)
+@ return: (int) 句柄所属分片编号，只由槽位决定
+
+@ func: AddTimer()
+@ param handle: (Conn_handle) 连接句柄，0无效
+@ param timer: (Util_timer *) 之后归Timer_service所有，调用方不能再访问
+@ function: 同一句柄已有定时器时先删除旧的
+@ return: (bool) 句柄无效时返回false并释放timer
+
+@ func: AdjustTimer()
+@ param handle: (Conn_handle)
+@ param timeout: (time_t) 新的过期时间
+@ function: 在分片锁内更新Time_out，过期时间延后时为O(1)
+@ return: (bool) 定时器已经到期释放或句柄已失效时返回false，不做任何操作
+
+@ func: DelTimer()
+@ param handle: (Conn_handle)
+@ function: 删除并释放定时器，不调用回调
+@ return: (bool) 同上
+
+@ func: ExpireTimer()
+@ param handle: (Conn_handle)
+@ function: 标记定时器立即过期，回调在所属线程下一次Tick()时执行
+@ return: (bool) 同上
+
+@ func: Count()
+@ return: (size_t) 各分片中还活着的定时器数
+
+@ func: Tick()
+@ param shard: (int) 分片编号
+@ function: 由分片所属线程调用，在分片锁内处理到期定时器并从句柄表中删除。回调中不能再操作同一分片
+@ return: (bool) 本分片还有留到下一次的到期定时器时返回true
+
+@ func: TickAll()
+@ function: 单线程驱动所有分片（单reactor模式）
+@ return: (bool) 任一分片还有留到下一次的到期定时器时返回true
+
+@ func: NextExpiry()
+@ function: TickAll()的调用方据此计算等待时间
+@ return: (time_t) 各分片next_expiry()的最小值，没有定时器时返回0
+
+@ func: Start()
+@ param timeslot: (int) 默认合并窗口(秒)
+@ function: 为每个分片创建一个所属线程，在下一个唤醒时间调用Tick()，分片为空时无限期等待
+@ return: (bool) 成功返回true
+
+@ func: Stop()
+@ function: 唤醒并等待所有分片线程退出
+@ return: 无
+*/
+class Timer_service{
+public:
+    Timer_service();
+
+    ~Timer_service();
+
+    bool Init(int shard_number);
+
+    int ShardOf(Conn_handle handle) const;
+
+    bool AddTimer(Conn_handle handle, Util_timer *timer);
+
+    bool AdjustTimer(Conn_handle handle, time_t timeout);
+
+    bool DelTimer(Conn_handle handle);
+
+    bool ExpireTimer(Conn_handle handle);
+
+    size_t Count();
+
+    bool Tick(int shard);
+
+    bool TickAll();
+
+    time_t NextExpiry();
+
+    bool Start(int timeslot);
+
+    void Stop();
+
+    int ShardNumber() const { return m_shard_number; }
+
+private:
+    //在分片锁内调用：句柄对应的定时器，没有时返回NULL
+    static Util_timer *Find(Timer_shard *shard, Conn_handle handle);
+
+    //在分片锁内调用：从句柄表和链表中删除并释放
+    static void Remove(Timer_shard *shard, Conn_handle handle, Util_timer *timer);
+
+    //分片链表的到期释放通知，arg为Timer_shard
+    static void Forget(void *arg, Util_timer *timer);
+
+    static void *Worker(void *arg);
+
+    //分片链表的唤醒回调，arg为Timer_shard
+    static void Wakeup(void *arg, time_t wake);
+
+    void Run(int shard);
+
+    int m_shard_number;
+
+    Timer_shard *m_shards;
+
+    //分片所属线程
+    pthread_t *m_threads;
+
+    int m_thread_number;
+
+    int m_TIMESLOT;
+
+    //传给分片线程的参数
+    struct Worker_arg
+    {
+        Timer_service *service;
+        int shard;
+    };
+
+    Worker_arg *m_args;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "Trace.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+volatile bool Tracer::u_enabled = false;
+int Tracer::u_sample_rate = 1;
+unsigned long Tracer::u_capacity = 1 << 16;
+uint64_t Tracer::u_start_tsc = 0;
+uint64_t Tracer::u_start_ns = 0;
+locker Tracer::u_lock;
+std::vector<Trace_buffer *> Tracer::u_buffers;
+thread_local unsigned long Tracer::t_request = 0;
+thread_local bool Tracer::t_sampled = false;
+thread_local Trace_buffer *Tracer::t_buffer = NULL;
+
+static uint64_t monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+@ function: 开始记录
+@ param: sample_rate (int)
+@ param: buffer_events (int)
+@ return: 无
+*/
+void Tracer::Start(int sample_rate, int buffer_events){
+    u_sample_rate = sample_rate > 0 ? sample_rate : 1;
+    unsigned long capacity = 1;
+    while(capacity < (unsigned long)(buffer_events > 0 ? buffer_events : 1)){
+        capacity <<= 1;
+    }
+    u_capacity = capacity;
+    u_start_ns = monotonic_ns();
+    u_start_tsc = TraceNow();
+    u_enabled = true;
+}
+
+/*
+@ function: 停止记录，正在处理的请求在下一次SetRequest()后不再被采样
+@ return: 无
+*/
+void Tracer::Stop(){
+    u_enabled = false;
+}
+
+/*
+@ function: 当前线程的缓冲区，第一次记录时创建并登记
+@ return: (Trace_buffer *)
+*/
+Trace_buffer *Tracer::Buffer(){
+    if(!t_buffer){
+        Trace_buffer *buffer = new Trace_buffer;
+        buffer->m_events = new Trace_event[u_capacity];
+        buffer->m_mask = u_capacity - 1;
+        buffer->m_head = 0;
+        buffer->m_tid = (int)syscall(SYS_gettid);
+        u_lock.lock();
+        u_buffers.push_back(buffer);
+        u_lock.unlock();
+        t_buffer = buffer;
+    }
+    return t_buffer;
+}
+
+/*
+@ function: 写入一条记录
+@ param: name (const char *)
+@ param: begin (uint64_t)
+@ param: end (uint64_t)
+@ param: async (bool)
+@ return: 无
+*/
+void Tracer::Record(const char *name, uint64_t begin, uint64_t end, bool async){
+    Trace_buffer *buffer = Buffer();
+    Trace_event &event = buffer->m_events[buffer->m_head & buffer->m_mask];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.request = t_request;
+    event.async = async;
+    __atomic_store_n(&buffer->m_head, buffer->m_head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+@ function: 导出为Chrome trace JSON
+@ param: path (const char *)
+@ return: (bool)
+同步span导出为完整事件("X")；异步span导出为一对"b"/"e"，id为请求号，在Perfetto中单独成行
+*/
+bool Tracer::Export(const char *path){
+    FILE *fp = fopen(path, "w");
+    if(!fp){
+        return false;
+    }
+
+    //用开始和导出两个时刻换算时间戳，时间从Start()开始计
+    uint64_t end_tsc = TraceNow();
+    uint64_t end_ns = monotonic_ns();
+    double ns_per_tick = end_tsc > u_start_tsc ? (double)(end_ns - u_start_ns) / (end_tsc - u_start_tsc) : 1.0;
+    int pid = (int)getpid();
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    u_lock.lock();
+    for(size_t i = 0; i < u_buffers.size(); ++i){
+        Trace_buffer *buffer = u_buffers[i];
+        unsigned long head = __atomic_load_n(&buffer->m_head, __ATOMIC_ACQUIRE);
+        unsigned long count = head < buffer->m_mask + 1 ? head : buffer->m_mask + 1;
+        for(unsigned long j = head - count; j < head; ++j){
+            const Trace_event &event = buffer->m_events[j & buffer->m_mask];
+            if(event.begin < u_start_tsc || event.end < event.begin){
+                continue;
+            }
+            double ts = (event.begin - u_start_tsc) * ns_per_tick / 1000.0;
+            double dur = (event.end - event.begin) * ns_per_tick / 1000.0;
+            if(event.async){
+                fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"b\",\"id\":\"0x%lx\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n"
+                            "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"e\",\"id\":\"0x%lx\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                        first ? "" : ",\n", event.name, event.request, ts, pid, buffer->m_tid,
+                        event.name, event.request, ts + dur, pid, buffer->m_tid);
+            }else{
+                fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"request\":\"0x%lx\"}}",
+                        first ? "" : ",\n", event.name, ts, dur, pid, buffer->m_tid, event.request);
+            }
+            first = false;
+        }
+    }
+    u_lock.unlock();
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,191 @@
+#ifndef TRACE_H
+#define TRACE_H
+/*
+头文件定义
+@function: 使用到的头文件
+*/
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "../lock/locker.h"
+
+/*
+@ func: TraceNow()
+@ function: 追踪用的时间戳，x86上读TSC，其他平台退回CLOCK_MONOTONIC纳秒；
+            导出时按开始、导出两个时刻的TSC与纳秒换算
+@ return: (uint64_t)
+*/
+inline uint64_t TraceNow()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+struct: Trace_event
+一条追踪记录
+@ param name: (const char *) span名，必须是字符串常量
+@ param begin / end: (uint64_t) TraceNow()时间戳
+@ param request: (unsigned long) 所属请求，0表示不属于请求
+@ param async: (bool) 跨线程的区间（例如请求在队列中等待），导出为异步事件
+*/
+struct Trace_event
+{
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    unsigned long request;
+    bool async;
+};
+
+/*
+struct: Trace_buffer
+每个线程一个环形缓冲区，只由所属线程写入，写满后覆盖最旧的记录
+*/
+struct Trace_buffer
+{
+    Trace_event *m_events;
+    unsigned long m_mask;
+    unsigned long m_head;
+    int m_tid;
+};
+
+/*
+class: Tracer
+请求生命周期追踪（全部为静态成员）
+@ function: 以请求为单位采样：线程开始处理某个请求时调用SetRequest()，按请求号哈希决定是否记录，
+            同一个连接在主线程和工作线程上的span都会被记录或都不记录，导出后可以看到完整时间线；
+            未启动或请求未被采样时，每个span只有一次线程局部变量的判断
+public:
+@ func: Start()
+@ param sample_rate: (int) 每sample_rate个请求记录1个，1表示全部记录
+@ param buffer_events: (int) 每个线程的环形缓冲区容量，向上取2的幂
+@ return: 无
+
+@ func: Stop()
+@ function: 停止记录，已记录的内容保留到Export()
+@ return: 无
+
+@ func: Export()
+@ param path: (const char *) 输出文件，Chrome trace JSON格式，可以用chrome://tracing或Perfetto打开
+@ return: (bool) 成功返回true
+@ function: 各线程仍在写入时导出，正在被覆盖的少数记录可能不完整，建议先Stop()
+
+@ func: SetRequest()
+@ param request: (unsigned long) 请求号，一般为连接对象的地址，0表示当前线程不在处理请求
+@ return: 无
+
+@ func: Sampled()
+@ return: (bool) 当前线程的当前请求是否被采样
+
+@ func: Record()
+@ param name: (const char *) span名
+@ param begin / end: (uint64_t) 时间戳
+@ param async: (bool) 是否为跨线程区间
+@ return: 无
+*/
+class Tracer{
+public:
+    static void Start(int sample_rate, int buffer_events);
+
+    static void Stop();
+
+    static bool Export(const char *path);
+
+    static void SetRequest(unsigned long request)
+    {
+        t_request = request;
+        t_sampled = u_enabled && request != 0 &&
+                    ((request >> 4) * 2654435761u >> 8) % (unsigned long)u_sample_rate == 0;
+    }
+
+    static bool Sampled() { return t_sampled; }
+
+    static void Record(const char *name, uint64_t begin, uint64_t end, bool async = false);
+
+private:
+    static Trace_buffer *Buffer();
+
+    static volatile bool u_enabled;
+
+    static int u_sample_rate;
+
+    static unsigned long u_capacity;
+
+    //开始时刻的TSC与纳秒，用于换算
+    static uint64_t u_start_tsc;
+
+    static uint64_t u_start_ns;
+
+    static locker u_lock;
+
+    static std::vector<Trace_buffer *> u_buffers;
+
+    static thread_local unsigned long t_request;
+
+    static thread_local bool t_sampled;
+
+    static thread_local Trace_buffer *t_buffer;
+};
+
+/*
+class: Trace_scope
+RAII的span，构造时记录开始时间，析构时写入当前线程的缓冲区
+*/
+class Trace_scope{
+public:
+    explicit Trace_scope(const char *name) : m_name(Tracer::Sampled() ? name : NULL), m_begin(0)
+    {
+        if(m_name){
+            m_begin = TraceNow();
+        }
+    }
+
+    ~Trace_scope()
+    {
+        if(m_name){
+            Tracer::Record(m_name, m_begin, TraceNow());
+        }
+    }
+
+private:
+    const char *m_name;
+    uint64_t m_begin;
+};
+
+/*
+追踪用的宏，定义TRACE_DISABLE时全部展开为空
+@ TRACE_SCOPE(name): 当前作用域作为一个span
+@ TRACE_REQUEST(request): 设置当前线程正在处理的请求
+@ TRACE_BEGIN(): 未采样时为0，否则为当前时间戳，配合TRACE_SPAN记录不便用作用域表示的区间
+@ TRACE_SPAN(name, begin): 记录从begin到现在的span，begin为0时不记录
+@ TRACE_ASYNC(name, begin): 同TRACE_SPAN，导出为异步事件，用于开始和结束不在同一线程的区间
+@ TRACE_LOCK(mutex, name): 加锁，等待时间记为一个span
+*/
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef TRACE_DISABLE
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_REQUEST(request) do {} while (0)
+#define TRACE_BEGIN() ((uint64_t)0)
+#define TRACE_SPAN(name, begin) do {} while (0)
+#define TRACE_ASYNC(name, begin) do {} while (0)
+#define TRACE_LOCK(mutex, name) (mutex).lock()
+#else
+#define TRACE_SCOPE(name) Trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_REQUEST(request) Tracer::SetRequest((unsigned long)(request))
+#define TRACE_BEGIN() (Tracer::Sampled() ? TraceNow() : (uint64_t)0)
+#define TRACE_SPAN(name, begin) do { uint64_t trace_begin_ = (begin); if (trace_begin_) Tracer::Record(name, trace_begin_, TraceNow()); } while (0)
+#define TRACE_ASYNC(name, begin) do { uint64_t trace_begin_ = (begin); if (trace_begin_) Tracer::Record(name, trace_begin_, TraceNow(), true); } while (0)
+#define TRACE_LOCK(mutex, name) do { Trace_scope TRACE_CONCAT(trace_lock_, __LINE__)(name); (mutex).lock(); } while (0)
+#endif
+
+#endif